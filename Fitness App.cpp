@@ -3,10 +3,33 @@
 // Demonstrates OOP, arrays, pointers, pointer arithmetic, inheritance, polymorphism,
 // operator/function overloading, exception handling, constructors/destructors, file I/O.
 
-// Compile: g++ -std=c++17 fitness_app.cpp -o fitness_app
-// Run: ./fitness_app
+// Compile: g++ -std=c++17 -O2 -pthread fitness_app.cpp -o fitness_app
+//          (-std=c++20 also builds the coroutine API and "bench async"; C++17 leaves it out)
+// Run: ./fitness_app                      (demo)
+//      ./fitness_app import <profiles.csv> [sessions.csv]
+//      ./fitness_app search "<query>" [logfile]
+//      ./fitness_app bench <all|name>
 
 #include <bits/stdc++.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define FITNESS_HAVE_MMAP 1
+#endif
+#if defined(__linux__)
+#include <sched.h>
+#define FITNESS_HAVE_AFFINITY 1
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+// coroutine API (build with -std=c++20 to enable)
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#include <coroutine>
+#define FITNESS_HAVE_COROUTINES 1
+#endif
 using namespace std;
 
 /* ---------------------------
@@ -19,33 +42,106 @@ public:
     const char* what() const noexcept override { return msg.c_str(); }
 };
 
+/* ---------------------------
+   Validation error codes (no-throw path)
+   --------------------------- */
+// Bulk ingestion cannot afford an exception (and a string allocation) per bad row,
+// so validation reports a small error code; messages are static and never allocate.
+enum class ProfileError : uint8_t {
+    None = 0,
+    EmptyName,
+    AgeOutOfRange,
+    WeightOutOfRange,
+    HeightOutOfRange,
+    InvalidGender,
+    Count
+};
+
+inline const char* profileErrorMessage(ProfileError e) noexcept {
+    static const char* const messages[] = {
+        "OK",
+        "Name is empty",
+        "Age out of range",
+        "Weight out of range",
+        "Height out of range",
+        "Gender must be 'M' or 'F'"
+    };
+    size_t i = static_cast<size_t>(e);
+    return i < static_cast<size_t>(ProfileError::Count) ? messages[i] : "Unknown error";
+}
+
+// expected-style result: either a value or a ProfileError (std::expected is C++23)
+template <typename T>
+class Expected {
+    T val;
+    ProfileError err;
+public:
+    Expected(const T &v): val(v), err(ProfileError::None) {}
+    Expected(ProfileError e): val(), err(e) {}
+    bool ok() const noexcept { return err == ProfileError::None; }
+    explicit operator bool() const noexcept { return ok(); }
+    const T& value() const noexcept { return val; } // only meaningful when ok()
+    T valueOr(const T &fallback) const noexcept { return ok() ? val : fallback; }
+    ProfileError error() const noexcept { return err; }
+    const char* message() const noexcept { return profileErrorMessage(err); }
+};
+
+// accepted ranges for profile fields
+struct ProfileLimits {
+    int minAge = 5, maxAge = 120;
+    double minWeightKg = 20.0, maxWeightKg = 400.0;
+    double minHeightCm = 50.0, maxHeightCm = 260.0;
+};
+
+inline ProfileError validateProfile(const char *name, size_t nameLen, int age, double w, double h, char g,
+                                    const ProfileLimits &lim = ProfileLimits()) noexcept {
+    if (name == nullptr || nameLen == 0) return ProfileError::EmptyName;
+    if (age < lim.minAge || age > lim.maxAge) return ProfileError::AgeOutOfRange;
+    // written so that NaN fails the check
+    if (!(w >= lim.minWeightKg && w <= lim.maxWeightKg)) return ProfileError::WeightOutOfRange;
+    if (!(h >= lim.minHeightCm && h <= lim.maxHeightCm)) return ProfileError::HeightOutOfRange;
+    if (g != 'M' && g != 'F') return ProfileError::InvalidGender;
+    return ProfileError::None;
+}
+
 /* ---------------------------
    Base Person class
    --------------------------- */
 class Person {
+public:
+    // strings come from this allocator, so a request can keep people in an arena
+    using allocator_type = pmr::polymorphic_allocator<char>;
+    // constructor/destructor trace lines (benchmarks turn them off)
+    static inline bool traceLifecycle = true;
 protected:
-    string name;
+    pmr::string name;
     int age;
     double weightKg;
     double heightCm;
     char gender; // 'M' or 'F'
 public:
     // Default constructor
-    Person(): name("Unknown"), age(18), weightKg(70.0), heightCm(170.0), gender('M') {
-        cout << "[Person] default constructed\n";
+    explicit Person(const allocator_type &alloc = allocator_type())
+        : name("Unknown", alloc), age(18), weightKg(70.0), heightCm(170.0), gender('M') {
+        if (traceLifecycle) cout << "[Person] default constructed\n";
     }
     // Parameterized constructor
-    Person(const string &n, int a, double w, double h, char g)
-        : name(n), age(a), weightKg(w), heightCm(h), gender(g) {
-        cout << "[Person] parameterized constructed\n";
+    Person(string_view n, int a, double w, double h, char g, const allocator_type &alloc = allocator_type())
+        : name(n, alloc), age(a), weightKg(w), heightCm(h), gender(g) {
+        if (traceLifecycle) cout << "[Person] parameterized constructed\n";
     }
     // Copy constructor
     Person(const Person &other) = default;
+    Person(const Person &other, const allocator_type &alloc)
+        : name(other.name, alloc), age(other.age), weightKg(other.weightKg), heightCm(other.heightCm),
+          gender(other.gender) {}
     // Destructor
-    virtual ~Person() { cout << "[Person] destroyed: " << name << "\n"; }
+    virtual ~Person() { if (traceLifecycle) cout << "[Person] destroyed: " << name << "\n"; }
+
+    allocator_type get_allocator() const { return name.get_allocator(); }
 
     // Getters / setters
-    string getName() const { return name; }
+    string getName() const { return string(name); }
     void setName(const string &n) { name = n; }
     int getAge() const { return age; }
     void setAge(int a) { age = a; }
@@ -56,55 +152,297 @@ public:
     char getGender() const { return gender; }
     void setGender(char g) { gender = g; }
 
+    // Validation without exceptions
+    ProfileError validate(const ProfileLimits &lim = ProfileLimits()) const noexcept {
+        return validateProfile(name.data(), name.size(), age, weightKg, heightCm, gender, lim);
+    }
+
     // BMI helper
-    double bmi() const {
+    Expected<double> tryBmi() const noexcept {
         double h_m = heightCm / 100.0;
-        if (h_m <= 0) throw FitnessException("Invalid height for BMI calculation");
+        if (h_m <= 0) return ProfileError::HeightOutOfRange;
         return weightKg / (h_m * h_m);
     }
+    double bmi() const {
+        Expected<double> r = tryBmi();
+        if (!r) throw FitnessException("Invalid height for BMI calculation");
+        return r.value();
+    }
 };
 
 /* ---------------------------
    User class (derived)
    --------------------------- */
 class User : public Person {
-    string fitnessGoal; // e.g., "Lose weight", "Build muscle", "Maintain"
+    pmr::string fitnessGoal; // e.g., "Lose weight", "Build muscle", "Maintain"
 public:
     // Demonstrate constructor chaining
-    User(): Person(), fitnessGoal("Maintain") {
-        cout << "[User] default constructed\n";
+    explicit User(const allocator_type &alloc = allocator_type()): Person(alloc), fitnessGoal("Maintain", alloc) {
+        if (traceLifecycle) cout << "[User] default constructed\n";
     }
-    User(const string &n, int a, double w, double h, char g, const string &goal)
-        : Person(n, a, w, h, g), fitnessGoal(goal) {
-        cout << "[User] parameterized constructed\n";
+    User(string_view n, int a, double w, double h, char g, string_view goal,
+         const allocator_type &alloc = allocator_type())
+        : Person(n, a, w, h, g, alloc), fitnessGoal(goal, alloc) {
+        if (traceLifecycle) cout << "[User] parameterized constructed\n";
     }
-    ~User() { cout << "[User] destroyed: " << name << "\n"; }
+    User(const User &other) = default;
+    User(const User &other, const allocator_type &alloc): Person(other, alloc), fitnessGoal(other.fitnessGoal, alloc) {}
+    ~User() { if (traceLifecycle) cout << "[User] destroyed: " << name << "\n"; }
 
     void setGoal(const string &g) { fitnessGoal = g; }
-    string getGoal() const { return fitnessGoal; }
+    string getGoal() const { return string(fitnessGoal); }
+};
+
+/* ---------------------------
+   Columnar profile validation
+   --------------------------- */
+// Structure-of-arrays view of many profiles, as produced by bulk imports.
+struct ProfileColumns {
+    vector<int> age;
+    vector<double> weightKg;
+    vector<double> heightCm;
+    vector<char> gender;
+
+    size_t size() const { return age.size(); }
+    void reserve(size_t n) { age.reserve(n); weightKg.reserve(n); heightCm.reserve(n); gender.reserve(n); }
+    void push_back(int a, double w, double h, char g) {
+        age.push_back(a); weightKg.push_back(w); heightCm.push_back(h); gender.push_back(g);
+    }
+};
+
+// Result of a batch check: one bitmap per error code (bit i = row i failed),
+// plus per-code counts and the first offending row for the summary.
+struct ValidationReport {
+    static constexpr size_t kCodes = static_cast<size_t>(ProfileError::Count);
+    size_t rows = 0;
+    array<vector<uint64_t>, kCodes> bitmaps;
+    vector<uint64_t> anyError;
+    array<size_t, kCodes> counts{};
+    array<size_t, kCodes> firstRow{};
+
+    bool rowValid(size_t i) const noexcept { return !((anyError[i >> 6] >> (i & 63)) & 1u); }
+    ProfileError firstError(size_t i) const noexcept {
+        for (size_t c = 1; c < kCodes; ++c)
+            if ((bitmaps[c][i >> 6] >> (i & 63)) & 1u) return static_cast<ProfileError>(c);
+        return ProfileError::None;
+    }
+    size_t invalidRows() const noexcept {
+        size_t n = 0;
+        for (uint64_t w : anyError) n += __builtin_popcountll(w);
+        return n;
+    }
+    void summarize(ostream &os) const {
+        size_t bad = invalidRows();
+        os << "Validated " << rows << " profiles: " << (rows - bad) << " valid, " << bad << " invalid\n";
+        for (size_t c = 1; c < kCodes; ++c) {
+            if (counts[c] == 0) continue;
+            os << "  " << profileErrorMessage(static_cast<ProfileError>(c)) << ": " << counts[c]
+               << " (first at row " << firstRow[c] << ")\n";
+        }
+    }
+};
+
+// Range checks over whole columns, 64 rows per bitmap word; never throws on bad data.
+inline ValidationReport validateColumns(const ProfileColumns &cols, const ProfileLimits &lim = ProfileLimits()) {
+    ValidationReport rep;
+    const size_t n = cols.size();
+    const size_t words = (n + 63) / 64;
+    rep.rows = n;
+    for (auto &b : rep.bitmaps) b.assign(words, 0);
+    rep.anyError.assign(words, 0);
+
+    const size_t AGE = static_cast<size_t>(ProfileError::AgeOutOfRange);
+    const size_t WEIGHT = static_cast<size_t>(ProfileError::WeightOutOfRange);
+    const size_t HEIGHT = static_cast<size_t>(ProfileError::HeightOutOfRange);
+    const size_t GENDER = static_cast<size_t>(ProfileError::InvalidGender);
+
+    for (size_t wi = 0; wi < words; ++wi) {
+        size_t base = wi * 64, end = min(n, base + 64);
+        uint64_t a = 0, w = 0, h = 0, g = 0;
+        // branch-free inner loop: each comparison becomes one bit
+        for (size_t i = base; i < end; ++i) {
+            uint64_t bit = 1ull << (i - base);
+            a |= bit & -uint64_t(cols.age[i] < lim.minAge || cols.age[i] > lim.maxAge);
+            w |= bit & -uint64_t(!(cols.weightKg[i] >= lim.minWeightKg && cols.weightKg[i] <= lim.maxWeightKg));
+            h |= bit & -uint64_t(!(cols.heightCm[i] >= lim.minHeightCm && cols.heightCm[i] <= lim.maxHeightCm));
+            g |= bit & -uint64_t(cols.gender[i] != 'M' && cols.gender[i] != 'F');
+        }
+        rep.bitmaps[AGE][wi] = a;
+        rep.bitmaps[WEIGHT][wi] = w;
+        rep.bitmaps[HEIGHT][wi] = h;
+        rep.bitmaps[GENDER][wi] = g;
+        rep.anyError[wi] = a | w | h | g;
+    }
+    for (size_t c = 1; c < ValidationReport::kCodes; ++c) {
+        const vector<uint64_t> &bm = rep.bitmaps[c];
+        for (size_t wi = 0; wi < words; ++wi) {
+            if (bm[wi] == 0) continue;
+            if (rep.counts[c] == 0) rep.firstRow[c] = wi * 64 + __builtin_ctzll(bm[wi]);
+            rep.counts[c] += __builtin_popcountll(bm[wi]);
+        }
+    }
+    return rep;
+}
+
+/* ---------------------------
+   Workout kinds and shared calorie formula
+   --------------------------- */
+enum class WorkoutKind : uint8_t { Cardio = 0, Strength = 1, Flexibility = 2 };
+const size_t kWorkoutKinds = 3;
+
+inline const char* workoutKindName(WorkoutKind k) {
+    switch (k) {
+        case WorkoutKind::Cardio: return "Cardio";
+        case WorkoutKind::Strength: return "Strength";
+        default: return "Flexibility";
+    }
+}
+// typical MET per kind (Cardio uses the workout's own value when it has one)
+inline double defaultMet(WorkoutKind k) {
+    return k == WorkoutKind::Cardio ? 7.0 : k == WorkoutKind::Strength ? 6.0 : 3.0;
+}
+// how strongly intensity (1..10, neutral 5) scales the MET
+inline double intensitySlope(WorkoutKind k) {
+    return k == WorkoutKind::Cardio ? 0.05 : k == WorkoutKind::Strength ? 0.04 : 0.0;
+}
+// calories burned per kg of body weight; estimateCalories() is this times weightKg,
+// so columnar code (imports, batch scoring) stays consistent with the classes
+inline double caloriesPerKg(WorkoutKind k, double met, int durationMin, int intensity) {
+    double hours = durationMin / 60.0;
+    return met * (1.0 + (intensity - 5) * intensitySlope(k)) * hours;
+}
+
+/* ---------------------------
+   Per-user MET calibration (recursive least squares)
+   --------------------------- */
+// Keytel et al. (2005) heart-rate equation, used as ground truth for calibration
+inline double heartRateCalories(char gender, int age, double weightKg, double avgHr, int durationMin) {
+    double perMin = gender == 'F'
+        ? (-20.4022 + 0.4472 * avgHr - 0.1263 * weightKg + 0.074 * age) / 4.184
+        : (-55.0969 + 0.6309 * avgHr + 0.1988 * weightKg + 0.2017 * age) / 4.184;
+    return max(0.0, perMin * durationMin);
+}
+
+// Per kind: calories = MET * weightKg * hours * (a + c * (intensity - 5)).
+// (a, c) start at (1, intensitySlope), i.e. the fixed formula, and are refined by a
+// two-parameter RLS with forgetting on the ratio measured / raw MET calories.
+struct KindCalibration {
+    float a, c;          // multiplier and intensity slope
+    float p00, p01, p11; // RLS covariance (symmetric 2x2)
+};
+
+struct UserCalibration {
+    KindCalibration kinds[kWorkoutKinds];
+    uint8_t samples[kWorkoutKinds]; // saturating count of sessions learned from
+
+    UserCalibration() { reset(); }
+    void reset() {
+        for (size_t k = 0; k < kWorkoutKinds; ++k) {
+            // covariance in units of the measurement noise (~0.1 on the ratio):
+            // prior std-dev ~0.2 on the multiplier, ~0.02 on the slope
+            kinds[k] = {1.0f, (float)intensitySlope(static_cast<WorkoutKind>(k)), 4.0f, 0.0f, 0.04f};
+            samples[k] = 0;
+        }
+    }
+
+    double multiplier(WorkoutKind k, int intensity) const {
+        const KindCalibration &m = kinds[static_cast<size_t>(k)];
+        return m.a + m.c * (intensity - 5);
+    }
+    double estimate(WorkoutKind k, double met, int durationMin, int intensity, double weightKg) const {
+        return met * weightKg * (durationMin / 60.0) * multiplier(k, intensity);
+    }
+
+    // One RLS step; false when the session carries no usable signal.
+    bool observe(WorkoutKind k, double met, int durationMin, int intensity, double weightKg,
+                 double measuredCalories, double forgetting = 0.98) {
+        double raw = met * weightKg * (durationMin / 60.0);
+        if (!(raw > 1.0) || !(measuredCalories > 0.0)) return false;
+        double z = min(4.0, measuredCalories / raw);
+        double x0 = 1.0, x1 = intensity - 5;
+        KindCalibration &m = kinds[static_cast<size_t>(k)];
+        double px0 = m.p00 * x0 + m.p01 * x1, px1 = m.p01 * x0 + m.p11 * x1;
+        double denom = forgetting + x0 * px0 + x1 * px1;
+        double k0 = px0 / denom, k1 = px1 / denom;
+        double err = z - (m.a * x0 + m.c * x1);
+        m.a = (float)min(3.0, max(0.3, m.a + k0 * err));
+        m.c = (float)min(0.3, max(-0.3, m.c + k1 * err));
+        // P = (P - k x^T P) / lambda, bounded by the prior: a direction the sessions do
+        // not excite (e.g. always the same intensity) would otherwise grow by 1/lambda
+        // per step until one unusual session swings the estimate to a clamp
+        double p00 = (m.p00 - k0 * px0) / forgetting;
+        double p01 = (m.p01 - k0 * px1) / forgetting;
+        double p11 = (m.p11 - k1 * px1) / forgetting;
+        const double maxP00 = 4.0, maxP11 = 0.04;
+        if (!isfinite(p00) || !isfinite(p01) || !isfinite(p11) || p00 <= 0.0 || p11 <= 0.0) {
+            p00 = maxP00; p01 = 0.0; p11 = maxP11; // lost positive definiteness: back to the prior
+        }
+        if (p00 > maxP00) { p01 *= sqrt(maxP00 / p00); p00 = maxP00; }
+        if (p11 > maxP11) { p01 *= sqrt(maxP11 / p11); p11 = maxP11; }
+        double maxP01 = 0.99 * sqrt(p00 * p11);
+        m.p00 = (float)p00;
+        m.p01 = (float)min(maxP01, max(-maxP01, p01));
+        m.p11 = (float)p11;
+        uint8_t &n = samples[static_cast<size_t>(k)];
+        if (n < 255) ++n;
+        return true;
+    }
 };
+static_assert(sizeof(UserCalibration) <= 64, "UserCalibration should fit in one cache line");
 
 /* ---------------------------
    Abstract Workout base
    --------------------------- */
 class Workout {
+public:
+    using allocator_type = pmr::polymorphic_allocator<char>;
 protected:
-    string name;
+    pmr::string name;
     int durationMinutes;
     int intensity; // 1..10
 public:
-    Workout(const string &n = "Generic", int d = 30, int inten = 5)
-        : name(n), durationMinutes(d), intensity(inten) {}
+    Workout(string_view n = "Generic", int d = 30, int inten = 5, const allocator_type &alloc = allocator_type())
+        : name(n, alloc), durationMinutes(d), intensity(inten) {}
+    Workout(const Workout &other) = default;
+    Workout(Workout &&other) noexcept = default; // pmr::string keeps its allocator on move
+    Workout(const Workout &other, const allocator_type &alloc)
+        : name(other.name, alloc), durationMinutes(other.durationMinutes), intensity(other.intensity) {}
     virtual ~Workout() {}
     virtual double estimateCalories(const Person &p) const = 0; // pure virtual
+    virtual WorkoutKind kind() const = 0;
+    virtual double getMet() const { return defaultMet(kind()); }
+    // copies of the concrete type, on the heap or constructed in caller-provided storage
+    // (moveInto keeps this workout's allocator, cloneInto uses the given one)
+    virtual Workout *clone() const = 0;
+    virtual Workout *cloneInto(void *mem, const allocator_type &alloc) const = 0;
+    virtual Workout *moveInto(void *mem) noexcept = 0;
+    virtual size_t footprint() const = 0; // sizeof the concrete type
+    // per-member calibrated estimate, O(1)
+    double estimateCalories(const Person &p, const UserCalibration &cal) const {
+        return cal.estimate(kind(), getMet(), durationMinutes, intensity, p.getWeight());
+    }
 
     virtual string info() const {
         ostringstream oss;
         oss << name << " (" << durationMinutes << " min, intensity " << intensity << ")";
         return oss.str();
     }
+    // same text as info() for the built-in kinds, appended without temporaries
+    void appendInfo(pmr::string &out) const {
+        char num[16];
+        out += workoutKindName(kind());
+        out += " - ";
+        out += name;
+        out += " (";
+        out.append(num, to_chars(num, num + sizeof num, durationMinutes).ptr);
+        out += " min, intensity ";
+        out.append(num, to_chars(num, num + sizeof num, intensity).ptr);
+        out += ")";
+    }
     int getDuration() const { return durationMinutes; }
-    string getName() const { return name; }
+    int getIntensity() const { return intensity; }
+    string getName() const { return string(name); }
+    string_view nameView() const { return name; }
 };
 
 /* ---------------------------
@@ -114,20 +452,28 @@ public:
 class Cardio : public Workout {
     double metValue; // metabolic equivalent for activity
 public:
-    Cardio(const string &n, int d, int inten, double met)
-        : Workout(n,d,inten), metValue(met) {}
+    Cardio(string_view n, int d, int inten, double met, const allocator_type &alloc = allocator_type())
+        : Workout(n,d,inten,alloc), metValue(met) {}
+    Cardio(const Cardio &other) = default;
+    Cardio(Cardio &&other) noexcept = default;
+    Cardio(const Cardio &other, const allocator_type &alloc): Workout(other, alloc), metValue(other.metValue) {}
+    using Workout::estimateCalories;
     // function overloading example: same name but different params
     double estimateCalories(const Person &p) const override {
-        double hours = durationMinutes / 60.0;
-        // intensity modifies MET slightly
-        double metAdj = metValue * (1.0 + (intensity - 5) * 0.05);
-        return metAdj * p.getWeight() * hours;
+        // intensity modifies MET slightly (see intensitySlope)
+        return caloriesPerKg(kind(), metValue, durationMinutes, intensity) * p.getWeight();
     }
     // overload: estimate with an extra intensity multiplier
     double estimateCalories(const Person &p, double extraMultiplier) const {
         double base = estimateCalories(p);
         return base * extraMultiplier;
     }
+    WorkoutKind kind() const override { return WorkoutKind::Cardio; }
+    Workout *clone() const override { return new Cardio(*this); }
+    Workout *cloneInto(void *mem, const allocator_type &alloc) const override { return new (mem) Cardio(*this, alloc); }
+    Workout *moveInto(void *mem) noexcept override { return new (mem) Cardio(std::move(*this)); }
+    size_t footprint() const override { return sizeof(Cardio); }
+    double getMet() const override { return metValue; }
     string info() const override {
         return "Cardio - " + Workout::info();
     }
@@ -138,14 +484,21 @@ public:
    --------------------------- */
 class Strength : public Workout {
 public:
-    Strength(const string &n, int d, int inten) : Workout(n,d,inten) {}
+    Strength(string_view n, int d, int inten, const allocator_type &alloc = allocator_type())
+        : Workout(n,d,inten,alloc) {}
+    Strength(const Strength &other) = default;
+    Strength(Strength &&other) noexcept = default;
+    Strength(const Strength &other, const allocator_type &alloc): Workout(other, alloc) {}
+    using Workout::estimateCalories;
     double estimateCalories(const Person &p) const override {
-        // Approximate strength training burn (simplified)
-        double hours = durationMinutes / 60.0;
-        double base = 6.0; // avg MET for strength-like activity
-        double metAdj = base * (1.0 + (intensity - 5) * 0.04);
-        return metAdj * p.getWeight() * hours;
+        // Approximate strength training burn (simplified): avg MET 6.0
+        return caloriesPerKg(kind(), defaultMet(kind()), durationMinutes, intensity) * p.getWeight();
     }
+    WorkoutKind kind() const override { return WorkoutKind::Strength; }
+    Workout *clone() const override { return new Strength(*this); }
+    Workout *cloneInto(void *mem, const allocator_type &alloc) const override { return new (mem) Strength(*this, alloc); }
+    Workout *moveInto(void *mem) noexcept override { return new (mem) Strength(std::move(*this)); }
+    size_t footprint() const override { return sizeof(Strength); }
     string info() const override {
         return "Strength - " + Workout::info();
     }
@@ -156,12 +509,21 @@ public:
    --------------------------- */
 class Flexibility : public Workout {
 public:
-    Flexibility(const string &n, int d, int inten) : Workout(n,d,inten) {}
+    Flexibility(string_view n, int d, int inten, const allocator_type &alloc = allocator_type())
+        : Workout(n,d,inten,alloc) {}
+    Flexibility(const Flexibility &other) = default;
+    Flexibility(Flexibility &&other) noexcept = default;
+    Flexibility(const Flexibility &other, const allocator_type &alloc): Workout(other, alloc) {}
+    using Workout::estimateCalories;
     double estimateCalories(const Person &p) const override {
-        double hours = durationMinutes / 60.0;
-        double base = 3.0; // light MET
-        return base * p.getWeight() * hours;
+        // light MET 3.0, intensity does not matter
+        return caloriesPerKg(kind(), defaultMet(kind()), durationMinutes, intensity) * p.getWeight();
     }
+    WorkoutKind kind() const override { return WorkoutKind::Flexibility; }
+    Workout *clone() const override { return new Flexibility(*this); }
+    Workout *cloneInto(void *mem, const allocator_type &alloc) const override { return new (mem) Flexibility(*this, alloc); }
+    Workout *moveInto(void *mem) noexcept override { return new (mem) Flexibility(std::move(*this)); }
+    size_t footprint() const override { return sizeof(Flexibility); }
     string info() const override {
         return "Flexibility - " + Workout::info();
     }
@@ -170,213 +532,7618 @@ public:
 /* ---------------------------
    WorkoutPlan class - demonstrates operator overloading
    --------------------------- */
+// The first kInline workouts live in the plan itself (emplace() constructs them there,
+// copies and merges clone into the slots), so typical plans need no allocation for
+// the container or its workouts. Longer plans come from the plan's memory resource
+// (the default heap unless an allocator is given); workouts handed over with add()
+// stay on the global heap. The plan owns every workout it holds.
 class WorkoutPlan {
-    vector<Workout*> workouts; // polymorphic pointers
 public:
-    WorkoutPlan() {}
-    ~WorkoutPlan() {
-        // We do not delete workouts because ownership may be external;
-        // for demo, assume plan owns them and delete:
-        for (Workout* w : workouts) delete w;
-        workouts.clear();
+    using allocator_type = pmr::polymorphic_allocator<char>;
+    static const size_t kInline = 6;
+    static constexpr size_t kSlotBytes = max({sizeof(Cardio), sizeof(Strength), sizeof(Flexibility)});
+
+private:
+    // a slot per cache line, so an inline workout never straddles two
+    struct alignas(64) Slot { unsigned char bytes[kSlotBytes]; };
+    enum class Home : uint8_t { Slot, Resource, Heap };
+    struct Entry {
+        Workout *w;
+        Home home;
+    };
+
+    // header (bookkeeping for the inline workouts first, 104 of 128 bytes), then the slots
+    allocator_type alloc;
+    uint32_t count = 0;
+    Home homes[kInline] = {};
+    Workout *items[kInline] = {};
+    pmr::vector<Entry> spill; // entries beyond kInline
+    Slot slots[kInline];
+
+    Entry entry(size_t i) const { return i < kInline ? Entry{items[i], homes[i]} : spill[i - kInline]; }
+
+    // room for the next entry, so push() cannot throw once a workout is built
+    void reserveEntry() {
+        if (count >= kInline && spill.size() == spill.capacity()) spill.reserve(max<size_t>(4, spill.capacity() * 2));
     }
-    void add(Workout* w) { workouts.push_back(w); }
-    double totalCaloriesFor(const Person &p) const {
-        double total = 0.0;
-        for (Workout* w : workouts) total += w->estimateCalories(p);
-        return total;
+    void push(Workout *w, Home home) noexcept {
+        if (count < kInline) { items[count] = w; homes[count] = home; }
+        else spill.push_back({w, home});
+        ++count;
     }
-    void showPlan() const {
-        cout << "Workout Plan (" << workouts.size() << " items):\n";
-        for (const Workout* w : workouts) cout << "  - " << w->info() << "\n";
+    // copy of w, in the next slot when it fits
+    void pushCopy(const Workout &w) {
+        reserveEntry();
+        if (count < kInline && w.footprint() <= kSlotBytes) {
+            push(w.cloneInto(&slots[count], alloc), Home::Slot);
+        } else {
+            void *mem = alloc.resource()->allocate(w.footprint(), alignof(max_align_t));
+            try {
+                push(w.cloneInto(mem, alloc), Home::Resource);
+            } catch (...) {
+                alloc.resource()->deallocate(mem, w.footprint(), alignof(max_align_t));
+                throw;
+            }
+        }
     }
-    // operator+ to merge plans (returns new plan owning copies)
-    WorkoutPlan operator+(const WorkoutPlan &other) const {
-        WorkoutPlan result;
-        // deep-copy by re-creating similar typed workouts (simple approach)
-        for (Workout* w : workouts) {
-            // attempt RTTI to copy appropriate type
-            if (const Cardio* c = dynamic_cast<Cardio*>(w)) {
-                result.add(new Cardio(*c));
-            } else if (const Strength* s = dynamic_cast<Strength*>(w)) {
-                result.add(new Strength(*s));
-            } else if (const Flexibility* f = dynamic_cast<Flexibility*>(w)) {
-                result.add(new Flexibility(*f));
+    void destroy(const Entry &e) {
+        if (e.home == Home::Slot) {
+            e.w->~Workout();
+        } else if (e.home == Home::Resource) {
+            size_t bytes = e.w->footprint();
+            void *mem = dynamic_cast<void *>(e.w);
+            e.w->~Workout();
+            alloc.resource()->deallocate(mem, bytes, alignof(max_align_t));
+        } else {
+            delete e.w;
+        }
+    }
+    void release() {
+        for (size_t i = 0; i < count; ++i) destroy(entry(i));
+        spill.clear();
+        count = 0;
+    }
+    // relocates other's inline entries into this empty plan; the caller has already
+    // taken other's spill vector, and both plans must use the same memory resource
+    void takeSlots(WorkoutPlan &other) noexcept {
+        count = other.count;
+        for (size_t i = 0; i < count && i < kInline; ++i) {
+            homes[i] = other.homes[i];
+            items[i] = other.items[i];
+            if (homes[i] == Home::Slot) {
+                items[i] = items[i]->moveInto(&slots[i]);
+                other.items[i]->~Workout();
+            }
+        }
+        other.spill.clear();
+        other.count = 0;
+    }
+
+public:
+    explicit WorkoutPlan(const allocator_type &a = allocator_type()): alloc(a), spill(a) {}
+    WorkoutPlan(const WorkoutPlan &other): WorkoutPlan(other, allocator_type()) {}
+    WorkoutPlan(const WorkoutPlan &other, const allocator_type &a): alloc(a), spill(a) {
+        try {
+            for (size_t i = 0; i < other.count; ++i) pushCopy(*other.entry(i).w);
+        } catch (...) {
+            release(); // no destructor for a constructor that throws
+            throw;
+        }
+    }
+    WorkoutPlan(WorkoutPlan &&other) noexcept: alloc(other.alloc), spill(std::move(other.spill)) { takeSlots(other); }
+    WorkoutPlan &operator=(const WorkoutPlan &other) {
+        if (this != &other) {
+            release();
+            for (size_t i = 0; i < other.count; ++i) pushCopy(*other.entry(i).w);
+        }
+        return *this;
+    }
+    // keeps this plan's allocator; copies when the other plan uses a different one
+    WorkoutPlan &operator=(WorkoutPlan &&other) {
+        if (this != &other) {
+            release();
+            if (alloc == other.alloc) {
+                spill = std::move(other.spill); // equal allocators, so this steals the buffer
+                takeSlots(other);
             } else {
-                // fallback: skip
+                for (size_t i = 0; i < other.count; ++i) pushCopy(*other.entry(i).w);
+                other.release();
             }
         }
-        for (Workout* w : other.workouts) {
-            if (const Cardio* c = dynamic_cast<Cardio*>(w)) {
-                result.add(new Cardio(*c));
-            } else if (const Strength* s = dynamic_cast<Strength*>(w)) {
-                result.add(new Strength(*s));
-            } else if (const Flexibility* f = dynamic_cast<Flexibility*>(w)) {
-                result.add(new Flexibility(*f));
+        return *this;
+    }
+    ~WorkoutPlan() { release(); }
+
+    allocator_type get_allocator() const { return alloc; }
+
+    // takes ownership of a heap-allocated workout (deleted if it cannot be added)
+    void add(Workout* w) {
+        try {
+            reserveEntry();
+        } catch (...) {
+            delete w;
+            throw;
+        }
+        push(w, Home::Heap);
+    }
+    // constructs the workout in the plan (inline while slots remain), using the
+    // plan's allocator for its name
+    template <typename T, typename... Args>
+    T &emplace(Args &&...args) {
+        static_assert(is_base_of<Workout, T>::value, "plans hold workouts");
+        static_assert(alignof(T) <= alignof(max_align_t), "over-aligned workout");
+        T *w;
+        reserveEntry();
+        if (count < kInline && sizeof(T) <= kSlotBytes) {
+            w = new (&slots[count]) T(std::forward<Args>(args)..., alloc);
+            push(w, Home::Slot);
+        } else {
+            void *mem = alloc.resource()->allocate(sizeof(T), alignof(max_align_t));
+            try {
+                w = new (mem) T(std::forward<Args>(args)..., alloc);
+            } catch (...) {
+                alloc.resource()->deallocate(mem, sizeof(T), alignof(max_align_t));
+                throw;
             }
+            push(w, Home::Resource);
+        }
+        return *w;
+    }
+
+    size_t size() const { return count; }
+    const Workout &at(size_t i) const {
+        if (i >= count) throw out_of_range("WorkoutPlan::at");
+        return *entry(i).w;
+    }
+    double totalCaloriesFor(const Person &p) const {
+        double total = 0.0;
+        for (size_t i = 0; i < count; ++i) total += entry(i).w->estimateCalories(p);
+        return total;
+    }
+    // totalCaloriesFor(p) / p.getWeight(): every estimate is caloriesPerKg x weight
+    double kcalPerKg() const {
+        double total = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            const Workout &w = *entry(i).w;
+            total += caloriesPerKg(w.kind(), w.getMet(), w.getDuration(), w.getIntensity());
+        }
+        return total;
+    }
+    void showPlan() const {
+        cout << "Workout Plan (" << count << " items):\n";
+        for (size_t i = 0; i < count; ++i) cout << "  - " << entry(i).w->info() << "\n";
+    }
+    // the showPlan() text, appended to out (which may live in an arena)
+    void format(pmr::string &out) const {
+        char num[16];
+        out += "Workout Plan (";
+        out.append(num, to_chars(num, num + sizeof num, count).ptr);
+        out += " items):\n";
+        for (size_t i = 0; i < count; ++i) {
+            out += "  - ";
+            entry(i).w->appendInfo(out);
+            out += "\n";
         }
+    }
+    // operator+ to merge plans (returns new plan owning copies, same allocator as this one)
+    WorkoutPlan operator+(const WorkoutPlan &other) const {
+        WorkoutPlan result(alloc);
+        for (size_t i = 0; i < count; ++i) result.pushCopy(*entry(i).w);
+        for (size_t i = 0; i < other.count; ++i) result.pushCopy(*other.entry(i).w);
         return result;
     }
 };
 
 /* ---------------------------
-   Logger - file I/O
+   PlanInterner - hash-consed shared plans
    --------------------------- */
-class Logger {
-    string filename;
+// Plans with the same workouts in the same order (kind, name, duration, intensity,
+// MET) share one immutable instance, so equality is a pointer comparison. The table
+// holds weak references: a plan disappears when its last handle goes away, and its
+// slot is reclaimed by purge() or the next insert that finds it expired.
+class PlanInterner {
 public:
-    Logger(const string &fname = "fitness_log.txt"): filename(fname) {}
-    void logSession(const Person &p, const Workout &w, double calories) {
-        ofstream ofs(filename, ios::app);
-        if (!ofs) throw FitnessException("Unable to open log file");
-        ofs << "[" << chrono::system_clock::to_time_t(chrono::system_clock::now())
-            << "] " << p.getName() << " did " << w.getName()
-            << " for " << w.getDuration() << " min, calories: " << fixed << setprecision(2) << calories << "\n";
-        ofs.close();
-    }
-};
+    using Handle = shared_ptr<const WorkoutPlan>;
 
-/* ---------------------------
-   FitnessApp controller
-   --------------------------- */
-class FitnessApp {
-    User currentUser;
-    Logger logger;
-    // demonstrate arrays and pointers:
-    // static 1D array of recommended durations for 3 intensity levels
-    int recommendedDurations[3] = {20, 30, 45};
-    // 2D array for sample weekly schedule (7 days x 3 slot types)
-    string weeklySchedule[7][3];
+private:
+    unordered_multimap<uint64_t, weak_ptr<const WorkoutPlan>> table;
+    mutable mutex m;
+    uint64_t lookups = 0, hits = 0;
 
-public:
-    FitnessApp(): currentUser(), logger("fitness_log.txt") {
-        // initialize weeklySchedule with defaults
-        for (int d=0; d<7; ++d) {
-            weeklySchedule[d][0] = "Rest";
-            weeklySchedule[d][1] = "Cardio";
-            weeklySchedule[d][2] = "Strength";
+    template <typename Plan>
+    Handle internImpl(Plan &&plan) {
+        uint64_t h = structuralHash(plan);
+        lock_guard<mutex> lk(m);
+        ++lookups;
+        auto range = table.equal_range(h);
+        for (auto it = range.first; it != range.second;) {
+            Handle existing = it->second.lock();
+            if (!existing) { it = table.erase(it); continue; }
+            if (sameStructure(*existing, plan)) { ++hits; return existing; }
+            ++it;
         }
+        // shared instances outlive the caller's arena: only a plan already on the
+        // default resource is moved in, anything else is copied onto it
+        Handle fresh = plan.get_allocator() == WorkoutPlan::allocator_type()
+                           ? make_shared<const WorkoutPlan>(std::forward<Plan>(plan))
+                           : make_shared<const WorkoutPlan>(plan, WorkoutPlan::allocator_type());
+        table.emplace(h, fresh);
+        return fresh;
     }
 
-    // pointer arithmetic demo (shows addresses and values)
-    void pointerDemo() {
-        int *p = recommendedDurations; // pointer to first element
-        cout << "Pointer demo: recommendedDurations addresses and values\n";
-        for (int i=0; i<3; ++i) {
-            cout << "  idx " << i << " address " << (p + i) << " value " << *(p + i) << "\n";
+public:
+    static uint64_t structuralHash(const WorkoutPlan &plan) {
+        uint64_t h = 1469598103934665603ull;
+        auto mix = [&h](const void *p, size_t n) {
+            const unsigned char *c = static_cast<const unsigned char *>(p);
+            for (size_t i = 0; i < n; ++i) { h ^= c[i]; h *= 1099511628211ull; }
+        };
+        for (size_t i = 0; i < plan.size(); ++i) {
+            const Workout &w = plan.at(i);
+            string_view name = w.nameView();
+            int fields[3] = {(int)w.kind(), w.getDuration(), w.getIntensity()};
+            double met = w.getMet();
+            mix(fields, sizeof fields);
+            mix(&met, sizeof met);
+            mix(name.data(), name.size());
+            h ^= name.size(); h *= 1099511628211ull; // separates adjacent names
+        }
+        h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+    static bool sameStructure(const WorkoutPlan &a, const WorkoutPlan &b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            const Workout &x = a.at(i), &y = b.at(i);
+            if (x.kind() != y.kind() || x.getDuration() != y.getDuration() || x.getIntensity() != y.getIntensity() ||
+                x.getMet() != y.getMet() || x.nameView() != y.nameView())
+                return false;
+        }
+        return true;
+    }
+    // estimated heap + object footprint of one private copy (assumes a 15-char
+    // small-string buffer; allocator overhead is not counted)
+    static size_t planBytes(const WorkoutPlan &plan) {
+        size_t bytes = sizeof(WorkoutPlan);
+        for (size_t i = 0; i < plan.size(); ++i) {
+            if (i >= WorkoutPlan::kInline) bytes += WorkoutPlan::kSlotBytes + sizeof(void *) * 2;
+            size_t len = plan.at(i).nameView().size();
+            if (len > 15) bytes += len + 1; // beyond the small-string buffer
         }
+        return bytes;
     }
 
-    // create sample workouts (dynamically allocated to show pointer management)
-    WorkoutPlan createSamplePlan() {
-        WorkoutPlan plan;
-        plan.add(new Cardio("Jogging", 30, 6, 7.0));
-        plan.add(new Strength("Circuit training", 40, 7));
-        plan.add(new Flexibility("Yoga", 20, 3));
-        return plan;
+    Handle intern(const WorkoutPlan &plan) { return internImpl(plan); }
+    Handle intern(WorkoutPlan &&plan) { return internImpl(std::move(plan)); }
+
+    // Copy-on-write edit: applies fn to a private copy and interns the result.
+    template <typename Fn>
+    Handle edit(const Handle &plan, Fn fn) {
+        WorkoutPlan copy(*plan);
+        fn(copy);
+        return intern(std::move(copy));
     }
 
-    // mapping user goal to recommended plan
-    WorkoutPlan recommendPlanForUser(const User &u) {
-        string g = u.getGoal();
-        WorkoutPlan plan;
-        if (g.find("Lose") != string::npos || g.find("lose") != string::npos) {
-            plan.add(new Cardio("HIIT", 25, 9, 10.0));
-            plan.add(new Strength("Full-body strength", 30, 7));
-            plan.add(new Flexibility("Stretch", 15, 2));
-        } else if (g.find("Build") != string::npos || g.find("build") != string::npos) {
-            plan.add(new Strength("Hypertrophy", 50, 8));
-            plan.add(new Cardio("Light cardio", 20, 4, 5.5));
-            plan.add(new Flexibility("Mobility", 20, 3));
-        } else {
-            // maintain
-            plan.add(new Cardio("Steady-state", 30, 5, 6.0));
-            plan.add(new Strength("Maintenance strength", 30, 5));
-        }
-        return plan;
+    // drops table entries whose plans are gone; returns how many were removed
+    size_t purge() {
+        lock_guard<mutex> lk(m);
+        size_t before = table.size();
+        for (auto it = table.begin(); it != table.end();) it = it->second.expired() ? table.erase(it) : next(it);
+        return before - table.size();
     }
 
-    // main interactive menu (kept minimal, but demonstrates control structures)
-    void runDemo() {
-        cout << "=== Fitness & Calorie Burn Recommendation System ===\n";
-        // create demo user
-        currentUser = User("Devin M.", 22, 72.5, 175.0, 'M', "Lose weight");
-        cout << "User: " << currentUser.getName() << ", Goal: " << currentUser.getGoal() << "\n";
+    size_t uniquePlans() const {
+        lock_guard<mutex> lk(m);
+        size_t live = 0;
+        for (const auto &e : table) live += !e.second.expired();
+        return live;
+    }
+    // estimated bytes held by the live shared instances (planBytes plus control blocks)
+    size_t sharedBytes() const {
+        lock_guard<mutex> lk(m);
+        size_t bytes = 0;
+        for (const auto &e : table)
+            if (Handle p = e.second.lock()) bytes += planBytes(*p) + 2 * sizeof(long);
+        return bytes;
+    }
+    double hitRate() const {
+        lock_guard<mutex> lk(m);
+        return lookups ? (double)hits / lookups : 0.0;
+    }
+};
 
-        pointerDemo();
+/* ---------------------------
+   StringPool - interned strings
+   --------------------------- */
+class StringPool {
+    deque<string> strings;                    // deque never relocates elements
+    unordered_map<string_view, uint32_t> ids; // keys view into `strings`
+public:
+    StringPool() = default;
+    StringPool(const StringPool &) = delete;
+    StringPool &operator=(const StringPool &) = delete;
+    StringPool(StringPool &&) = default;
+    StringPool &operator=(StringPool &&) = default;
 
-        WorkoutPlan recommended = recommendPlanForUser(currentUser);
-        recommended.showPlan();
-        double total = recommended.totalCaloriesFor(currentUser);
-        cout << "Estimated total calories for plan: " << fixed << setprecision(2) << total << "\n";
+    uint32_t intern(string_view s) {
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        strings.emplace_back(s);
+        uint32_t id = (uint32_t)(strings.size() - 1);
+        ids.emplace(string_view(strings.back()), id);
+        return id;
+    }
+    // -1 when the string was never interned
+    int64_t find(string_view s) const {
+        auto it = ids.find(s);
+        return it == ids.end() ? -1 : (int64_t)it->second;
+    }
+    const string &at(uint32_t id) const { return strings[id]; }
+    size_t size() const { return strings.size(); }
+};
 
-        // demonstrate operator+ merging plans
-        WorkoutPlan extras = createSamplePlan();
-        WorkoutPlan merged = recommended + extras; // operator+
-        cout << "\nMerged plan:\n";
-        merged.showPlan();
-        cout << "Merged calories estimate: " << merged.totalCaloriesFor(currentUser) << "\n";
+/* ---------------------------
+   SessionTextIndex - full-text search over session logs
+   --------------------------- */
+// Inverted index: one posting list per term, each a byte stream of
+//   varint(doc delta), varint(term frequency), tf x varint(position delta)
+// with a skip entry every kSkipInterval documents so AND queries can jump ahead.
+// Document ids are log line numbers (0-based). Not thread-safe.
+class SessionTextIndex {
+    static const uint32_t kSkipInterval = 128;
 
-        // log first workout
-        try {
-            // pick first workout pointer via internal copy: get pointer by creating sample again and delete
-            WorkoutPlan single = createSamplePlan();
-            // For demo, we extract first workout to log (ptr ownership tricky: we'll create a temp cardio)
-            Cardio tempCardio("Temp Jog", 30, 6, 7.0);
-            double cal = tempCardio.estimateCalories(currentUser);
-            logger.logSession(currentUser, tempCardio, cal);
-            cout << "Logged session: " << tempCardio.info() << " calories: " << cal << "\n";
-        } catch (FitnessException &ex) {
-            cerr << "Logging failed: " << ex.what() << "\n";
+    struct Skip { uint32_t lastDoc; uint32_t offset; }; // lastDoc = doc before the block at offset
+    struct Posting {
+        vector<uint8_t> bytes;
+        vector<Skip> skips;
+        uint32_t lastDoc = 0;
+        uint32_t docCount = 0;
+    };
+
+    StringPool terms;
+    vector<Posting> postings;
+    uint32_t docs = 0;
+
+    static void putVarint(vector<uint8_t> &out, uint32_t v) {
+        while (v >= 0x80) { out.push_back(uint8_t(v | 0x80)); v >>= 7; }
+        out.push_back(uint8_t(v));
+    }
+    static uint32_t getVarint(const uint8_t *&p) {
+        uint32_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            uint8_t b = *p++;
+            v |= uint32_t(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
         }
+    }
 
-        // demonstrate array (1D) traversal with control structures
-        cout << "\nRecommended durations by intensity index:\n";
-        for (int i=0; i<3; ++i) {
-            if (recommendedDurations[i] < 30) cout << "  Short: ";
-            else if (recommendedDurations[i] == 30) cout << "  Medium: ";
-            else cout << "  Long: ";
-            cout << recommendedDurations[i] << " min\n";
+    // Walks one posting list; positions are decoded only when asked for.
+    class Cursor {
+        const Posting *pl;
+        const uint8_t *p, *end;
+        const uint8_t *posStart = nullptr;
+        uint32_t doc = 0, tf = 0, seen = 0;
+        bool exhausted = false;
+    public:
+        explicit Cursor(const Posting *posting)
+            : pl(posting), p(posting->bytes.data()), end(posting->bytes.data() + posting->bytes.size()) {}
+        uint32_t docId() const { return doc; }
+        uint32_t docFrequency() const { return pl->docCount; }
+        bool next() {
+            if (p >= end) { exhausted = true; return false; }
+            uint32_t delta = getVarint(p);
+            doc = (seen % kSkipInterval == 0) ? delta : doc + delta;
+            tf = getVarint(p);
+            posStart = p;
+            for (uint32_t i = 0; i < tf; ++i) getVarint(p);
+            ++seen;
+            return true;
+        }
+        // first document >= target
+        bool advanceTo(uint32_t target) {
+            if (exhausted) return false;
+            if (seen > 0 && doc >= target) return true;
+            const vector<Skip> &sk = pl->skips;
+            // last skip block that starts before the target
+            auto it = upper_bound(sk.begin(), sk.end(), target,
+                                  [](uint32_t t, const Skip &s) { return t <= s.lastDoc; });
+            if (it != sk.begin()) {
+                const Skip &s = *(it - 1);
+                const uint8_t *jump = pl->bytes.data() + s.offset;
+                if (jump > p) { p = jump; seen = (uint32_t)((it - sk.begin()) * kSkipInterval); }
+            }
+            while (next())
+                if (doc >= target) return true;
+            return false;
+        }
+        void positions(vector<uint32_t> &out) const {
+            out.clear();
+            const uint8_t *q = posStart;
+            uint32_t pos = 0;
+            for (uint32_t i = 0; i < tf; ++i) { pos += getVarint(q); out.push_back(pos); }
         }
+    };
 
-        // 2D array display (weekly schedule)
-        cout << "\nWeekly schedule sample (days x 3 slots):\n";
-        const char* days[] = {"Mon","Tue","Wed","Thu","Fri","Sat","Sun"};
-        for (int d=0; d<7; ++d) {
-            cout << days[d] << ": ";
-            for (int s=0; s<3; ++s) cout << weeklySchedule[d][s] << (s==2? "": " | ");
-            cout << "\n";
+    struct Clause {
+        vector<uint32_t> termIds; // one term, or a phrase
+        bool negated = false;
+        bool missing = false;     // a term never seen: AND fails, NOT is a no-op
+    };
+
+    Clause makeClause(const vector<string> &words, bool negated) const {
+        Clause c;
+        c.negated = negated;
+        for (const string &w : words) {
+            int64_t id = terms.find(w);
+            if (id < 0) c.missing = true;
+            else c.termIds.push_back((uint32_t)id);
         }
+        if (c.termIds.empty()) c.missing = true;
+        return c;
+    }
 
-        // demonstrate string / pointer mixing and pointer arithmetic
-        string sample = "HelloFitness";
-        const char *cstr = sample.c_str();
-        cout << "\nString pointer traversal: ";
-        for (size_t i=0; i<sample.size(); ++i) {
-            cout << *(cstr + i); // pointer arithmetic on C-string
+    bool phraseAt(const Clause &c, vector<Cursor> &cur, const vector<size_t> &slot) const {
+        vector<uint32_t> first, other;
+        cur[slot[0]].positions(first);
+        for (size_t k = 1; k < c.termIds.size() && !first.empty(); ++k) {
+            cur[slot[k]].positions(other);
+            vector<uint32_t> kept;
+            for (uint32_t p : first)
+                if (binary_search(other.begin(), other.end(), p + (uint32_t)k)) kept.push_back(p);
+            first.swap(kept);
         }
-        cout << "\n";
+        return !first.empty();
+    }
 
-        // Demonstrate exception: BMI with zero height
-        try {
-            User badUser("ZeroHeight", 30, 70, 0.0, 'F', "Maintain");
-            cout << "Attempting BMI for " << badUser.getName() << "\n";
-            cout << "BMI: " << badUser.bmi() << "\n"; // should throw
-        } catch (FitnessException &ex) {
-            cout << "Caught exception as expected: " << ex.what() << "\n";
+    // AND of positive clauses (terms / phrases) minus negated clauses
+    vector<uint32_t> evalGroup(const vector<Clause> &group) const {
+        vector<uint32_t> out;
+        vector<Cursor> cur;
+        vector<vector<size_t>> slots(group.size());
+        vector<Cursor> neg;
+        for (size_t i = 0; i < group.size(); ++i) {
+            const Clause &c = group[i];
+            if (c.negated) {
+                if (!c.missing && c.termIds.size() == 1) neg.emplace_back(&postings[c.termIds[0]]);
+                continue;
+            }
+            if (c.missing) return out;
+            for (uint32_t t : c.termIds) { slots[i].push_back(cur.size()); cur.emplace_back(&postings[t]); }
+        }
+        if (cur.empty()) return out;
+        // leapfrog intersection, rarest list leads
+        vector<size_t> order(cur.size());
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cur[a].docFrequency() < cur[b].docFrequency(); });
+        if (!cur[order[0]].next()) return out;
+        uint32_t target = cur[order[0]].docId();
+        for (;;) {
+            bool aligned = true;
+            for (size_t k : order) {
+                if (!cur[k].advanceTo(target)) return out;
+                if (cur[k].docId() != target) { target = cur[k].docId(); aligned = false; break; }
+            }
+            if (!aligned) continue;
+            bool ok = true;
+            for (size_t i = 0; i < group.size() && ok; ++i)
+                if (!group[i].negated && group[i].termIds.size() > 1) ok = phraseAt(group[i], cur, slots[i]);
+            for (size_t i = 0, n = 0; i < group.size() && ok; ++i) {
+                const Clause &c = group[i];
+                if (!c.negated || c.missing) continue;
+                if (c.termIds.size() == 1) {
+                    Cursor &nc = neg[n++];
+                    if (nc.advanceTo(target) && nc.docId() == target) ok = false;
+                } else if (containsPhrase(c, target)) {
+                    ok = false;
+                }
+            }
+            if (ok) out.push_back(target);
+            if (target == UINT32_MAX) return out;
+            ++target;
         }
+    }
 
-        cout << "\nDemo finished.\n";
+    bool containsPhrase(const Clause &c, uint32_t doc) const {
+        vector<Cursor> cur;
+        vector<size_t> slot;
+        for (uint32_t t : c.termIds) {
+            slot.push_back(cur.size());
+            cur.emplace_back(&postings[t]);
+            if (!cur.back().advanceTo(doc) || cur.back().docId() != doc) return false;
+        }
+        return phraseAt(c, cur, slot);
     }
-};
 
-/* ---------------------------
-   Main — Executes tests and demo
+public:
+    template <typename Fn>
+    static void tokenize(string_view text, Fn onToken) {
+        string tok;
+        uint32_t pos = 0;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            unsigned char c = i < text.size() ? (unsigned char)text[i] : ' ';
+            if (isalnum(c)) { tok.push_back((char)tolower(c)); continue; }
+            if (!tok.empty()) { onToken(string_view(tok), pos++); tok.clear(); }
+        }
+    }
+
+    // Appends the next document (log line); returns its id.
+    uint32_t addDocument(string_view text) {
+        uint32_t doc = docs++;
+        vector<pair<uint32_t, uint32_t>> occ; // (term, position)
+        tokenize(text, [&](string_view t, uint32_t pos) { occ.push_back({terms.intern(t), pos}); });
+        sort(occ.begin(), occ.end());
+        if (postings.size() < terms.size()) postings.resize(terms.size());
+        for (size_t i = 0; i < occ.size();) {
+            size_t j = i;
+            while (j < occ.size() && occ[j].first == occ[i].first) ++j;
+            Posting &pl = postings[occ[i].first];
+            if (pl.docCount > 0 && pl.docCount % kSkipInterval == 0)
+                pl.skips.push_back({pl.lastDoc, (uint32_t)pl.bytes.size()});
+            // skip blocks restart the delta chain so a cursor can land on them
+            bool blockStart = pl.docCount % kSkipInterval == 0;
+            putVarint(pl.bytes, blockStart ? doc : doc - pl.lastDoc);
+            putVarint(pl.bytes, (uint32_t)(j - i));
+            uint32_t prev = 0;
+            for (size_t k = i; k < j; ++k) { putVarint(pl.bytes, occ[k].second - prev); prev = occ[k].second; }
+            pl.lastDoc = doc;
+            ++pl.docCount;
+            i = j;
+        }
+        return doc;
+    }
+
+    // Indexes every line of an existing log; returns the number of lines added.
+    size_t indexFile(const string &path) {
+        ifstream ifs(path);
+        string line;
+        size_t n = 0;
+        while (getline(ifs, line)) { addDocument(line); ++n; }
+        return n;
+    }
+
+    // Query syntax: words are ANDed, "quoted words" form a phrase, -word / -"phrase"
+    // excludes, and OR separates alternatives: jog "devin m" OR yoga -temp
+    vector<uint32_t> query(string_view q) const {
+        vector<vector<Clause>> groups(1);
+        size_t i = 0;
+        while (i < q.size()) {
+            while (i < q.size() && isspace((unsigned char)q[i])) ++i;
+            if (i >= q.size()) break;
+            bool negated = false;
+            if (q[i] == '-') { negated = true; ++i; }
+            size_t start = i;
+            string_view raw;
+            if (i < q.size() && q[i] == '"') {
+                size_t close = q.find('"', i + 1);
+                if (close == string_view::npos) close = q.size();
+                raw = q.substr(i + 1, close - i - 1);
+                i = close + 1;
+            } else {
+                while (i < q.size() && !isspace((unsigned char)q[i])) ++i;
+                raw = q.substr(start, i - start);
+                if (!negated && raw == "OR") { groups.emplace_back(); continue; }
+            }
+            vector<string> words;
+            tokenize(raw, [&](string_view t, uint32_t) { words.emplace_back(t); });
+            if (!words.empty()) groups.back().push_back(makeClause(words, negated));
+        }
+        vector<uint32_t> result;
+        for (const vector<Clause> &g : groups) {
+            vector<uint32_t> part = evalGroup(g), merged;
+            merged.reserve(result.size() + part.size());
+            set_union(result.begin(), result.end(), part.begin(), part.end(), back_inserter(merged));
+            result.swap(merged);
+        }
+        return result;
+    }
+
+    size_t documentCount() const { return docs; }
+    size_t termCount() const { return terms.size(); }
+    size_t postingBytes() const {
+        size_t n = 0;
+        for (const Posting &pl : postings) n += pl.bytes.size() + pl.skips.size() * sizeof(Skip);
+        return n;
+    }
+};
+
+/* ---------------------------
+   SessionDeduplicator - idempotent session submission
+   --------------------------- */
+// 64-bit hash of a client-supplied session id (FNV-1a, then a murmur3 finalizer)
+inline uint64_t hashSessionId(string_view id) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : id) { h ^= c; h *= 1099511628211ull; }
+    h ^= h >> 33; h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33; h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// Split-block Bloom filter: each key touches one 64-byte block, one bit per word.
+class BlockedBloomFilter {
+    struct alignas(64) Block { uint64_t w[8]; };
+    vector<Block> blocks;
+    // block from the low 32 bits (callers may shard on the high ones), bit positions from a remix
+    size_t blockOf(uint64_t h) const { return (size_t)(((h & 0xFFFFFFFFull) * blocks.size()) >> 32); }
+    static uint64_t bitsOf(uint64_t h) { return (h ^ (h >> 29)) * 0x9E3779B97F4A7C15ull; }
+public:
+    explicit BlockedBloomFilter(size_t expectedKeys = 0) { reset(expectedKeys); }
+    // ~16 bits per key keeps the false-positive rate well under 1%
+    void reset(size_t expectedKeys) {
+        size_t n = max<size_t>(1, (expectedKeys * 16 + 511) / 512);
+        blocks.assign(n, Block{});
+    }
+    void clear() { blocks.clear(); blocks.shrink_to_fit(); }
+    bool empty() const { return blocks.empty(); }
+    size_t bytes() const { return blocks.size() * sizeof(Block); }
+
+    bool mayContain(uint64_t h) const {
+        const Block &b = blocks[blockOf(h)];
+        uint64_t bits = bitsOf(h);
+        bool all = true;
+        for (int i = 0; i < 8; ++i) all &= (b.w[i] >> ((bits >> (16 + i * 6)) & 63)) & 1;
+        return all;
+    }
+    void insert(uint64_t h) {
+        Block &b = blocks[blockOf(h)];
+        uint64_t bits = bitsOf(h);
+        for (int i = 0; i < 8; ++i) b.w[i] |= 1ull << ((bits >> (16 + i * 6)) & 63);
+    }
+};
+
+// Open-addressing set of 64-bit hashes (linear probing, 0 marks an empty slot).
+class FlatHashSet {
+    vector<uint64_t> slots;
+    size_t count = 0;
+    static uint64_t key(uint64_t h) { return h ? h : 1; }
+    void rehash(size_t cap) {
+        vector<uint64_t> old;
+        old.swap(slots);
+        slots.assign(cap, 0);
+        count = 0;
+        for (uint64_t k : old) if (k) insert(k);
+    }
+public:
+    void prefetch(uint64_t h) const {
+        if (!slots.empty()) __builtin_prefetch(&slots[(size_t)key(h) & (slots.size() - 1)], 1);
+    }
+    bool contains(uint64_t h) const {
+        if (slots.empty()) return false;
+        uint64_t k = key(h);
+        size_t mask = slots.size() - 1;
+        for (size_t i = (size_t)k & mask;; i = (i + 1) & mask) {
+            if (slots[i] == k) return true;
+            if (slots[i] == 0) return false;
+        }
+    }
+    // false when already present
+    bool insert(uint64_t h) {
+        if ((count + 1) * 2 > slots.size()) rehash(max<size_t>(16, slots.size() * 2));
+        uint64_t k = key(h);
+        size_t mask = slots.size() - 1;
+        for (size_t i = (size_t)k & mask;; i = (i + 1) & mask) {
+            if (slots[i] == k) return false;
+            if (slots[i] == 0) { slots[i] = k; ++count; return true; }
+        }
+    }
+    // false when absent; shifts later entries of the probe chain back into the hole
+    bool erase(uint64_t h) {
+        if (slots.empty()) return false;
+        uint64_t k = key(h);
+        size_t mask = slots.size() - 1, i = (size_t)k & mask;
+        while (slots[i] != k) {
+            if (slots[i] == 0) return false;
+            i = (i + 1) & mask;
+        }
+        for (size_t j = (i + 1) & mask; slots[j]; j = (j + 1) & mask) {
+            size_t home = (size_t)slots[j] & mask;
+            if (((j - home) & mask) >= ((j - i) & mask)) { slots[i] = slots[j]; i = j; }
+        }
+        slots[i] = 0;
+        --count;
+        return true;
+    }
+    void reserve(size_t n) {
+        size_t cap = 16;
+        while (cap < n * 2) cap <<= 1;
+        if (cap > slots.size()) rehash(cap);
+    }
+    void clear() { slots.clear(); slots.shrink_to_fit(); count = 0; }
+    size_t size() const { return count; }
+    size_t bytes() const { return slots.size() * sizeof(uint64_t); }
+};
+
+enum class DedupResult : uint8_t { Accepted, Duplicate, Expired };
+
+// Remembers session ids per day for `windowDays` days. A day's Bloom filter answers
+// most first-time submissions without touching the exact set: those ids are only
+// appended to a pending list, which is moved into the exact set (with prefetching)
+// the next time the filter reports a possible repeat. Days that fall out of the
+// window are dropped, which bounds memory. Session times more than `maxAheadSeconds`
+// past the server clock are clamped to it, so a client with a wrong clock cannot
+// advance the window and expire everyone else's ids. Sharded by hash for concurrent use.
+class SessionDeduplicator {
+    static const size_t kShards = 16;
+    struct Day {
+        int64_t day = INT64_MIN;
+        BlockedBloomFilter bloom;
+        FlatHashSet exact;
+        vector<uint64_t> pending; // Bloom negatives not yet in `exact`
+    };
+    struct Shard {
+        mutex m;
+        vector<Day> ring; // indexed by day % windowDays
+        uint64_t bloomNegatives = 0, exactChecks = 0, duplicates = 0;
+    };
+    int windowDays;
+    size_t expectedPerShardDay;
+    int64_t maxAheadSeconds;
+    array<Shard, kShards> shards;
+    atomic<int64_t> newestDay{INT64_MIN};
+
+    int64_t dayOf(int64_t sessionTime, int64_t now) const {
+        int64_t t = min(sessionTime, now + maxAheadSeconds);
+        return t >= 0 ? t / 86400 : (t - 86399) / 86400;
+    }
+    Shard &shardOf(uint64_t h) { return shards[(h >> 60) & (kShards - 1)]; }
+    Day &slotOf(Shard &s, int64_t day) { return s.ring[(size_t)(((day % windowDays) + windowDays) % windowDays)]; }
+    static void flushPending(Day &d) {
+        const size_t ahead = 8;
+        d.exact.reserve(d.exact.size() + d.pending.size());
+        for (size_t i = 0; i < d.pending.size(); ++i) {
+            if (i + ahead < d.pending.size()) d.exact.prefetch(d.pending[i + ahead]);
+            d.exact.insert(d.pending[i]);
+        }
+        d.pending.clear();
+    }
+    uint64_t sumCounter(uint64_t Shard::*counter) {
+        uint64_t n = 0;
+        for (Shard &s : shards) {
+            lock_guard<mutex> lk(s.m);
+            n += s.*counter;
+        }
+        return n;
+    }
+
+public:
+    explicit SessionDeduplicator(int window = 3, size_t expectedPerDay = 1000000, int64_t maxAhead = 3600)
+        : windowDays(max(1, window)), expectedPerShardDay(max<size_t>(1, expectedPerDay / kShards)),
+          maxAheadSeconds(max<int64_t>(0, maxAhead)) {
+        for (Shard &s : shards) s.ring.resize((size_t)windowDays);
+    }
+
+    DedupResult check(string_view sessionId, int64_t sessionTime) {
+        return checkHash(hashSessionId(sessionId), sessionTime, (int64_t)time(nullptr));
+    }
+
+    // `now` is the server clock (seconds since the epoch)
+    DedupResult checkHash(uint64_t h, int64_t sessionTime, int64_t now) {
+        int64_t day = dayOf(sessionTime, now);
+        int64_t newest = newestDay.load(memory_order_relaxed);
+        while (day > newest && !newestDay.compare_exchange_weak(newest, day, memory_order_relaxed)) {}
+        if (day > newest) newest = day;
+        if (day <= newest - windowDays) return DedupResult::Expired;
+
+        Shard &s = shardOf(h);
+        lock_guard<mutex> lk(s.m);
+        Day &d = slotOf(s, day);
+        if (d.day != day) {
+            if (d.day > day) return DedupResult::Expired; // slot already reused by a newer day
+            d.day = day;                                   // expire the old day in this slot
+            d.exact.clear(); // grows as pending ids are flushed into it
+            d.pending.clear();
+            d.bloom.reset(expectedPerShardDay);
+        }
+        if (!d.bloom.mayContain(h)) {
+            ++s.bloomNegatives;
+            d.bloom.insert(h);
+            d.pending.push_back(h);
+            return DedupResult::Accepted;
+        }
+        ++s.exactChecks;
+        flushPending(d);
+        if (!d.exact.insert(h)) {
+            ++s.duplicates;
+            return DedupResult::Duplicate;
+        }
+        return DedupResult::Accepted;
+    }
+
+    // Forgets an id accepted by check() whose session then could not be stored, so
+    // the client's retry is accepted again.
+    void release(string_view sessionId, int64_t sessionTime) {
+        releaseHash(hashSessionId(sessionId), sessionTime, (int64_t)time(nullptr));
+    }
+    void releaseHash(uint64_t h, int64_t sessionTime, int64_t now) {
+        int64_t day = dayOf(sessionTime, now);
+        Shard &s = shardOf(h);
+        lock_guard<mutex> lk(s.m);
+        Day &d = slotOf(s, day);
+        if (d.day != day) return; // already expired
+        auto it = find(d.pending.begin(), d.pending.end(), h);
+        if (it != d.pending.end()) {
+            *it = d.pending.back();
+            d.pending.pop_back();
+        } else {
+            d.exact.erase(h);
+        }
+    }
+
+    size_t memoryBytes() {
+        size_t n = 0;
+        for (Shard &s : shards) {
+            lock_guard<mutex> lk(s.m);
+            for (Day &d : s.ring) n += d.bloom.bytes() + d.exact.bytes() + d.pending.capacity() * sizeof(uint64_t);
+        }
+        return n;
+    }
+    uint64_t bloomNegativeCount() { return sumCounter(&Shard::bloomNegatives); }
+    uint64_t exactCheckCount() { return sumCounter(&Shard::exactChecks); }
+    uint64_t duplicateCount() { return sumCounter(&Shard::duplicates); }
+};
+
+/* ---------------------------
+   SessionAnomalyDetector - implausible session checks
+   --------------------------- */
+enum class SessionVerdict : uint8_t { Ok, Flagged, Quarantined };
+
+// reason bits (a session can trip several)
+enum : uint16_t {
+    AnomalyDuration = 1,       // longer than any real session
+    AnomalyIntensity = 2,      // outside 1..10
+    AnomalyHardDuration = 4,   // long stretch at intensity 9-10
+    AnomalyCalorieRatio = 8,   // far from the MET formula for this weight
+    AnomalyCalorieRate = 16,   // kcal per hour no one sustains
+    AnomalyHeartRate = 32,     // average heart rate outside human range
+    AnomalyUserCalories = 64,  // unusual for this member (robust z-score)
+    AnomalyUserDuration = 128
+};
+const uint16_t kHardAnomalies = AnomalyDuration | AnomalyIntensity | AnomalyHardDuration | AnomalyCalorieRatio |
+                                AnomalyCalorieRate | AnomalyHeartRate;
+
+inline string anomalyReasonText(uint16_t reasons) {
+    static const char *const names[] = {"duration", "intensity", "hard duration", "calorie ratio",
+                                        "calorie rate", "heart rate", "member calories", "member duration"};
+    string out;
+    for (int b = 0; b < 8; ++b)
+        if (reasons >> b & 1) out += (out.empty() ? "" : ", ") + string(names[b]);
+    return out;
+}
+
+struct AnomalyResult {
+    SessionVerdict verdict = SessionVerdict::Ok;
+    uint16_t reasons = 0;
+};
+
+struct AnomalyLimits {
+    int maxDurationMin = 300;
+    int maxHardMinutes = 120; // at intensity >= 9
+    double maxKcalPerHour = 1500.0;
+    double minCalorieRatio = 0.25, maxCalorieRatio = 4.0; // logged / formula with the session's MET
+    int minHeartRate = 40, maxHeartRate = 220;            // 0 = not recorded
+    double memberZ = 4.0;                                 // robust z-score that flags a session
+    int memberMinSamples = 8;
+};
+
+// Hard limits quarantine a session; per-member outliers are only flagged. Each member
+// keeps two byte histograms (calorie ratio in eighth-octave bins, duration in
+// half-octave bins) from which median and MAD are read; counts halve when a bin
+// saturates, so the sketch follows slow changes. Quarantined sessions are not learned.
+// Sketches of different members are independent, so callers may shard by member.
+class SessionAnomalyDetector {
+    static const int kRatioBins = 32, kDurationBins = 16;
+    struct Sketch {
+        uint8_t ratio[kRatioBins] = {};
+        uint8_t duration[kDurationBins] = {};
+    };
+    static_assert(sizeof(Sketch) == 48, "sketch should stay compact");
+
+    AnomalyLimits lim;
+    vector<Sketch> sketches;
+    atomic<uint64_t> verdicts[3] = {};
+
+    static int ratioBin(double ratio) { // log2 in [-2, 2)
+        return (int)min(31.0, max(0.0, floor((log2(max(ratio, 1e-6)) + 2.0) * 8.0)));
+    }
+    static int durationBin(int minutes) { // log2 in [2, 10)
+        return (int)min(15.0, max(0.0, floor((log2(max(minutes, 1)) - 2.0) * 2.0)));
+    }
+
+    // true if bin b is an outlier against histogram h
+    bool outlier(const uint8_t *h, int bins, int b) const {
+        unsigned total = 0;
+        for (int i = 0; i < bins; ++i) total += h[i];
+        if (total < (unsigned)lim.memberMinSamples) return false;
+        int med = 0;
+        unsigned cum = h[0];
+        while (2 * cum < total) cum += h[++med];
+        int mad = 0;
+        cum = h[med];
+        while (2 * cum < total) {
+            ++mad;
+            if (med - mad >= 0) cum += h[med - mad];
+            if (med + mad < bins) cum += h[med + mad];
+        }
+        return abs(b - med) > lim.memberZ * 1.4826 * max(mad, 1);
+    }
+    static void learn(uint8_t *h, int bins, int b) {
+        if (h[b] == 255)
+            for (int i = 0; i < bins; ++i) h[i] >>= 1;
+        ++h[b];
+    }
+
+public:
+    explicit SessionAnomalyDetector(const AnomalyLimits &limits = AnomalyLimits()): lim(limits) {}
+
+    // member-independent rules only; met is the workout's own (Workout::getMet)
+    AnomalyResult checkGlobal(WorkoutKind kind, double met, int minutes, int intensity, double kcal, double weightKg,
+                              int heartRate = 0) const {
+        uint16_t r = 0;
+        if (minutes <= 0 || minutes > lim.maxDurationMin) r |= AnomalyDuration;
+        if (intensity < 1 || intensity > 10) r |= AnomalyIntensity;
+        if (intensity >= 9 && minutes > lim.maxHardMinutes) r |= AnomalyHardDuration;
+        if (minutes > 0 && kcal * 60.0 / minutes > lim.maxKcalPerHour) r |= AnomalyCalorieRate;
+        double expected = caloriesPerKg(kind, met, minutes, min(max(intensity, 1), 10)) * weightKg;
+        if (!(kcal >= expected * lim.minCalorieRatio && kcal <= expected * lim.maxCalorieRatio)) r |= AnomalyCalorieRatio;
+        if (heartRate != 0 && (heartRate < lim.minHeartRate || heartRate > lim.maxHeartRate)) r |= AnomalyHeartRate;
+        return {r ? SessionVerdict::Quarantined : SessionVerdict::Ok, r};
+    }
+
+    // Global rules plus the member's own history; accepted and flagged sessions update it.
+    AnomalyResult check(uint32_t member, WorkoutKind kind, double met, int minutes, int intensity, double kcal,
+                        double weightKg, int heartRate = 0) {
+        AnomalyResult res = checkGlobal(kind, met, minutes, intensity, kcal, weightKg, heartRate);
+        if (res.verdict == SessionVerdict::Ok) {
+            if (member >= sketches.size()) sketches.resize((size_t)member + 1);
+            Sketch &s = sketches[member];
+            double expected = caloriesPerKg(kind, met, minutes, intensity) * weightKg;
+            int rb = ratioBin(kcal / expected), db = durationBin(minutes);
+            if (outlier(s.ratio, kRatioBins, rb)) res.reasons |= AnomalyUserCalories;
+            if (outlier(s.duration, kDurationBins, db)) res.reasons |= AnomalyUserDuration;
+            if (res.reasons) res.verdict = SessionVerdict::Flagged;
+            learn(s.ratio, kRatioBins, rb);
+            learn(s.duration, kDurationBins, db);
+        }
+        verdicts[(int)res.verdict].fetch_add(1, memory_order_relaxed);
+        return res;
+    }
+
+    // sizes the member table up front (needed before checking from several threads)
+    void reserve(size_t members) { if (members > sketches.size()) sketches.resize(members); }
+    void reset() { sketches.clear(); for (auto &v : verdicts) v = 0; }
+
+    uint64_t count(SessionVerdict v) const { return verdicts[(int)v].load(memory_order_relaxed); }
+    size_t memoryBytes() const { return sketches.capacity() * sizeof(Sketch); }
+    const AnomalyLimits &limits() const { return lim; }
+};
+
+#ifdef FITNESS_HAVE_COROUTINES
+/* ---------------------------
+   Coroutine tasks, event loop and file I/O pool (C++20)
+   --------------------------- */
+struct TaskPromiseBase {
+    coroutine_handle<> continuation = noop_coroutine();
+    exception_ptr error;
+
+    suspend_always initial_suspend() noexcept { return {}; }
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        coroutine_handle<> await_suspend(coroutine_handle<P> h) noexcept { return h.promise().continuation; }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = current_exception(); }
+};
+
+template <typename T> struct TaskPromise;
+
+// Lazily started coroutine; co_await runs it and resumes the awaiter when it finishes
+// (symmetric transfer, so long await chains do not grow the stack).
+template <typename T = void>
+class [[nodiscard]] Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(coroutine_handle<promise_type> handle): h(handle) {}
+    Task(Task &&o) noexcept: h(exchange(o.h, nullptr)) {}
+    Task &operator=(Task &&o) noexcept {
+        if (this != &o) { if (h) h.destroy(); h = exchange(o.h, nullptr); }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() { if (h) h.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        h.promise().continuation = awaiting;
+        return h;
+    }
+    T await_resume() {
+        if (h.promise().error) rethrow_exception(h.promise().error);
+        if constexpr (!is_void<T>::value) return std::move(*h.promise().value);
+    }
+
+private:
+    coroutine_handle<promise_type> h;
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    optional<T> value;
+    Task<T> get_return_object() { return Task<T>(coroutine_handle<TaskPromise>::from_promise(*this)); }
+    template <typename U>
+    void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+};
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object() { return Task<void>(coroutine_handle<TaskPromise>::from_promise(*this)); }
+    void return_void() {}
+};
+
+// Single-threaded executor. Coroutines run only inside run(); other threads hand
+// work back with post(). run() returns once every spawned task has finished.
+class EventLoop {
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            suspend_never initial_suspend() noexcept { return {}; }
+            suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { terminate(); }
+        };
+    };
+
+    deque<coroutine_handle<>> ready;
+    mutex m;
+    condition_variable cv;
+    size_t outstanding = 0;
+    uint64_t failures = 0;
+
+    static Detached drive(EventLoop &loop, Task<void> task) {
+        co_await loop.schedule();
+        try {
+            co_await task;
+        } catch (...) {
+            ++loop.failures; // runs on the loop thread
+        }
+        loop.finished();
+    }
+    void finished() {
+        lock_guard<mutex> lk(m);
+        if (--outstanding == 0) cv.notify_all();
+    }
+
+public:
+    // thread-safe
+    void post(coroutine_handle<> h) {
+        lock_guard<mutex> lk(m);
+        ready.push_back(h);
+        cv.notify_one();
+    }
+    struct ScheduleAwaiter {
+        EventLoop &loop;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) { loop.post(h); }
+        void await_resume() const noexcept {}
+    };
+    // co_await loop.schedule() continues on the loop thread
+    ScheduleAwaiter schedule() { return {*this}; }
+    // starts a task; the loop owns it until it completes (exceptions are counted)
+    void spawn(Task<void> task) {
+        {
+            lock_guard<mutex> lk(m);
+            ++outstanding;
+        }
+        drive(*this, std::move(task));
+    }
+
+    void run() {
+        deque<coroutine_handle<>> batch;
+        for (;;) {
+            {
+                unique_lock<mutex> lk(m);
+                cv.wait(lk, [&] { return !ready.empty() || outstanding == 0; });
+                if (ready.empty()) return;
+                batch.swap(ready);
+            }
+            for (coroutine_handle<> h : batch) h.resume();
+            batch.clear();
+        }
+    }
+
+    uint64_t failedTasks() const { return failures; }
+};
+
+// Worker threads for blocking file and profile work. Appends queued for the same file
+// are written with one open and one flush, then all their awaiters are resumed. Only
+// one worker writes appends at a time, so lines land (and awaiters resume) in the
+// order they were queued.
+class FileIoPool {
+    struct Job {
+        function<void()> work;
+        EventLoop *loop;
+        coroutine_handle<> resume;
+    };
+    struct Append {
+        const string *path;
+        const string *line;
+        exception_ptr *error;
+        EventLoop *loop;
+        coroutine_handle<> resume;
+    };
+
+    deque<Job> jobs;
+    vector<Append> appends;
+    bool appendWriter = false; // a worker is writing a batch of appends
+    mutex m;
+    condition_variable cv;
+    bool stopping = false;
+    vector<thread> workers;
+    atomic<uint64_t> fileWrites{0};
+
+    void writeAppends(vector<Append> &batch) {
+        stable_sort(batch.begin(), batch.end(), [](const Append &a, const Append &b) { return *a.path < *b.path; });
+        for (size_t i = 0; i < batch.size();) {
+            size_t j = i;
+            while (j < batch.size() && *batch[j].path == *batch[i].path) ++j;
+            ofstream ofs(*batch[i].path, ios::app);
+            for (size_t k = i; k < j; ++k) {
+                if (ofs) ofs << *batch[k].line << '\n';
+                else *batch[k].error = make_exception_ptr(FitnessException("Unable to open log file"));
+            }
+            ofs.flush();
+            fileWrites.fetch_add(1, memory_order_relaxed);
+            for (size_t k = i; k < j; ++k) batch[k].loop->post(batch[k].resume);
+            i = j;
+        }
+    }
+
+    void workerLoop() {
+        vector<Append> batch;
+        for (;;) {
+            Job job;
+            {
+                unique_lock<mutex> lk(m);
+                bool canAppend = false;
+                cv.wait(lk, [&] {
+                    canAppend = !appends.empty() && !appendWriter;
+                    return canAppend || !jobs.empty() || (stopping && appends.empty() && !appendWriter);
+                });
+                if (canAppend) {
+                    batch.swap(appends);
+                    appendWriter = true;
+                } else if (!jobs.empty()) {
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                } else {
+                    return;
+                }
+            }
+            if (!batch.empty()) {
+                writeAppends(batch);
+                batch.clear();
+                lock_guard<mutex> lk(m);
+                appendWriter = false;
+                cv.notify_all(); // appends queued meanwhile, or shutdown
+            } else {
+                job.work();
+                job.loop->post(job.resume);
+            }
+        }
+    }
+
+public:
+    explicit FileIoPool(unsigned threads = 2) {
+        for (unsigned i = 0; i < max(1u, threads); ++i) workers.emplace_back([this] { workerLoop(); });
+    }
+    ~FileIoPool() {
+        {
+            lock_guard<mutex> lk(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (thread &t : workers) t.join();
+    }
+    FileIoPool(const FileIoPool &) = delete;
+    FileIoPool &operator=(const FileIoPool &) = delete;
+
+    // co_await io.run(loop, fn): fn runs on a worker, the result comes back on the loop
+    template <typename Fn>
+    auto run(EventLoop &loop, Fn fn) {
+        using R = invoke_result_t<Fn>;
+        struct Awaiter {
+            FileIoPool &pool;
+            EventLoop &loop;
+            Fn fn;
+            conditional_t<is_void<R>::value, bool, optional<R>> result{};
+            exception_ptr error;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(coroutine_handle<> h) {
+                Job job{[this] {
+                            try {
+                                if constexpr (is_void<R>::value) fn();
+                                else result.emplace(fn());
+                            } catch (...) {
+                                error = current_exception();
+                            }
+                        },
+                        &loop, h};
+                lock_guard<mutex> lk(pool.m);
+                pool.jobs.push_back(std::move(job));
+                pool.cv.notify_one();
+            }
+            R await_resume() {
+                if (error) rethrow_exception(error);
+                if constexpr (!is_void<R>::value) return std::move(*result);
+            }
+        };
+        return Awaiter{*this, loop, std::move(fn), {}, nullptr};
+    }
+
+    // co_await io.appendLine(loop, path, line): line plus '\n' appended to path
+    auto appendLine(EventLoop &loop, string path, string line) {
+        struct Awaiter {
+            FileIoPool &pool;
+            EventLoop &loop;
+            string path, line;
+            exception_ptr error;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(coroutine_handle<> h) {
+                lock_guard<mutex> lk(pool.m);
+                pool.appends.push_back({&path, &line, &error, &loop, h});
+                pool.cv.notify_one();
+            }
+            void await_resume() {
+                if (error) rethrow_exception(error);
+            }
+        };
+        return Awaiter{*this, loop, std::move(path), std::move(line), nullptr};
+    }
+
+    uint64_t fileWriteCount() const { return fileWrites.load(memory_order_relaxed); }
+};
+#endif
+
+/* ---------------------------
+   HierarchyRollup - member / team / gym / region totals
+   --------------------------- */
+enum class RollupLevel : uint8_t { Region = 0, Gym = 1, Team = 2, Member = 3 };
+
+struct RollupTotals {
+    double kcal = 0.0;
+    uint64_t sessions = 0;
+};
+
+// Every node keeps the totals of its whole subtree, updated along the path to the
+// root as sessions arrive, so any level is read in O(1). Writers are serialized and
+// publish through a sequence lock; readers retry if a write overlapped and, after a
+// few failed tries under a steady writer, take the writer lock for one read.
+// Nodes live in fixed-size chunks that never move, so readers may run while nodes
+// are added; names and levels are written before a node is published.
+class HierarchyRollup {
+    struct Node {
+        atomic<uint32_t> parent{UINT32_MAX};
+        RollupLevel level = RollupLevel::Region;
+        atomic<double> kcal{0.0};
+        atomic<uint64_t> sessions{0};
+        string name;
+    };
+    static const uint32_t kNoParent = UINT32_MAX;
+    static constexpr size_t kChunkBits = 12, kChunk = size_t(1) << kChunkBits;
+    static constexpr size_t kMaxChunks = size_t(1) << 14; // 64M nodes
+    static const int kOptimisticReads = 8;
+
+    unique_ptr<atomic<Node *>[]> chunks{new atomic<Node *>[kMaxChunks]()};
+    size_t count = 0; // writer side, under `writer`
+    mutable mutex writer;
+    atomic<uint64_t> seq{0};
+    atomic<size_t> published{0}; // nodes visible to readers
+    unordered_map<uint64_t, uint32_t> byKey; // external member key -> member node, under `writer`
+
+    Node &at(size_t i) const { return chunks[i >> kChunkBits].load(memory_order_acquire)[i & (kChunk - 1)]; }
+
+    void beginWrite() { seq.fetch_add(1, memory_order_relaxed); atomic_thread_fence(memory_order_release); }
+    void endWrite() { seq.fetch_add(1, memory_order_release); }
+
+    void addAlongPath(uint32_t node, double kcal, int64_t sessions) {
+        for (uint32_t n = node; n != kNoParent; n = at(n).parent.load(memory_order_relaxed)) {
+            Node &x = at(n);
+            x.kcal.store(x.kcal.load(memory_order_relaxed) + kcal, memory_order_relaxed);
+            x.sessions.store(x.sessions.load(memory_order_relaxed) + (uint64_t)sessions, memory_order_relaxed);
+        }
+    }
+
+    // fn may run more than once and must overwrite (not accumulate) its results
+    template <typename Fn>
+    void readConsistent(Fn fn) const {
+        for (int attempt = 0; attempt < kOptimisticReads; ++attempt) {
+            uint64_t s0 = seq.load(memory_order_acquire);
+            if (s0 & 1) { this_thread::yield(); continue; }
+            fn();
+            atomic_thread_fence(memory_order_acquire);
+            if (seq.load(memory_order_relaxed) == s0) return;
+        }
+        lock_guard<mutex> lk(writer);
+        fn();
+    }
+    void checkNode(uint32_t node) const {
+        if (node >= published.load(memory_order_acquire)) throw FitnessException("Unknown rollup node");
+    }
+    // under `writer`, before beginWrite(), so a bad id never leaves the sequence odd
+    void checkMember(uint32_t node) const {
+        if (node >= count || at(node).level != RollupLevel::Member) throw FitnessException("Not a rollup member");
+    }
+    // under `writer`; the node is built but not yet visible to readers
+    uint32_t buildNode(RollupLevel level, uint32_t parent, const string &name) {
+        if (level != RollupLevel::Region &&
+            (parent >= count || static_cast<int>(at(parent).level) != static_cast<int>(level) - 1))
+            throw FitnessException("Rollup node must be added under the level above it");
+        if (count == kMaxChunks * kChunk) throw FitnessException("Rollup is full");
+        if ((count & (kChunk - 1)) == 0) chunks[count >> kChunkBits].store(new Node[kChunk], memory_order_release);
+        Node &n = at(count);
+        n.parent.store(level == RollupLevel::Region ? kNoParent : parent, memory_order_relaxed);
+        n.level = level;
+        n.name = name;
+        return (uint32_t)count;
+    }
+
+public:
+    HierarchyRollup() = default;
+    HierarchyRollup(const HierarchyRollup &) = delete;
+    HierarchyRollup &operator=(const HierarchyRollup &) = delete;
+    ~HierarchyRollup() {
+        for (size_t c = 0; c < kMaxChunks && c << kChunkBits < count; ++c) delete[] chunks[c].load(memory_order_relaxed);
+    }
+
+    uint32_t addNode(RollupLevel level, uint32_t parent, const string &name = "") {
+        lock_guard<mutex> lk(writer);
+        uint32_t node = buildNode(level, parent, name);
+        published.store(++count, memory_order_release);
+        return node;
+    }
+    uint32_t addRegion(const string &name) { return addNode(RollupLevel::Region, kNoParent, name); }
+    uint32_t addGym(uint32_t region, const string &name) { return addNode(RollupLevel::Gym, region, name); }
+    uint32_t addTeam(uint32_t gym, const string &name) { return addNode(RollupLevel::Team, gym, name); }
+    uint32_t addMember(uint32_t team, const string &name = "") { return addNode(RollupLevel::Member, team, name); }
+    // A member reachable by an external key (e.g. its UserStore index), so sessions
+    // logged elsewhere can be recorded with recordForKey.
+    // The key is registered before the member becomes visible.
+    uint32_t addMember(uint32_t team, const string &name, uint64_t key) {
+        lock_guard<mutex> lk(writer);
+        uint32_t node = buildNode(RollupLevel::Member, team, name);
+        byKey[key] = node;
+        published.store(++count, memory_order_release);
+        return node;
+    }
+
+    // one logged session for a member
+    void record(uint32_t member, double kcal) {
+        lock_guard<mutex> lk(writer);
+        checkMember(member);
+        beginWrite();
+        addAlongPath(member, kcal, 1);
+        endWrite();
+    }
+    // one logged session for the member registered under `key`; false if there is none
+    bool recordForKey(uint64_t key, double kcal) {
+        lock_guard<mutex> lk(writer);
+        auto it = byKey.find(key);
+        if (it == byKey.end()) return false;
+        beginWrite();
+        addAlongPath(it->second, kcal, 1);
+        endWrite();
+        return true;
+    }
+    // many sessions under one lock acquisition; all or none are recorded
+    void recordBatch(const vector<pair<uint32_t, double>> &events) {
+        lock_guard<mutex> lk(writer);
+        for (const auto &e : events) checkMember(e.first);
+        beginWrite();
+        for (const auto &e : events) addAlongPath(e.first, e.second, 1);
+        endWrite();
+    }
+
+    // Re-parents a node (member to another team, team to another gym, ...): its subtree
+    // totals leave the old ancestors and join the new ones, O(depth).
+    void move(uint32_t node, uint32_t newParent) {
+        lock_guard<mutex> lk(writer);
+        if (node >= count) throw FitnessException("Unknown rollup node");
+        Node &n = at(node);
+        if (n.level == RollupLevel::Region || newParent >= count ||
+            static_cast<int>(at(newParent).level) != static_cast<int>(n.level) - 1)
+            throw FitnessException("Rollup node must move under the level above it");
+        double kcal = n.kcal.load(memory_order_relaxed);
+        int64_t sessions = (int64_t)n.sessions.load(memory_order_relaxed);
+        beginWrite();
+        addAlongPath(n.parent.load(memory_order_relaxed), -kcal, -sessions);
+        n.parent.store(newParent, memory_order_relaxed);
+        addAlongPath(newParent, kcal, sessions);
+        endWrite();
+    }
+
+    RollupTotals totals(uint32_t node) const {
+        checkNode(node);
+        const Node &n = at(node);
+        RollupTotals t;
+        readConsistent([&]() {
+            t.kcal = n.kcal.load(memory_order_relaxed);
+            t.sessions = n.sessions.load(memory_order_relaxed);
+        });
+        return t;
+    }
+
+    // All nodes' totals, read one chunk of kChunk nodes at a time: each chunk is
+    // consistent by itself, but chunks may be a few writes apart, so a parent's total
+    // can differ slightly from the sum of children in other chunks.
+    vector<RollupTotals> snapshot() const {
+        size_t n = published.load(memory_order_acquire);
+        vector<RollupTotals> out(n);
+        for (size_t lo = 0; lo < n; lo += kChunk) {
+            const Node *chunk = &at(lo);
+            size_t len = min(kChunk, n - lo);
+            readConsistent([&]() {
+                for (size_t i = 0; i < len; ++i) {
+                    out[lo + i].kcal = chunk[i].kcal.load(memory_order_relaxed);
+                    out[lo + i].sessions = chunk[i].sessions.load(memory_order_relaxed);
+                }
+            });
+        }
+        return out;
+    }
+
+    // leaderboard for one level from a snapshot: (node, totals), highest kcal first
+    vector<pair<uint32_t, RollupTotals>> top(RollupLevel level, size_t k) const {
+        vector<RollupTotals> snap = snapshot();
+        vector<pair<uint32_t, RollupTotals>> out;
+        for (uint32_t i = 0; i < snap.size(); ++i)
+            if (at(i).level == level) out.push_back({i, snap[i]});
+        size_t cnt = min(k, out.size());
+        partial_sort(out.begin(), out.begin() + cnt, out.end(),
+                     [](const pair<uint32_t, RollupTotals> &a, const pair<uint32_t, RollupTotals> &b) { return a.second.kcal > b.second.kcal; });
+        out.resize(cnt);
+        return out;
+    }
+
+    const string &name(uint32_t node) const { checkNode(node); return at(node).name; }
+    uint32_t parentOf(uint32_t node) const { checkNode(node); return at(node).parent.load(memory_order_relaxed); }
+    size_t size() const { return published.load(memory_order_acquire); }
+};
+
+/* ---------------------------
+   Logger - file I/O
+   --------------------------- */
+// What is known about a session beyond the workout itself. Each attached component
+// uses what it needs and is skipped when that is missing.
+struct SessionContext {
+    string_view sessionId;   // client id for retries; empty = not deduplicated
+    time_t sessionTime = 0;  // when the session happened (dedup day)
+    int64_t member = -1;     // UserStore index; -1 = unknown: global anomaly rules only, no rollup
+    int heartRate = 0;       // average, 0 = not recorded
+};
+
+struct LogOutcome {
+    DedupResult dedup = DedupResult::Accepted;  // not Accepted: nothing was written
+    SessionVerdict verdict = SessionVerdict::Ok; // Quarantined: written to <log>.quarantine
+    uint16_t reasons = 0;                        // anomaly reason bits
+    bool logged() const { return dedup == DedupResult::Accepted && verdict != SessionVerdict::Quarantined; }
+};
+
+class Logger {
+    string filename;
+    SessionTextIndex *index = nullptr;           // optional, kept in step with the file
+    SessionDeduplicator *dedup = nullptr;        // optional, sessions with an id
+    SessionAnomalyDetector *anomalies = nullptr; // optional, member rules when the member is known
+    HierarchyRollup *rollup = nullptr;           // optional, sessions of a known member (key = member)
+
+    static string formatLine(const Person &p, const Workout &w, double calories) {
+        ostringstream line;
+        line << "[" << chrono::system_clock::to_time_t(chrono::system_clock::now())
+             << "] " << p.getName() << " did " << w.getName()
+             << " for " << w.getDuration() << " min, calories: " << fixed << setprecision(2) << calories;
+        return line.str();
+    }
+    void appendLine(const string &file, const string &line) {
+        ofstream ofs(file, ios::app);
+        if (!ofs) throw FitnessException("Unable to open log file");
+        ofs << line << "\n";
+    }
+
+    // Runs dedup and anomaly detection. Returns false when nothing is to be written;
+    // otherwise sets the file and line to append.
+    bool admit(const Person &p, const Workout &w, double calories, const SessionContext &ctx, LogOutcome &out,
+               string &file, string &line) {
+        if (dedup && !ctx.sessionId.empty()) {
+            out.dedup = dedup->check(ctx.sessionId, (int64_t)ctx.sessionTime);
+            if (out.dedup != DedupResult::Accepted) return false;
+        }
+        if (anomalies) {
+            AnomalyResult a = ctx.member >= 0
+                ? anomalies->check((uint32_t)ctx.member, w.kind(), w.getMet(), w.getDuration(), w.getIntensity(),
+                                   calories, p.getWeight(), ctx.heartRate)
+                : anomalies->checkGlobal(w.kind(), w.getMet(), w.getDuration(), w.getIntensity(), calories,
+                                         p.getWeight(), ctx.heartRate);
+            out.verdict = a.verdict;
+            out.reasons = a.reasons;
+        }
+        file = filename;
+        line = formatLine(p, w, calories);
+        if (out.verdict == SessionVerdict::Quarantined) {
+            file += ".quarantine";
+            line += " [" + anomalyReasonText(out.reasons) + "]";
+        } else if (out.verdict == SessionVerdict::Flagged) {
+            line += " [flagged: " + anomalyReasonText(out.reasons) + "]";
+        }
+        return true;
+    }
+    // after the line is in its file
+    void written(const string &line, double calories, const SessionContext &ctx, const LogOutcome &out) {
+        if (!out.logged()) return;
+        if (index) index->addDocument(line);
+        if (rollup && ctx.member >= 0) rollup->recordForKey((uint64_t)ctx.member, calories);
+    }
+    // the write failed: a retry with the same id must not count as a duplicate
+    void unwritten(const SessionContext &ctx, const LogOutcome &) {
+        if (dedup && !ctx.sessionId.empty()) dedup->release(ctx.sessionId, (int64_t)ctx.sessionTime);
+    }
+
+public:
+    Logger(const string &fname = "fitness_log.txt"): filename(fname) {}
+
+    // Keeps `idx` updated on every logSession. An empty index first catches up on
+    // the lines already in the file, so document ids stay equal to line numbers.
+    void attachIndex(SessionTextIndex *idx) {
+        index = idx;
+        if (index && index->documentCount() == 0) index->indexFile(filename);
+    }
+    void attachDeduplicator(SessionDeduplicator *d) { dedup = d; }
+    void attachAnomalyDetector(SessionAnomalyDetector *d) { anomalies = d; }
+    void attachRollup(HierarchyRollup *r) { rollup = r; }
+    const string &getFilename() const { return filename; }
+
+    // The one logging path; every attached component sees every session it has the data
+    // for. A session id already seen for its day (or too old) writes nothing; the id is
+    // only kept once the line is written. Quarantined sessions go to <log>.quarantine,
+    // flagged ones are logged with a marker. The index and rollup follow the main log.
+    LogOutcome logSession(const Person &p, const Workout &w, double calories, const SessionContext &ctx) {
+        LogOutcome out;
+        string file, line;
+        if (!admit(p, w, calories, ctx, out, file, line)) return out;
+        try {
+            appendLine(file, line);
+        } catch (...) {
+            unwritten(ctx, out);
+            throw;
+        }
+        written(line, calories, ctx, out);
+        return out;
+    }
+    void logSession(const Person &p, const Workout &w, double calories) {
+        logSession(p, w, calories, SessionContext());
+    }
+    // idempotent variant for client retries
+    DedupResult logSession(const Person &p, const Workout &w, double calories, string_view sessionId, time_t sessionTime) {
+        SessionContext ctx;
+        ctx.sessionId = sessionId;
+        ctx.sessionTime = sessionTime;
+        return logSession(p, w, calories, ctx).dedup;
+    }
+    // variant for a known member (UserStore index)
+    SessionVerdict logSession(const Person &p, const Workout &w, double calories, uint32_t member, int heartRate = 0) {
+        SessionContext ctx;
+        ctx.member = member;
+        ctx.heartRate = heartRate;
+        return logSession(p, w, calories, ctx).verdict;
+    }
+#ifdef FITNESS_HAVE_COROUTINES
+    // Coroutine variant of the same path: the append runs on the I/O pool (batched with
+    // other pending appends to this file) while the loop serves other requests. p, w and
+    // the session id in ctx must stay alive until the task completes.
+    Task<LogOutcome> logSessionAsync(EventLoop &loop, FileIoPool &io, const Person &p, const Workout &w, double calories,
+                                     SessionContext ctx = SessionContext()) {
+        LogOutcome out;
+        string file, line;
+        if (!admit(p, w, calories, ctx, out, file, line)) co_return out;
+        exception_ptr failed;
+        try {
+            co_await io.appendLine(loop, file, line);
+        } catch (...) {
+            failed = current_exception();
+        }
+        if (failed) {
+            unwritten(ctx, out);
+            rethrow_exception(failed);
+        }
+        written(line, calories, ctx, out); // back on the loop thread
+        co_return out;
+    }
+#endif
+};
+
+/* ---------------------------
+   Parallel helper
+   --------------------------- */
+inline unsigned workerCount(unsigned requested = 0) {
+    if (requested) return requested;
+    unsigned hc = thread::hardware_concurrency();
+    return hc ? hc : 1;
+}
+
+// Runs fn(part) for part in [0, parts) on one thread each; the calling thread takes part 0.
+template <typename Fn>
+void runParts(unsigned parts, Fn fn) {
+    if (parts <= 1) { fn(0u); return; }
+    vector<thread> pool;
+    pool.reserve(parts - 1);
+    for (unsigned t = 1; t < parts; ++t) pool.emplace_back([&fn, t]() { fn(t); });
+    fn(0u);
+    for (thread &th : pool) th.join();
+}
+
+// Splits [0, n) into contiguous ranges and calls fn(begin, end) for each range in parallel.
+template <typename Fn>
+void parallelFor(size_t n, unsigned threads, Fn fn) {
+    unsigned parts = (unsigned)min<size_t>(workerCount(threads), max<size_t>(1, n));
+    runParts(parts, [&](unsigned t) { fn(n * t / parts, n * (t + 1) / parts); });
+}
+
+/* ---------------------------
+   Bit streams (for compressed series)
+   --------------------------- */
+class BitWriter {
+    vector<uint64_t> &words;
+    size_t &bitLen;
+public:
+    BitWriter(vector<uint64_t> &w, size_t &len): words(w), bitLen(len) {}
+    // appends the low n bits of v (n <= 64), most significant first
+    void write(uint64_t v, int n) {
+        if (n == 0) return;
+        if (n < 64) v &= (1ull << n) - 1;
+        size_t used = bitLen & 63;
+        if (used == 0) words.push_back(0);
+        int room = 64 - (int)used;
+        if (n <= room) {
+            words.back() |= v << (room - n);
+        } else {
+            words.back() |= v >> (n - room);
+            words.push_back(v << (64 - (n - room)));
+        }
+        bitLen += (size_t)n;
+    }
+};
+
+class BitReader {
+    const uint64_t *words;
+    size_t pos = 0;
+public:
+    explicit BitReader(const uint64_t *w): words(w) {}
+    uint64_t read(int n) {
+        if (n == 0) return 0;
+        size_t wi = pos >> 6;
+        int used = (int)(pos & 63), room = 64 - used;
+        uint64_t v;
+        if (n <= room) v = (words[wi] << used) >> (64 - n);
+        else v = ((words[wi] << used) >> (64 - n)) | (words[wi + 1] >> (64 - (n - room)));
+        pos += (size_t)n;
+        return v;
+    }
+    bool bit() { return read(1) != 0; }
+};
+
+/* ---------------------------
+   GorillaSeries - compressed (timestamp, value) samples
+   --------------------------- */
+// Facebook Gorilla encoding in append-only blocks: delta-of-delta timestamps and
+// XOR-ed doubles. Values are first snapped to the series resolution (e.g. 0.1 kg) and
+// stored in resolution units, so consecutive XORs have long runs of trailing zeros;
+// resolution 0 keeps values exact.
+class GorillaSeries {
+    static const uint32_t kBlockSamples = 256;
+    struct Block {
+        int64_t firstTs = 0, lastTs = 0;
+        uint32_t count = 0;
+        vector<uint64_t> bits;
+        size_t bitLen = 0;
+        // encoder state
+        int64_t prevDelta = 0;
+        uint64_t prevValue = 0;
+        int prevLeading = -1, prevTrailing = 0;
+    };
+    vector<Block> blocks;
+    double resolution;
+
+    double toUnits(double v) const { return resolution > 0 ? nearbyint(v / resolution) : v; }
+    double fromUnits(double u) const { return resolution > 0 ? u * resolution : u; }
+
+    static uint64_t bitsOf(double d) { uint64_t u; memcpy(&u, &d, sizeof u); return u; }
+    static double doubleOf(uint64_t u) { double d; memcpy(&d, &u, sizeof d); return d; }
+
+    // Decodes one block, calling fn(ts, value) until fn returns false.
+    template <typename Fn>
+    void decode(const Block &b, Fn fn) const {
+        if (b.count == 0) return;
+        BitReader r(b.bits.data());
+        int64_t ts = (int64_t)r.read(64), delta = 0;
+        uint64_t value = r.read(64);
+        int leading = 0, trailing = 0;
+        if (!fn(ts, fromUnits(doubleOf(value)))) return;
+        for (uint32_t i = 1; i < b.count; ++i) {
+            int64_t dod;
+            if (!r.bit()) dod = 0;
+            else if (!r.bit()) dod = (int64_t)r.read(7) - 63;
+            else if (!r.bit()) dod = (int64_t)r.read(9) - 255;
+            else if (!r.bit()) dod = (int64_t)r.read(12) - 2047;
+            else dod = (int64_t)(int32_t)(uint32_t)r.read(32);
+            delta += dod;
+            ts += delta;
+            if (r.bit()) {
+                if (r.bit()) {
+                    leading = (int)r.read(5);
+                    int meaningful = (int)r.read(6) + 1;
+                    trailing = 64 - leading - meaningful;
+                }
+                value ^= r.read(64 - leading - trailing) << trailing;
+            }
+            if (!fn(ts, fromUnits(doubleOf(value)))) return;
+        }
+    }
+
+    // first block that may hold samples at or after ts
+    size_t firstBlockFor(int64_t ts) const {
+        auto it = upper_bound(blocks.begin(), blocks.end(), ts,
+                              [](int64_t t, const Block &b) { return t < b.firstTs; });
+        return it == blocks.begin() ? 0 : (size_t)(it - blocks.begin() - 1);
+    }
+
+public:
+    explicit GorillaSeries(double res = 0.0): resolution(res) {}
+
+    // Samples must arrive in time order; false for an out-of-order timestamp.
+    bool append(int64_t ts, double v) {
+        if (!blocks.empty() && ts < blocks.back().lastTs) return false;
+        uint64_t value = bitsOf(toUnits(v));
+        Block *b = blocks.empty() ? nullptr : &blocks.back();
+        int64_t delta = b ? ts - b->lastTs : 0;
+        int64_t dod = b ? delta - b->prevDelta : 0;
+        if (!b || b->count >= kBlockSamples || dod < INT32_MIN || dod > INT32_MAX) {
+            blocks.emplace_back();
+            b = &blocks.back();
+            BitWriter w(b->bits, b->bitLen);
+            w.write((uint64_t)ts, 64);
+            w.write(value, 64);
+            b->firstTs = b->lastTs = ts;
+            b->prevValue = value;
+            b->count = 1;
+            return true;
+        }
+        BitWriter w(b->bits, b->bitLen);
+        if (dod == 0) w.write(0, 1);
+        else if (dod >= -63 && dod <= 64) { w.write(0b10, 2); w.write((uint64_t)(dod + 63), 7); }
+        else if (dod >= -255 && dod <= 256) { w.write(0b110, 3); w.write((uint64_t)(dod + 255), 9); }
+        else if (dod >= -2047 && dod <= 2048) { w.write(0b1110, 4); w.write((uint64_t)(dod + 2047), 12); }
+        else { w.write(0b1111, 4); w.write((uint64_t)(uint32_t)(int32_t)dod, 32); }
+
+        uint64_t x = value ^ b->prevValue;
+        if (x == 0) {
+            w.write(0, 1);
+        } else {
+            int leading = min(31, __builtin_clzll(x)), trailing = __builtin_ctzll(x);
+            if (b->prevLeading >= 0 && leading >= b->prevLeading && trailing >= b->prevTrailing) {
+                w.write(0b10, 2); // fits the previous meaningful-bit window
+                w.write(x >> b->prevTrailing, 64 - b->prevLeading - b->prevTrailing);
+            } else {
+                int meaningful = 64 - leading - trailing;
+                w.write(0b11, 2);
+                w.write((uint64_t)leading, 5);
+                w.write((uint64_t)(meaningful - 1), 6);
+                w.write(x >> trailing, meaningful);
+                b->prevLeading = leading;
+                b->prevTrailing = trailing;
+            }
+        }
+        b->prevDelta = delta;
+        b->prevValue = value;
+        b->lastTs = ts;
+        ++b->count;
+        return true;
+    }
+
+    // fn(ts, value) for samples with from <= ts <= to
+    template <typename Fn>
+    void scan(int64_t from, int64_t to, Fn fn) const {
+        for (size_t i = firstBlockFor(from); i < blocks.size() && blocks[i].firstTs <= to; ++i) {
+            if (blocks[i].lastTs < from) continue;
+            decode(blocks[i], [&](int64_t ts, double v) {
+                if (ts > to) return false;
+                if (ts >= from) fn(ts, v);
+                return true;
+            });
+        }
+    }
+
+    vector<pair<int64_t, double>> range(int64_t from, int64_t to) const {
+        vector<pair<int64_t, double>> out;
+        scan(from, to, [&](int64_t ts, double v) { out.push_back({ts, v}); });
+        return out;
+    }
+
+    struct Bucket {
+        int64_t start;
+        uint32_t count;
+        double min, max, mean, last;
+    };
+    // fixed-width buckets over [from, to]; empty buckets are omitted
+    vector<Bucket> downsample(int64_t from, int64_t to, int64_t step) const {
+        vector<Bucket> out;
+        if (step <= 0) return out;
+        scan(from, to, [&](int64_t ts, double v) {
+            int64_t start = from + (ts - from) / step * step;
+            if (out.empty() || out.back().start != start) out.push_back({start, 0, v, v, 0.0, v});
+            Bucket &b = out.back();
+            b.min = min(b.min, v);
+            b.max = max(b.max, v);
+            b.mean += (v - b.mean) / ++b.count;
+            b.last = v;
+        });
+        return out;
+    }
+
+    // latest sample at or before ts
+    bool valueAt(int64_t ts, double &out) const {
+        if (blocks.empty() || ts < blocks.front().firstTs) return false;
+        bool found = false;
+        decode(blocks[firstBlockFor(ts)], [&](int64_t t, double v) {
+            if (t > ts) return false;
+            out = v;
+            found = true;
+            return true;
+        });
+        return found;
+    }
+
+    bool latest(int64_t &ts, double &v) const {
+        if (blocks.empty()) return false;
+        ts = blocks.back().lastTs;
+        return valueAt(ts, v);
+    }
+    bool earliest(int64_t &ts, double &v) const {
+        if (blocks.empty()) return false;
+        ts = blocks.front().firstTs;
+        return valueAt(ts, v);
+    }
+
+    size_t sampleCount() const {
+        size_t n = 0;
+        for (const Block &b : blocks) n += b.count;
+        return n;
+    }
+    // encoded payload plus per-block headers
+    size_t compressedBytes() const {
+        size_t n = 0;
+        for (const Block &b : blocks) n += (b.bitLen + 7) / 8 + 2 * sizeof(int64_t) + sizeof(uint32_t);
+        return n;
+    }
+};
+
+/* ---------------------------
+   BodyMetricHistory - per-member metric series
+   --------------------------- */
+enum class BodyMetric : uint8_t { WeightKg = 0, BodyFatPct, RestingHeartRate, Count };
+
+inline double bodyMetricResolution(BodyMetric m) {
+    switch (m) {
+        case BodyMetric::WeightKg: return 0.1;
+        case BodyMetric::BodyFatPct: return 0.1;
+        default: return 1.0;
+    }
+}
+
+class BodyMetricHistory {
+    static const size_t kMetrics = static_cast<size_t>(BodyMetric::Count);
+    vector<array<GorillaSeries, kMetrics>> series; // by UserStore index
+
+    void ensure(size_t u) {
+        while (series.size() <= u) {
+            series.emplace_back();
+            for (size_t m = 0; m < kMetrics; ++m)
+                series.back()[m] = GorillaSeries(bodyMetricResolution(static_cast<BodyMetric>(m)));
+        }
+    }
+public:
+    bool record(size_t u, BodyMetric m, int64_t ts, double value) {
+        ensure(u);
+        return series[u][static_cast<size_t>(m)].append(ts, value);
+    }
+    const GorillaSeries *find(size_t u, BodyMetric m) const {
+        return u < series.size() ? &series[u][static_cast<size_t>(m)] : nullptr;
+    }
+    // weight at the time of a past session; before the first sample the earliest known
+    // weight, and `fallback` only for members without any samples
+    double weightAt(size_t u, int64_t ts, double fallback) const {
+        const GorillaSeries *s = find(u, BodyMetric::WeightKg);
+        double w;
+        int64_t first;
+        if (s && s->valueAt(ts, w)) return w;
+        return s && s->earliest(first, w) ? w : fallback;
+    }
+    size_t sampleCount() const {
+        size_t n = 0;
+        for (const auto &per : series) for (const GorillaSeries &s : per) n += s.sampleCount();
+        return n;
+    }
+    size_t compressedBytes() const {
+        size_t n = 0;
+        for (const auto &per : series) for (const GorillaSeries &s : per) n += s.compressedBytes();
+        return n;
+    }
+};
+
+/* ---------------------------
+   WeightTrend - exponentially weighted regression
+   --------------------------- */
+// Weighted least-squares line through the weigh-ins, older samples decaying with a
+// half-life. Sums are kept relative to the latest sample, so each update is O(1)
+// and the intercept is the smoothed current weight.
+struct WeightTrend {
+    double s0 = 0, s1 = 0, s2 = 0, sy = 0, sty = 0; // sum w, w*t, w*t^2, w*y, w*t*y (t in days)
+    int64_t lastTs = 0;
+    uint32_t samples = 0;
+
+    void update(int64_t ts, double kg, double halfLifeDays = 30.0) {
+        if (samples > 0) {
+            double dt = (ts - lastTs) / 86400.0;
+            if (dt < 0) return; // out of order
+            double decay = exp2(-dt / halfLifeDays);
+            // move the origin to the new sample (t -> t - dt), then decay
+            s2 = (s2 - 2 * dt * s1 + dt * dt * s0) * decay;
+            sty = (sty - dt * sy) * decay;
+            s1 = (s1 - dt * s0) * decay;
+            s0 *= decay;
+            sy *= decay;
+        }
+        s0 += 1;
+        sy += kg;
+        lastTs = ts;
+        ++samples;
+    }
+    bool hasTrend() const { return samples >= 3 && s0 * s2 - s1 * s1 > 1e-9; }
+    double slopePerDay() const { return hasTrend() ? (s0 * sty - s1 * sy) / (s0 * s2 - s1 * s1) : 0.0; }
+    double current() const { return s0 > 0 ? (sy - slopePerDay() * s1) / s0 : 0.0; }
+    double predict(int64_t ts) const { return current() + slopePerDay() * (ts - lastTs) / 86400.0; }
+
+    // When the trend line reaches targetKg: lastTs if already there, nothing if the
+    // trend points away from the target (or is flat).
+    optional<int64_t> projectedGoalDate(double targetKg) const {
+        if (s0 <= 0) return nullopt;
+        double now = current(), slope = slopePerDay();
+        if (fabs(now - targetKg) < 0.05) return lastTs;
+        if (fabs(slope) < 1e-6) return nullopt;
+        double days = (targetKg - now) / slope;
+        if (days < 0 || days > 3650) return nullopt; // moving away, or too far out to be useful
+        return lastTs + (int64_t)(days * 86400);
+    }
+};
+
+enum class GoalKind : uint8_t { Lose, Build, Maintain };
+
+// same substring rules as FitnessApp::recommendPlanForUser
+inline GoalKind goalKindOf(string_view goal) {
+    if (goal.find("Lose") != string_view::npos || goal.find("lose") != string_view::npos) return GoalKind::Lose;
+    if (goal.find("Build") != string_view::npos || goal.find("build") != string_view::npos) return GoalKind::Build;
+    return GoalKind::Maintain;
+}
+
+// healthy expected rate of change per goal, kg/week
+inline double expectedKgPerWeek(GoalKind g) {
+    return g == GoalKind::Lose ? -0.5 : g == GoalKind::Build ? 0.25 : 0.0;
+}
+
+// the built-in plan for each goal (FitnessApp::recommendPlanForUser)
+inline void fillDefaultPlan(GoalKind g, WorkoutPlan &plan) {
+    if (g == GoalKind::Lose) {
+        plan.emplace<Cardio>("HIIT", 25, 9, 10.0);
+        plan.emplace<Strength>("Full-body strength", 30, 7);
+        plan.emplace<Flexibility>("Stretch", 15, 2);
+    } else if (g == GoalKind::Build) {
+        plan.emplace<Strength>("Hypertrophy", 50, 8);
+        plan.emplace<Cardio>("Light cardio", 20, 4, 5.5);
+        plan.emplace<Flexibility>("Mobility", 20, 3);
+    } else {
+        // maintain
+        plan.emplace<Cardio>("Steady-state", 30, 5, 6.0);
+        plan.emplace<Strength>("Maintenance strength", 30, 5);
+    }
+}
+
+/* ---------------------------
+   UserStore - columnar member profiles
+   --------------------------- */
+// Bulk data lives here rather than in User objects: millions of members must not
+// pay for a heap object (and a constructor trace line) each.
+class UserStore {
+    vector<uint64_t> memberIds;
+    vector<string> names;
+    vector<uint32_t> goalIds;
+    vector<int64_t> profileTimes; // when the profile (and its weight) was taken, 0 if unknown
+    ProfileColumns profiles;
+    StringPool goals;
+    unordered_map<uint64_t, uint32_t> byMemberId;
+public:
+    size_t size() const { return memberIds.size(); }
+    void reserve(size_t n) {
+        memberIds.reserve(n); names.reserve(n); goalIds.reserve(n); profileTimes.reserve(n);
+        profiles.reserve(n); byMemberId.reserve(n);
+    }
+    // false when the member id is already present
+    bool add(uint64_t id, string name, int age, double w, double h, char g, string_view goal, int64_t profileTime = 0) {
+        if (!byMemberId.emplace(id, (uint32_t)memberIds.size()).second) return false;
+        memberIds.push_back(id);
+        names.push_back(std::move(name));
+        goalIds.push_back(goals.intern(goal));
+        profileTimes.push_back(profileTime);
+        profiles.push_back(age, w, h, g);
+        return true;
+    }
+    // internal index of a member, or -1 when unknown
+    int64_t indexOf(uint64_t id) const {
+        auto it = byMemberId.find(id);
+        return it == byMemberId.end() ? -1 : (int64_t)it->second;
+    }
+    // Updates the current weight and records it in `history` (if given). On a member's
+    // first update the weight it replaces is recorded first, dated from the profile, so
+    // sessions before ts are still estimated with the weight they were done at.
+    void updateWeight(size_t i, double kg, int64_t ts, BodyMetricHistory *history = nullptr) {
+        if (history) {
+            const GorillaSeries *s = history->find(i, BodyMetric::WeightKg);
+            if (!s || s->sampleCount() == 0)
+                history->record(i, BodyMetric::WeightKg, min(profileTimes[i], ts), profiles.weightKg[i]);
+            history->record(i, BodyMetric::WeightKg, ts, kg);
+        }
+        profiles.weightKg[i] = kg;
+    }
+    int64_t profileTime(size_t i) const { return profileTimes[i]; }
+    uint64_t memberId(size_t i) const { return memberIds[i]; }
+    const string &name(size_t i) const { return names[i]; }
+    const string &goal(size_t i) const { return goals.at(goalIds[i]); }
+    uint32_t goalId(size_t i) const { return goalIds[i]; }
+    const StringPool &goalNames() const { return goals; }
+    // goalKindOf for every goal id, so column scans can index it with goalId(i)
+    vector<GoalKind> goalKinds() const {
+        vector<GoalKind> kinds(goals.size());
+        for (uint32_t g = 0; g < kinds.size(); ++g) kinds[g] = goalKindOf(goals.at(g));
+        return kinds;
+    }
+    const ProfileColumns &columns() const { return profiles; }
+    ProfileColumns &columns() { return profiles; }
+
+    User toUser(size_t i) const {
+        return User(names[i], profiles.age[i], profiles.weightKg[i], profiles.heightCm[i],
+                    profiles.gender[i], goal(i));
+    }
+};
+
+/* ---------------------------
+   SessionLog - columnar workout history
+   --------------------------- */
+struct SessionLog {
+    vector<uint32_t> user;         // UserStore index
+    vector<int64_t> timestamp;     // unix seconds
+    vector<uint32_t> workout;      // id in workoutNames
+    vector<WorkoutKind> kind;
+    vector<uint16_t> durationMin;
+    vector<uint8_t> intensity;
+    vector<uint16_t> avgHeartRate; // 0 = no heart-rate data
+    vector<float> calories;
+    vector<float> met;             // MET the workout was logged with
+    StringPool workoutNames;
+
+    size_t size() const { return user.size(); }
+    void reserve(size_t n) {
+        user.reserve(n); timestamp.reserve(n); workout.reserve(n); kind.reserve(n);
+        durationMin.reserve(n); intensity.reserve(n); avgHeartRate.reserve(n); calories.reserve(n); met.reserve(n);
+    }
+    // metValue 0 = unknown, recorded as the kind's default MET
+    void append(uint32_t u, int64_t ts, uint32_t w, WorkoutKind k, uint16_t d, uint8_t inten, uint16_t hr, float cal,
+                float metValue = 0.0f) {
+        user.push_back(u); timestamp.push_back(ts); workout.push_back(w); kind.push_back(k);
+        durationMin.push_back(d); intensity.push_back(inten); avgHeartRate.push_back(hr); calories.push_back(cal);
+        met.push_back(metValue > 0.0f ? metValue : (float)defaultMet(k));
+    }
+    // for writers that fill rows in place (set) from several threads
+    void resize(size_t n) {
+        user.resize(n); timestamp.resize(n); workout.resize(n); kind.resize(n);
+        durationMin.resize(n); intensity.resize(n); avgHeartRate.resize(n); calories.resize(n); met.resize(n);
+    }
+    void set(size_t i, uint32_t u, int64_t ts, uint32_t w, WorkoutKind k, uint16_t d, uint8_t inten, uint16_t hr,
+             float cal, float metValue = 0.0f) {
+        user[i] = u; timestamp[i] = ts; workout[i] = w; kind[i] = k;
+        durationMin[i] = d; intensity[i] = inten; avgHeartRate[i] = hr; calories[i] = cal;
+        met[i] = metValue > 0.0f ? metValue : (float)defaultMet(k);
+    }
+    // rows [from, from + n) moved down to start at `to` (to <= from)
+    void moveRows(size_t from, size_t n, size_t to) {
+        auto move = [&](auto &col) { std::move(col.begin() + from, col.begin() + from + n, col.begin() + to); };
+        move(user); move(timestamp); move(workout); move(kind);
+        move(durationMin); move(intensity); move(avgHeartRate); move(calories); move(met);
+    }
+};
+
+// Row indices of `log` split by member into `parts` shards (member u goes to shard
+// u % parts), each shard's rows in log order. Threads partition their own slice of the
+// log, so replays sharded by member never scan the whole log per thread.
+inline vector<vector<size_t>> shardRowsByMember(const SessionLog &log, unsigned parts) {
+    vector<vector<size_t>> offset(parts, vector<size_t>(parts, 0)); // [slice][shard]
+    runParts(parts, [&](unsigned t) {
+        for (size_t i = log.size() * t / parts, e = log.size() * (t + 1) / parts; i < e; ++i)
+            ++offset[t][log.user[i] % parts];
+    });
+    vector<vector<size_t>> shards(parts);
+    for (unsigned p = 0; p < parts; ++p) {
+        size_t total = 0;
+        for (unsigned t = 0; t < parts; ++t) {
+            size_t n = offset[t][p];
+            offset[t][p] = total;
+            total += n;
+        }
+        shards[p].resize(total);
+    }
+    runParts(parts, [&](unsigned t) {
+        vector<size_t> &next = offset[t];
+        for (size_t i = log.size() * t / parts, e = log.size() * (t + 1) / parts; i < e; ++i) {
+            unsigned p = log.user[i] % parts;
+            shards[p][next[p]++] = i;
+        }
+    });
+    return shards;
+}
+
+// Session calories re-estimated with the session's logged MET and the member's weight at
+// the time of the session (falling back to the current profile weight before the first
+// recorded sample).
+inline vector<float> recomputeSessionCalories(const SessionLog &log, const UserStore &users,
+                                              const BodyMetricHistory &history, unsigned threads = 0) {
+    vector<float> out(log.size());
+    const ProfileColumns &prof = users.columns();
+    parallelFor(log.size(), threads, [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            uint32_t u = log.user[i];
+            double w = history.weightAt(u, log.timestamp[i], prof.weightKg[u]);
+            out[i] = (float)(caloriesPerKg(log.kind[i], log.met[i], log.durationMin[i], log.intensity[i]) * w);
+        }
+    });
+    return out;
+}
+
+// Runs the detector over an existing log (backfill), in log order per member, using
+// each member's current profile weight. Members are sharded across threads.
+inline vector<AnomalyResult> backfillAnomalies(SessionAnomalyDetector &det, const SessionLog &log,
+                                               const UserStore &users, unsigned threads = 0) {
+    vector<AnomalyResult> out(log.size());
+    const ProfileColumns &prof = users.columns();
+    det.reserve(users.size());
+    auto check = [&](size_t i) {
+        uint32_t u = log.user[i];
+        out[i] = det.check(u, log.kind[i], log.met[i], log.durationMin[i], log.intensity[i], log.calories[i],
+                           prof.weightKg[u], log.avgHeartRate[i]);
+    };
+    unsigned parts = workerCount(threads);
+    if (parts == 1) {
+        for (size_t i = 0; i < log.size(); ++i) check(i);
+        return out;
+    }
+    vector<vector<size_t>> shards = shardRowsByMember(log, parts);
+    runParts(parts, [&](unsigned p) {
+        for (size_t i : shards[p]) check(i);
+    });
+    return out;
+}
+
+/* ---------------------------
+   WeightTrendStore - trends for all members
+   --------------------------- */
+struct TrendDeviation {
+    uint32_t user;
+    double actualKgPerWeek;
+    double expectedKgPerWeek;
+    double deviation; // actual - expected, kg/week
+};
+
+class WeightTrendStore {
+    vector<WeightTrend> trends; // by UserStore index
+    double halfLifeDays;
+public:
+    explicit WeightTrendStore(double halfLife = 30.0): halfLifeDays(halfLife) {}
+
+    void observe(size_t u, int64_t ts, double kg) {
+        if (u >= trends.size()) trends.resize(u + 1);
+        trends[u].update(ts, kg, halfLifeDays);
+    }
+    const WeightTrend &at(size_t u) const { return trends[u]; }
+    size_t size() const { return trends.size(); }
+
+    // Replays every member's weight series (in parallel).
+    void rebuild(const BodyMetricHistory &history, size_t users, unsigned threads = 0) {
+        trends.assign(users, WeightTrend());
+        parallelFor(users, threads, [&](size_t lo, size_t hi) {
+            for (size_t u = lo; u < hi; ++u) {
+                const GorillaSeries *s = history.find(u, BodyMetric::WeightKg);
+                if (!s) continue;
+                s->scan(INT64_MIN, INT64_MAX, [&](int64_t ts, double kg) { trends[u].update(ts, kg, halfLifeDays); });
+            }
+        });
+    }
+
+    // Members furthest from the trajectory their goal implies, largest |deviation| first.
+    vector<TrendDeviation> rankByDeviation(const UserStore &users, size_t topK, unsigned threads = 0) const {
+        size_t n = min(users.size(), trends.size());
+        vector<GoalKind> goalOfId = users.goalKinds();
+        auto further = [](const TrendDeviation &a, const TrendDeviation &b) {
+            return fabs(a.deviation) > fabs(b.deviation);
+        };
+        mutex m;
+        vector<TrendDeviation> best;
+        parallelFor(n, threads, [&](size_t lo, size_t hi) {
+            vector<TrendDeviation> local; // min-heap on |deviation|
+            for (size_t u = lo; u < hi; ++u) {
+                const WeightTrend &t = trends[u];
+                if (!t.hasTrend()) continue;
+                double expected = expectedKgPerWeek(goalOfId[users.goalId(u)]);
+                double actual = t.slopePerDay() * 7;
+                TrendDeviation d{(uint32_t)u, actual, expected, actual - expected};
+                if (local.size() < topK) { local.push_back(d); push_heap(local.begin(), local.end(), further); }
+                else if (topK && further(d, local.front())) {
+                    pop_heap(local.begin(), local.end(), further);
+                    local.back() = d;
+                    push_heap(local.begin(), local.end(), further);
+                }
+            }
+            lock_guard<mutex> lk(m);
+            best.insert(best.end(), local.begin(), local.end());
+        });
+        sort(best.begin(), best.end(), further);
+        if (best.size() > topK) best.resize(topK);
+        return best;
+    }
+};
+
+/* ---------------------------
+   CalibrationStore - calibration models for all members
+   --------------------------- */
+// One UserCalibration (<= 64 bytes) per UserStore index; 10M members is ~640 MB.
+class CalibrationStore {
+    vector<UserCalibration> models;
+public:
+    void resize(size_t users) { models.resize(users); }
+    size_t size() const { return models.size(); }
+    UserCalibration &at(size_t u) { return models[u]; }
+    const UserCalibration &at(size_t u) const { return models[u]; }
+    size_t memoryBytes() const { return models.capacity() * sizeof(UserCalibration); }
+
+    // Online update as a session with heart-rate data arrives.
+    bool observe(size_t u, const ProfileColumns &prof, WorkoutKind k, double met, int durationMin,
+                 int intensity, double avgHr) {
+        if (u >= models.size()) models.resize(u + 1);
+        if (avgHr < 60) return false;
+        double truth = heartRateCalories(prof.gender[u], prof.age[u], prof.weightKg[u], avgHr, durationMin);
+        return models[u].observe(k, met, durationMin, intensity, prof.weightKg[u], truth);
+    }
+
+    // Rebuilds every model from history: sessions are bucketed by member, then each
+    // worker replays its members' sessions in time order. Each session is fitted with
+    // the MET it was logged with and the member's weight at that time (from `history`
+    // when given, else the current profile weight), so the model applies to
+    // Workout::estimateCalories(p, cal), which uses the workout's own MET.
+    void refit(const UserStore &users, const SessionLog &log, const BodyMetricHistory *history = nullptr,
+               unsigned threads = 0) {
+        const size_t n = users.size();
+        models.assign(n, UserCalibration());
+        vector<uint32_t> start(n + 1, 0), order(log.size());
+        for (size_t i = 0; i < log.size(); ++i) ++start[log.user[i] + 1];
+        for (size_t u = 0; u < n; ++u) start[u + 1] += start[u];
+        vector<uint32_t> fill(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < log.size(); ++i) order[fill[log.user[i]]++] = (uint32_t)i;
+
+        const ProfileColumns &prof = users.columns();
+        parallelFor(n, threads, [&](size_t lo, size_t hi) {
+            for (size_t u = lo; u < hi; ++u) {
+                auto b = order.begin() + start[u], e = order.begin() + start[u + 1];
+                if (!is_sorted(b, e, [&](uint32_t x, uint32_t y) { return log.timestamp[x] < log.timestamp[y]; }))
+                    sort(b, e, [&](uint32_t x, uint32_t y) { return log.timestamp[x] < log.timestamp[y]; });
+                for (auto it = b; it != e; ++it) {
+                    size_t i = *it;
+                    if (log.avgHeartRate[i] < 60) continue;
+                    double kg = history ? history->weightAt(u, log.timestamp[i], prof.weightKg[u]) : prof.weightKg[u];
+                    double truth = heartRateCalories(prof.gender[u], prof.age[u], kg, log.avgHeartRate[i], log.durationMin[i]);
+                    models[u].observe(log.kind[i], log.met[i], log.durationMin[i], log.intensity[i], kg, truth);
+                }
+            }
+        });
+    }
+};
+
+/* ---------------------------
+   TrainingProgram - periodized multi-week programs
+   --------------------------- */
+// Exercises a program can prescribe (names match the default catalog).
+struct ProgramExercise { const char *name; WorkoutKind kind; double met; };
+const ProgramExercise kProgramExercises[] = {
+    {"HIIT", WorkoutKind::Cardio, 10.0},
+    {"Steady-state", WorkoutKind::Cardio, 6.0},
+    {"Light cardio", WorkoutKind::Cardio, 5.5},
+    {"Full-body strength", WorkoutKind::Strength, 6.0},
+    {"Hypertrophy", WorkoutKind::Strength, 6.0},
+    {"Maintenance strength", WorkoutKind::Strength, 6.0},
+    {"Stretch", WorkoutKind::Flexibility, 3.0},
+    {"Mobility", WorkoutKind::Flexibility, 3.0},
+};
+enum : uint8_t { kExHiit, kExSteady, kExLightCardio, kExFullBody, kExHypertrophy, kExMaintStrength, kExStretch, kExMobility };
+
+struct SessionPrescription {
+    uint8_t exercise; // index into kProgramExercises
+    uint8_t day;      // 0 = Monday
+    uint16_t durationMin;
+    uint8_t intensity;
+};
+
+struct WeekPrescription {
+    int week;  // 0-based
+    int meso;  // mesocycle number
+    bool deload;
+    uint8_t count;
+    SessionPrescription sessions[6];
+};
+
+// A program is a weekly template plus ramp parameters; week k is derived on demand:
+//   mesocycle m = k / mesoLength, position p = k % mesoLength, last position = deload
+//   duration  = base * (1 + mesoStep*m) * (1 + durationRamp*p)   (deload: * deloadFactor, no ramp)
+//   intensity = base + intensityRamp*p + m                         (deload: base - 2), clamped to 1..10
+struct TrainingProgram {
+    GoalKind goal = GoalKind::Maintain;
+    uint8_t weeks = 8;
+    uint8_t mesoLength = 4;
+    uint8_t slotCount = 0;
+    float durationRamp = 0.08f;
+    float intensityRamp = 0.5f;
+    float mesoStep = 0.05f;
+    float deloadFactor = 0.6f;
+    SessionPrescription slots[6];
+
+    // mesoLength as used: a hand-built 0 counts as 1 (no deloads)
+    int mesoWeeks() const { return max<int>(1, mesoLength); }
+    bool isDeload(int k) const { return mesoWeeks() > 1 && k % mesoWeeks() == mesoWeeks() - 1; }
+
+    WeekPrescription week(int k) const {
+        WeekPrescription w{k, k / mesoWeeks(), isDeload(k), slotCount, {}};
+        int p = k % mesoWeeks();
+        double durScale = (1.0 + mesoStep * w.meso) * (w.deload ? deloadFactor : 1.0 + durationRamp * p);
+        for (uint8_t i = 0; i < slotCount; ++i) {
+            SessionPrescription s = slots[i];
+            s.durationMin = (uint16_t)max(5.0, nearbyint(s.durationMin * durScale));
+            double inten = w.deload ? s.intensity - 2 : s.intensity + intensityRamp * p + w.meso;
+            s.intensity = (uint8_t)min(10.0, max(1.0, nearbyint(inten)));
+            w.sessions[i] = s;
+        }
+        return w;
+    }
+
+    // Appends week k's sessions to plan (the plan owns the new workouts).
+    void fillPlan(int k, WorkoutPlan &plan) const {
+        WeekPrescription w = week(k);
+        for (uint8_t i = 0; i < w.count; ++i) {
+            const SessionPrescription &s = w.sessions[i];
+            const ProgramExercise &e = kProgramExercises[s.exercise];
+            if (e.kind == WorkoutKind::Cardio) plan.emplace<Cardio>(e.name, s.durationMin, s.intensity, e.met);
+            else if (e.kind == WorkoutKind::Strength) plan.emplace<Strength>(e.name, s.durationMin, s.intensity);
+            else plan.emplace<Flexibility>(e.name, s.durationMin, s.intensity);
+        }
+    }
+
+    // Total calories over the whole program, one pass over the weeks.
+    double projectedCalories(double weightKg) const {
+        double perKg = 0.0;
+        for (int k = 0; k < weeks; ++k) {
+            WeekPrescription w = week(k);
+            for (uint8_t i = 0; i < w.count; ++i) {
+                const SessionPrescription &s = w.sessions[i];
+                const ProgramExercise &e = kProgramExercises[s.exercise];
+                perKg += caloriesPerKg(e.kind, e.met, s.durationMin, s.intensity);
+            }
+        }
+        return perKg * weightKg;
+    }
+};
+
+// Builds a member's program from goal, age and BMI.
+inline TrainingProgram makeProgram(GoalKind goal, int age, double bmi) {
+    TrainingProgram p;
+    p.goal = goal;
+    auto slot = [&p](uint8_t ex, uint8_t day, uint16_t dur, uint8_t inten) { p.slots[p.slotCount++] = {ex, day, dur, inten}; };
+    if (goal == GoalKind::Lose) {
+        p.weeks = 12;
+        slot(kExHiit, 0, 25, 8);
+        slot(kExFullBody, 1, 30, 7);
+        slot(kExSteady, 3, 35, 5);
+        slot(kExFullBody, 4, 30, 6);
+        slot(kExStretch, 6, 15, 2);
+    } else if (goal == GoalKind::Build) {
+        p.weeks = 16;
+        p.intensityRamp = 0.4f;
+        slot(kExHypertrophy, 0, 50, 7);
+        slot(kExHypertrophy, 2, 50, 7);
+        slot(kExLightCardio, 3, 20, 4);
+        slot(kExHypertrophy, 4, 45, 7);
+        slot(kExMobility, 5, 20, 3);
+    } else {
+        p.weeks = 8;
+        p.durationRamp = 0.04f;
+        p.intensityRamp = 0.25f;
+        slot(kExSteady, 1, 30, 5);
+        slot(kExMaintStrength, 3, 30, 5);
+        slot(kExSteady, 5, 30, 5);
+    }
+    // older or heavier members start easier and ramp more gently
+    int easeOff = (age >= 50 ? 1 : 0) + (bmi >= 30 ? 1 : 0);
+    for (uint8_t i = 0; i < p.slotCount; ++i)
+        p.slots[i].intensity = (uint8_t)max(1, p.slots[i].intensity - easeOff);
+    p.intensityRamp *= easeOff ? 0.5f : 1.0f;
+    return p;
+}
+
+// Nightly regeneration for every member.
+inline vector<TrainingProgram> generatePrograms(const UserStore &users, unsigned threads = 0) {
+    vector<TrainingProgram> out(users.size());
+    const ProfileColumns &prof = users.columns();
+    vector<GoalKind> goalOfId = users.goalKinds();
+    parallelFor(users.size(), threads, [&](size_t lo, size_t hi) {
+        for (size_t u = lo; u < hi; ++u) {
+            double h = prof.heightCm[u] / 100.0;
+            double bmi = h > 0 ? prof.weightKg[u] / (h * h) : 0.0;
+            out[u] = makeProgram(goalOfId[users.goalId(u)], prof.age[u], bmi);
+        }
+    });
+    return out;
+}
+
+/* ---------------------------
+   RecommendationTable - compiled recommendation rules
+   --------------------------- */
+// Rule file format ('#' starts a comment). Rules are tried top to bottom, first match wins:
+//   goal=lose age>=60 -> gentle-start
+//   goal=lose bmi>=30 load<1500 -> walk-start
+//   goal=build,maintain gender=F -> strength-mix
+//   * -> maintain
+// Conditions: age / bmi / load (kcal burned over the last 7 days) with < <= > >= =,
+// gender=M|F|X and goal=lose|build|maintain (comma lists allowed).
+// Plans: plan <name>: <kind> <minutes> <intensity> [met=<m>] <title>; ...
+//   plan walk-start: cardio 30 4 met=3.5 Brisk walk; flexibility 10 2 Stretch
+struct RecommendationItem {
+    WorkoutKind kind;
+    uint16_t minutes;
+    uint8_t intensity;
+    double met;
+    string name;
+};
+
+// Every numeric boundary used by any rule becomes a cut point, which splits the
+// member space into cells; each cell stores the plan of the first rule matching it.
+// A lookup is one bucket count per numeric attribute plus an index computation.
+class RecommendationTable {
+public:
+    static constexpr uint16_t kNoPlan = 0xFFFF;
+    enum Attr { Age, Bmi, Load, kNumericAttrs };
+
+private:
+    static constexpr size_t kMaxCuts = 15;
+    static constexpr size_t kMaxCells = size_t(1) << 22;
+
+    struct Rule {
+        double lo[kNumericAttrs], hi[kNumericAttrs]; // [lo, hi)
+        uint8_t genders = 7, goals = 7;               // bitmasks
+        string plan;
+        size_t line;
+    };
+
+    vector<double> cuts[kNumericAttrs];
+    size_t stride[kNumericAttrs + 2] = {};
+    vector<uint16_t> cells;
+    vector<string> planNames;
+    vector<vector<RecommendationItem>> plans;
+    size_t uncovered = 0;
+
+    static int genderBucket(char g) { return g == 'M' || g == 'm' ? 0 : g == 'F' || g == 'f' ? 1 : 2; }
+    // the whole of s is a number (stod would stop at trailing garbage)
+    static bool parseNumber(string_view s, double &v) {
+        from_chars_result r = from_chars(s.data(), s.data() + s.size(), v);
+        return !s.empty() && r.ec == errc() && r.ptr == s.data() + s.size();
+    }
+
+    static void parsePlan(const string &body, vector<RecommendationItem> &items, const function<void(const string &)> &fail) {
+        stringstream all(body);
+        string part;
+        while (getline(all, part, ';')) {
+            istringstream in(part);
+            string kind, w;
+            RecommendationItem item{WorkoutKind::Cardio, 0, 5, 0.0, ""};
+            int minutes = 0, intensity = 0;
+            if (!(in >> kind)) continue;
+            if (kind == "cardio") item.kind = WorkoutKind::Cardio;
+            else if (kind == "strength") item.kind = WorkoutKind::Strength;
+            else if (kind == "flexibility") item.kind = WorkoutKind::Flexibility;
+            else fail("unknown workout kind '" + kind + "'");
+            if (!(in >> minutes >> intensity) || minutes <= 0 || minutes > 600 || intensity < 1 || intensity > 10)
+                fail("plan item needs <minutes> <intensity 1-10>");
+            item.minutes = (uint16_t)minutes;
+            item.intensity = (uint8_t)intensity;
+            item.met = defaultMet(item.kind);
+            while (in >> w) {
+                if (item.name.empty() && w.compare(0, 4, "met=") == 0) {
+                    if (!parseNumber(string_view(w).substr(4), item.met)) fail("bad met value");
+                    continue;
+                }
+                item.name += (item.name.empty() ? "" : " ") + w;
+            }
+            if (item.name.empty()) fail("plan item needs a title");
+            items.push_back(item);
+        }
+        if (items.empty()) fail("plan has no items");
+    }
+
+    static void parseCondition(const string &c, Rule &r, const function<void(const string &)> &fail) {
+        size_t opPos = c.find_first_of("<>=");
+        if (opPos == string::npos || opPos == 0) fail("bad condition '" + c + "'");
+        string attr = c.substr(0, opPos);
+        size_t opEnd = opPos + 1;
+        if (opEnd < c.size() && c[opEnd] == '=') ++opEnd;
+        string op = c.substr(opPos, opEnd - opPos), value = c.substr(opEnd);
+        if (value.empty()) fail("missing value in '" + c + "'");
+        if (attr == "gender" || attr == "goal") {
+            if (op != "=") fail(attr + " only supports '='");
+            uint8_t mask = 0;
+            stringstream vs(value);
+            string v;
+            while (getline(vs, v, ',')) {
+                if (attr == "gender") {
+                    if (v == "M" || v == "F" || v == "X") mask |= (uint8_t)(1u << genderBucket(v[0]));
+                    else fail("gender must be M, F or X");
+                } else {
+                    if (v == "lose") mask |= 1u << (int)GoalKind::Lose;
+                    else if (v == "build") mask |= 1u << (int)GoalKind::Build;
+                    else if (v == "maintain") mask |= 1u << (int)GoalKind::Maintain;
+                    else fail("goal must be lose, build or maintain");
+                }
+            }
+            (attr == "gender" ? r.genders : r.goals) &= mask;
+            return;
+        }
+        int a = attr == "age" ? Age : attr == "bmi" ? Bmi : attr == "load" ? Load : -1;
+        if (a < 0) fail("unknown attribute '" + attr + "'");
+        double v;
+        if (!parseNumber(value, v)) { fail("bad number in '" + c + "'"); return; }
+        double above = nextafter(v, HUGE_VAL); // x > v  <=>  x >= above
+        if (op == ">=") r.lo[a] = max(r.lo[a], v);
+        else if (op == ">") r.lo[a] = max(r.lo[a], above);
+        else if (op == "<") r.hi[a] = min(r.hi[a], v);
+        else if (op == "<=") r.hi[a] = min(r.hi[a], above);
+        else if (op == "=") { r.lo[a] = max(r.lo[a], v); r.hi[a] = min(r.hi[a], above); }
+        else fail("bad operator in '" + c + "'");
+    }
+
+public:
+    // Throws FitnessException (with the line number) on malformed rule text.
+    static shared_ptr<const RecommendationTable> compile(const string &text) {
+        auto t = make_shared<RecommendationTable>();
+        vector<Rule> rules;
+        map<string, uint16_t> planIds;
+        istringstream in(text);
+        string line;
+        size_t lineNo = 0;
+        while (getline(in, line)) {
+            ++lineNo;
+            auto fail = [lineNo](const string &why) {
+                throw FitnessException("Recommendation rule line " + to_string(lineNo) + ": " + why);
+            };
+            size_t hash = line.find('#');
+            if (hash != string::npos) line.resize(hash);
+            istringstream words(line);
+            string w;
+            if (!(words >> w)) continue;
+            if (w == "plan") {
+                size_t colon = line.find(':');
+                string name;
+                words >> name;
+                if (!name.empty() && name.back() == ':') name.pop_back();
+                if (colon == string::npos || name.empty()) fail("expected 'plan <name>: ...'");
+                if (planIds.count(name)) fail("plan '" + name + "' defined twice");
+                if (t->plans.size() >= kNoPlan) fail("too many plans");
+                planIds[name] = (uint16_t)t->plans.size();
+                t->planNames.push_back(name);
+                t->plans.emplace_back();
+                parsePlan(line.substr(colon + 1), t->plans.back(), fail);
+                continue;
+            }
+            Rule r;
+            for (int a = 0; a < kNumericAttrs; ++a) { r.lo[a] = -HUGE_VAL; r.hi[a] = HUGE_VAL; }
+            r.line = lineNo;
+            bool arrow = false;
+            do {
+                if (w == "->") { arrow = true; break; }
+                if (w != "*") parseCondition(w, r, fail);
+            } while (words >> w);
+            if (!arrow || !(words >> r.plan)) fail("expected '-> <plan>'");
+            rules.push_back(r);
+        }
+
+        for (const Rule &r : rules) {
+            if (!planIds.count(r.plan))
+                throw FitnessException("Recommendation rule line " + to_string(r.line) + ": unknown plan '" + r.plan + "'");
+            for (int a = 0; a < kNumericAttrs; ++a) {
+                if (r.lo[a] != -HUGE_VAL) t->cuts[a].push_back(r.lo[a]);
+                if (r.hi[a] != HUGE_VAL) t->cuts[a].push_back(r.hi[a]);
+            }
+        }
+        size_t dims[kNumericAttrs + 2];
+        for (int a = 0; a < kNumericAttrs; ++a) {
+            vector<double> &c = t->cuts[a];
+            sort(c.begin(), c.end());
+            c.erase(unique(c.begin(), c.end()), c.end());
+            if (c.size() > kMaxCuts) throw FitnessException("Recommendation rules use too many distinct boundaries");
+            dims[a] = c.size() + 1;
+        }
+        dims[kNumericAttrs] = 3;     // gender
+        dims[kNumericAttrs + 1] = 3; // goal
+        size_t total = 1;
+        for (int d = kNumericAttrs + 1; d >= 0; --d) { t->stride[d] = total; total *= dims[d]; }
+        if (total > kMaxCells) throw FitnessException("Recommendation rules produce too many cells");
+
+        // each cell is represented by its lower corner
+        t->cells.assign(total, kNoPlan);
+        for (size_t cell = 0; cell < total; ++cell) {
+            double rep[kNumericAttrs];
+            for (int a = 0; a < kNumericAttrs; ++a) {
+                size_t b = cell / t->stride[a] % dims[a];
+                rep[a] = b == 0 ? -HUGE_VAL : t->cuts[a][b - 1];
+            }
+            size_t gender = cell / t->stride[kNumericAttrs] % 3, goal = cell % 3;
+            for (const Rule &r : rules) {
+                bool match = (r.genders >> gender & 1) && (r.goals >> goal & 1);
+                for (int a = 0; a < kNumericAttrs && match; ++a) match = rep[a] >= r.lo[a] && rep[a] < r.hi[a];
+                if (match) { t->cells[cell] = planIds[r.plan]; break; }
+            }
+            t->uncovered += t->cells[cell] == kNoPlan;
+        }
+        return t;
+    }
+
+    // number of cut points at or below v
+    size_t bucket(Attr a, double v) const {
+        size_t b = 0;
+        for (double c : cuts[a]) b += v >= c;
+        return b;
+    }
+
+    // plan id for one member, or kNoPlan if no rule covers them
+    uint16_t lookup(int age, double bmi, char gender, GoalKind goal, double load = 0.0) const {
+        return cells[bucket(Age, age) * stride[Age] + bucket(Bmi, bmi) * stride[Bmi] + bucket(Load, load) * stride[Load] +
+                     (size_t)genderBucket(gender) * stride[kNumericAttrs] + (size_t)goal];
+    }
+    uint16_t lookup(const User &u, double load = 0.0) const {
+        Expected<double> bmi = u.tryBmi();
+        return lookup(u.getAge(), bmi ? bmi.value() : 0.0, u.getGender(), goalKindOf(u.getGoal()), load);
+    }
+
+    // Plan ids for every member; recentLoad (kcal over the last 7 days, per member) is optional.
+    vector<uint16_t> evaluate(const UserStore &users, const vector<float> *recentLoad = nullptr, unsigned threads = 0) const {
+        vector<uint16_t> out(users.size());
+        const ProfileColumns &prof = users.columns();
+        vector<GoalKind> goalOfId = users.goalKinds();
+        parallelFor(users.size(), threads, [&](size_t lo, size_t hi) {
+            for (size_t u = lo; u < hi; ++u) {
+                double h = prof.heightCm[u] / 100.0;
+                double bmi = h > 0 ? prof.weightKg[u] / (h * h) : 0.0;
+                out[u] = lookup(prof.age[u], bmi, prof.gender[u], goalOfId[users.goalId(u)],
+                                recentLoad ? (*recentLoad)[u] : 0.0);
+            }
+        });
+        return out;
+    }
+
+    void fillPlan(uint16_t plan, WorkoutPlan &out) const {
+        for (const RecommendationItem &e : plans.at(plan)) {
+            if (e.kind == WorkoutKind::Cardio) out.emplace<Cardio>(e.name, e.minutes, e.intensity, e.met);
+            else if (e.kind == WorkoutKind::Strength) out.emplace<Strength>(e.name, e.minutes, e.intensity);
+            else out.emplace<Flexibility>(e.name, e.minutes, e.intensity);
+        }
+    }
+
+    const string &planName(uint16_t plan) const { return planNames.at(plan); }
+    size_t planCount() const { return plans.size(); }
+    size_t cellCount() const { return cells.size(); }
+    size_t uncoveredCells() const { return uncovered; }
+};
+
+// A rule file that can be reloaded while lookups continue; readers keep whichever
+// table they loaded until they drop it.
+class RecommendationRules {
+    string path;
+    shared_ptr<const RecommendationTable> table;
+    filesystem::file_time_type loadedAt{};
+    mutex reloading;
+
+    static string readAll(const string &path) {
+        ifstream in(path);
+        if (!in) throw FitnessException("Cannot open recommendation rules: " + path);
+        stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+public:
+    explicit RecommendationRules(string file): path(std::move(file)) {
+        error_code ec;
+        loadedAt = filesystem::last_write_time(path, ec);
+        table = RecommendationTable::compile(readAll(path));
+    }
+
+    // Recompiles if the file changed since the last load. A file that fails to compile
+    // leaves the current table in place and its message in *error.
+    bool reloadIfChanged(string *error = nullptr) {
+        lock_guard<mutex> lk(reloading);
+        error_code ec;
+        filesystem::file_time_type t = filesystem::last_write_time(path, ec);
+        if (ec || t == loadedAt) return false;
+        try {
+            shared_ptr<const RecommendationTable> fresh = RecommendationTable::compile(readAll(path));
+            atomic_store(&table, fresh);
+            loadedAt = t;
+            return true;
+        } catch (const FitnessException &e) {
+            if (error) *error = e.what();
+            return false;
+        }
+    }
+
+    shared_ptr<const RecommendationTable> current() const { return atomic_load(&table); }
+    const string &file() const { return path; }
+};
+
+/* ---------------------------
+   ReplayHarness - offline comparison of recommendation strategies
+   --------------------------- */
+// What a strategy sees for one member at the start of one week.
+struct ReplayContext {
+    uint32_t member;
+    int age;
+    double bmi;
+    double weightKg;
+    char gender;
+    GoalKind goal;
+    double recentLoad; // kcal logged in the previous week
+};
+
+struct ReplayStrategy {
+    string name;
+    function<int(const ReplayContext &)> choose; // harness plan index, -1 = no recommendation
+};
+
+struct ReplayResult {
+    string name;
+    uint64_t weeks = 0;       // member-weeks replayed
+    uint64_t recommended = 0; // member-weeks with a plan
+    double planKcal = 0;      // mean planned kcal per recommended week
+    double agreement = 0;     // share of weeks matching the logging policy
+    double dm = 0, ips = 0, snips = 0, dr = 0; // completion-rate estimates; NaN = not estimable
+};
+
+// Replays every member-week of a session log through several strategies. The first
+// strategy is the logging policy (what members actually received); it is deterministic,
+// so its propensity is 1 and IPS/SNIPS only use weeks where a candidate agrees with it.
+// A week counts as completed when the logged sessions cover kCompletedShare of the
+// plan's minutes per workout kind. The direct-method model is the mean observed
+// completion per (goal, age band, BMI band, plan); (cell, plan) pairs the logging
+// policy never visited fall back to the share of the cell's logged weeks whose
+// activity would have covered the plan (fitted on the whole cell, never on the week
+// being scored). IPS and SNIPS are reported as NaN when a strategy never agrees with
+// the logging policy.
+class ReplayHarness {
+public:
+    static constexpr double kCompletedShare = 0.8;
+
+private:
+    struct PlanSummary {
+        string name;
+        float minutes[kWorkoutKinds];
+        float total;
+        double kcalPerKg;
+    };
+    struct WeekActivity {
+        float minutes[kWorkoutKinds];
+        double kcal;
+    };
+    static const size_t kCells = 3 * 4 * 4;
+
+    vector<PlanSummary> plans;
+    unordered_map<string, int> planBySignature;
+    vector<ReplayStrategy> strategies;
+
+    static int64_t weekOf(int64_t ts) {
+        int64_t day = ts >= 0 ? ts / 86400 : (ts - 86399) / 86400;
+        return day + 3 >= 0 ? (day + 3) / 7 : (day + 3 - 6) / 7; // Monday-based
+    }
+    static size_t cellOf(const ReplayContext &c) {
+        size_t age = c.age < 30 ? 0 : c.age < 45 ? 1 : c.age < 60 ? 2 : 3;
+        size_t bmi = c.bmi < 18.5 ? 0 : c.bmi < 25 ? 1 : c.bmi < 30 ? 2 : 3;
+        return ((size_t)c.goal * 4 + age) * 4 + bmi;
+    }
+    double coverage(int plan, const WeekActivity &w) const {
+        const PlanSummary &p = plans[plan];
+        if (p.total <= 0) return 1.0;
+        float done = 0;
+        for (size_t k = 0; k < kWorkoutKinds; ++k) done += min(p.minutes[k], w.minutes[k]);
+        return done / p.total;
+    }
+    bool completed(int plan, const WeekActivity &w) const { return coverage(plan, w) >= kCompletedShare; }
+
+    // Calls fn(context, activity) for every week between each member's first and last
+    // session in [lo, hi); weeks without sessions are included with no activity.
+    template <typename Fn>
+    void forEachMemberWeek(const UserStore &users, const SessionLog &log, const vector<uint32_t> &start,
+                           const vector<uint32_t> &order, size_t lo, size_t hi, Fn fn) const {
+        const ProfileColumns &prof = users.columns();
+        vector<pair<int64_t, uint32_t>> sessions;
+        for (size_t u = lo; u < hi; ++u) {
+            if (start[u] == start[u + 1]) continue;
+            sessions.clear();
+            for (uint32_t k = start[u]; k < start[u + 1]; ++k) sessions.push_back({weekOf(log.timestamp[order[k]]), order[k]});
+            sort(sessions.begin(), sessions.end());
+            double h = prof.heightCm[u] / 100.0;
+            ReplayContext ctx{(uint32_t)u, prof.age[u], h > 0 ? prof.weightKg[u] / (h * h) : 0.0, prof.weightKg[u],
+                              prof.gender[u], goalKindOf(users.goal(u)), 0.0};
+            size_t s = 0;
+            for (int64_t week = sessions.front().first; week <= sessions.back().first; ++week) {
+                WeekActivity act{{0, 0, 0}, 0.0};
+                for (; s < sessions.size() && sessions[s].first == week; ++s) {
+                    uint32_t i = sessions[s].second;
+                    act.minutes[(size_t)log.kind[i]] += log.durationMin[i];
+                    act.kcal += log.calories[i];
+                }
+                fn(ctx, act);
+                ctx.recentLoad = act.kcal;
+            }
+        }
+    }
+
+public:
+    // Registers a plan the strategies can return and returns its index. Plans with
+    // the same workouts share an index, so agreement compares content, not names.
+    int addPlan(const string &name, const WorkoutPlan &plan) {
+        PlanSummary p{name, {0, 0, 0}, 0, 0.0};
+        ostringstream sig;
+        for (size_t i = 0; i < plan.size(); ++i) {
+            const Workout &w = plan.at(i);
+            p.minutes[(size_t)w.kind()] += w.getDuration();
+            p.total += w.getDuration();
+            p.kcalPerKg += caloriesPerKg(w.kind(), w.getMet(), w.getDuration(), w.getIntensity());
+            sig << (int)w.kind() << '|' << w.getName() << '|' << w.getDuration() << '|' << w.getIntensity() << '|' << w.getMet() << ';';
+        }
+        auto it = planBySignature.emplace(sig.str(), (int)plans.size());
+        if (it.second) plans.push_back(p);
+        return it.first->second;
+    }
+
+    // The first strategy added is the logging policy.
+    void addStrategy(ReplayStrategy s) { strategies.push_back(std::move(s)); }
+
+    // FitnessApp's built-in goal mapping
+    void addBuiltinStrategy(const string &name = "builtin") {
+        int ids[3];
+        for (GoalKind g : {GoalKind::Lose, GoalKind::Build, GoalKind::Maintain}) {
+            WorkoutPlan plan;
+            fillDefaultPlan(g, plan);
+            ids[(int)g] = addPlan(name + "/" + to_string((int)g), plan);
+        }
+        addStrategy({name, [ids](const ReplayContext &c) { return ids[(int)c.goal]; }});
+    }
+
+    // a compiled rule table (the table is kept alive by the strategy)
+    void addRuleStrategy(const string &name, shared_ptr<const RecommendationTable> table) {
+        vector<int> ids(table->planCount());
+        for (size_t p = 0; p < ids.size(); ++p) {
+            WorkoutPlan plan;
+            table->fillPlan((uint16_t)p, plan);
+            ids[p] = addPlan(name + "/" + table->planName((uint16_t)p), plan);
+        }
+        addStrategy({name, [table, ids](const ReplayContext &c) {
+            uint16_t id = table->lookup(c.age, c.bmi, c.gender, c.goal, c.recentLoad);
+            return id == RecommendationTable::kNoPlan ? -1 : ids[id];
+        }});
+    }
+
+    // Two passes over the log: the first fits the direct-method model on the logging
+    // policy's observed completions, the second scores every strategy. agreementOut
+    // (optional) receives the pairwise agreement matrix, row-major.
+    vector<ReplayResult> run(const UserStore &users, const SessionLog &log, unsigned threads = 0,
+                             vector<double> *agreementOut = nullptr) const {
+        if (strategies.empty()) throw FitnessException("Replay needs at least one strategy");
+        size_t S = strategies.size(), P = plans.size(), n = users.size();
+        vector<uint32_t> start(n + 1, 0), order(log.size());
+        for (uint32_t u : log.user) {
+            if (u >= n) throw FitnessException("Session log refers to an unknown member");
+            ++start[u + 1];
+        }
+        for (size_t u = 0; u < n; ++u) start[u + 1] += start[u];
+        {
+            vector<uint32_t> fill(start.begin(), start.end() - 1);
+            for (size_t i = 0; i < log.size(); ++i) order[fill[log.user[i]]++] = (uint32_t)i;
+        }
+
+        // pass 1: observed completion per (cell, logged plan), and per cell how often
+        // the logged activity would have covered each plan (the fallback model)
+        vector<double> hits(kCells * P, 0.0), visits(kCells * P, 0.0), covered(kCells * P, 0.0), cellWeeks(kCells, 0.0);
+        mutex merge;
+        parallelFor(n, threads, [&](size_t lo, size_t hi) {
+            vector<double> h(kCells * P, 0.0), v(kCells * P, 0.0), cov(kCells * P, 0.0), cw(kCells, 0.0);
+            forEachMemberWeek(users, log, start, order, lo, hi, [&](const ReplayContext &c, const WeekActivity &w) {
+                size_t cell = cellOf(c);
+                cw[cell] += 1;
+                for (size_t a = 0; a < P; ++a) cov[cell * P + a] += completed((int)a, w);
+                int a = strategies[0].choose(c);
+                if (a < 0) return;
+                size_t slot = cell * P + (size_t)a;
+                h[slot] += completed(a, w);
+                v[slot] += 1;
+            });
+            lock_guard<mutex> lk(merge);
+            for (size_t i = 0; i < h.size(); ++i) { hits[i] += h[i]; visits[i] += v[i]; covered[i] += cov[i]; }
+            for (size_t i = 0; i < cw.size(); ++i) cellWeeks[i] += cw[i];
+        });
+
+        // pass 2: per-strategy sums
+        struct Sums {
+            uint64_t weeks = 0, recommended = 0, agree = 0;
+            double kcal = 0, dm = 0, ipsHits = 0, dr = 0;
+        };
+        vector<Sums> sums(S);
+        vector<uint64_t> pairAgree(S * S, 0);
+        parallelFor(n, threads, [&](size_t lo, size_t hi) {
+            vector<Sums> local(S);
+            vector<uint64_t> localPairs(S * S, 0);
+            vector<int> chosen(S);
+            forEachMemberWeek(users, log, start, order, lo, hi, [&](const ReplayContext &c, const WeekActivity &w) {
+                size_t cell = cellOf(c);
+                auto model = [&](int a) {
+                    size_t slot = cell * P + (size_t)a;
+                    return visits[slot] > 0 ? hits[slot] / visits[slot] : covered[slot] / cellWeeks[cell]; // cell seen in pass 1
+                };
+                for (size_t s = 0; s < S; ++s) chosen[s] = strategies[s].choose(c);
+                int logged = chosen[0];
+                double observed = logged >= 0 ? (double)completed(logged, w) : 0.0;
+                for (size_t s = 0; s < S; ++s) {
+                    Sums &x = local[s];
+                    int a = chosen[s];
+                    ++x.weeks;
+                    for (size_t t = 0; t < S; ++t) localPairs[s * S + t] += chosen[t] == a;
+                    if (a < 0) continue;
+                    ++x.recommended;
+                    x.kcal += plans[a].kcalPerKg * c.weightKg;
+                    double dm = model(a);
+                    x.dm += dm;
+                    x.dr += dm;
+                    if (a == logged) {
+                        ++x.agree;
+                        x.ipsHits += observed;
+                        x.dr += observed - model(logged);
+                    }
+                }
+            });
+            lock_guard<mutex> lk(merge);
+            for (size_t s = 0; s < S; ++s) {
+                sums[s].weeks += local[s].weeks; sums[s].recommended += local[s].recommended; sums[s].agree += local[s].agree;
+                sums[s].kcal += local[s].kcal; sums[s].dm += local[s].dm; sums[s].ipsHits += local[s].ipsHits; sums[s].dr += local[s].dr;
+            }
+            for (size_t i = 0; i < pairAgree.size(); ++i) pairAgree[i] += localPairs[i];
+        });
+
+        vector<ReplayResult> out(S);
+        for (size_t s = 0; s < S; ++s) {
+            const Sums &x = sums[s];
+            ReplayResult &r = out[s];
+            r.name = strategies[s].name;
+            r.weeks = x.weeks;
+            r.recommended = x.recommended;
+            double w = x.weeks ? (double)x.weeks : 1.0;
+            r.planKcal = x.recommended ? x.kcal / x.recommended : 0.0;
+            r.agreement = x.agree / w;
+            r.dm = x.dm / w;
+            r.ips = x.agree ? x.ipsHits / w : NAN; // no overlap with the logging policy
+            r.snips = x.agree ? x.ipsHits / x.agree : NAN;
+            r.dr = x.dr / w;
+        }
+        if (agreementOut) {
+            agreementOut->assign(S * S, 0.0);
+            for (size_t i = 0; i < S * S; ++i) (*agreementOut)[i] = sums[0].weeks ? (double)pairAgree[i] / sums[0].weeks : 0.0;
+        }
+        return out;
+    }
+
+    static void printReport(const vector<ReplayResult> &results, const vector<double> &agreement, ostream &os) {
+        os << left << setw(14) << "strategy" << right << setw(12) << "weeks" << setw(10) << "kcal/wk"
+           << setw(8) << "agree" << setw(8) << "DM" << setw(8) << "IPS" << setw(8) << "SNIPS" << setw(8) << "DR" << "\n";
+        auto estimate = [&os](double v) {
+            if (isnan(v)) os << setw(8) << "n/a";
+            else os << setw(8) << v;
+        };
+        for (const ReplayResult &r : results) {
+            os << left << setw(14) << r.name << right << setw(12) << r.weeks << fixed << setprecision(0) << setw(10) << r.planKcal
+               << setprecision(3) << setw(8) << r.agreement;
+            for (double v : {r.dm, r.ips, r.snips, r.dr}) estimate(v);
+            os << "\n";
+        }
+        size_t S = results.size();
+        if (agreement.size() != S * S) return;
+        os << "pairwise agreement:\n";
+        for (size_t s = 0; s < S; ++s) {
+            os << "  " << left << setw(12) << results[s].name << right;
+            for (size_t t = 0; t < S; ++t) os << setw(7) << setprecision(3) << agreement[s * S + t];
+            os << "\n";
+        }
+    }
+
+    size_t planCount() const { return plans.size(); }
+    size_t strategyCount() const { return strategies.size(); }
+};
+
+/* ---------------------------
+   AchievementEngine - compiled badge and streak rules
+   --------------------------- */
+// Rule format, one per line ('#' starts a comment):
+//   <name>: <count|kcal|minutes|streak> [cardio|strength|flexibility] [min <minutes>] per <day|week> >= <threshold>
+// e.g.  five-a-week: count per week >= 5
+//       big-burn: kcal per day >= 1000
+//       cardio-streak: streak cardio min 20 per day >= 7
+// count/kcal/minutes accumulate within a calendar day or week (UTC, weeks start Monday)
+// and award once in every window that reaches the threshold; streak counts consecutive
+// days or weeks with a matching session and awards once per unbroken run.
+struct AchievementAward {
+    uint32_t user;
+    uint32_t rule;
+    int64_t timestamp;
+};
+
+// Rules that differ only in threshold share one accumulator, and accumulators are
+// indexed by workout kind and minimum duration, so an event only touches the
+// accumulators whose filter it passes. Each (member, accumulator) pair is a small
+// state machine; thresholds are kept sorted so awarding is a single comparison.
+class AchievementEngine {
+public:
+    enum Metric : uint8_t { Count, Kcal, Minutes, Streak };
+    enum Window : uint8_t { Day, Week };
+
+private:
+    struct Accumulator {
+        Metric metric;
+        Window window;
+        int8_t kind; // -1 = any
+        uint16_t minMinutes;
+        vector<float> thresholds; // ascending
+        vector<uint32_t> rules;   // rule id per threshold
+    };
+    struct State {
+        int32_t bucket = INT32_MIN;
+        float value = 0.0f;
+        uint32_t level = 0; // thresholds already awarded
+    };
+
+    vector<string> names;
+    vector<Accumulator> accs;
+    vector<uint32_t> byKind[kWorkoutKinds]; // accumulator ids, ascending minMinutes
+    vector<State> state;                    // member-major: state[user * accs.size() + acc]
+    uint64_t late = 0;
+
+    static bool kindFromWord(const string &w, int8_t &k) {
+        if (w == "cardio") k = 0;
+        else if (w == "strength") k = 1;
+        else if (w == "flexibility") k = 2;
+        else return false;
+        return true;
+    }
+
+    void compile(const string &text) {
+        istringstream in(text);
+        string line;
+        size_t lineNo = 0;
+        map<tuple<int, int, int, int>, uint32_t> shared;
+        vector<vector<pair<float, uint32_t>>> levels;
+        while (getline(in, line)) {
+            ++lineNo;
+            size_t hash = line.find('#');
+            if (hash != string::npos) line.resize(hash);
+            size_t colon = line.find(':');
+            if (line.find_first_not_of(" \t\r") == string::npos) continue;
+            auto fail = [&](const string &why) {
+                throw FitnessException("Achievement rule line " + to_string(lineNo) + ": " + why);
+            };
+            if (colon == string::npos) fail("missing ':'");
+            string name = line.substr(0, colon);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            if (name.empty()) fail("missing rule name");
+
+            istringstream words(line.substr(colon + 1));
+            string w;
+            Metric metric;
+            words >> w;
+            if (w == "count") metric = Count;
+            else if (w == "kcal") metric = Kcal;
+            else if (w == "minutes") metric = Minutes;
+            else if (w == "streak") metric = Streak;
+            else fail("unknown metric '" + w + "'");
+            int8_t kind = -1;
+            long minMinutes = 0;
+            Window window = Day;
+            bool havePer = false;
+            double threshold = -1;
+            while (words >> w) {
+                if (kindFromWord(w, kind)) continue;
+                if (w == "min") {
+                    if (!(words >> minMinutes) || minMinutes < 0 || minMinutes > 1440) fail("bad minimum duration");
+                } else if (w == "per") {
+                    words >> w;
+                    if (w == "day") window = Day;
+                    else if (w == "week") window = Week;
+                    else fail("window must be day or week");
+                    havePer = true;
+                } else if (w == ">=") {
+                    if (!(words >> threshold) || threshold <= 0) fail("threshold must be positive");
+                } else {
+                    fail("unexpected '" + w + "'");
+                }
+            }
+            if (!havePer) fail("missing 'per day' or 'per week'");
+            if (threshold <= 0) fail("missing '>= <threshold>'");
+
+            auto key = make_tuple((int)metric, (int)window, (int)kind, (int)minMinutes);
+            auto it = shared.find(key);
+            if (it == shared.end()) {
+                it = shared.emplace(key, (uint32_t)accs.size()).first;
+                accs.push_back({metric, window, kind, (uint16_t)minMinutes, {}, {}});
+                levels.emplace_back();
+            }
+            levels[it->second].push_back({(float)threshold, (uint32_t)names.size()});
+            names.push_back(name);
+        }
+        for (size_t a = 0; a < accs.size(); ++a) {
+            sort(levels[a].begin(), levels[a].end());
+            for (const auto &l : levels[a]) { accs[a].thresholds.push_back(l.first); accs[a].rules.push_back(l.second); }
+            for (size_t k = 0; k < kWorkoutKinds; ++k)
+                if (accs[a].kind < 0 || accs[a].kind == (int8_t)k) byKind[k].push_back((uint32_t)a);
+        }
+        for (auto &list : byKind)
+            stable_sort(list.begin(), list.end(), [&](uint32_t x, uint32_t y) { return accs[x].minMinutes < accs[y].minMinutes; });
+    }
+
+    static int32_t bucketOf(Window w, int64_t ts) {
+        int64_t day = ts >= 0 ? ts / 86400 : (ts - 86399) / 86400;
+        return (int32_t)(w == Day ? day : (day + 3 >= 0 ? (day + 3) / 7 : (day + 3 - 6) / 7)); // 1970-01-01 was a Thursday
+    }
+
+    // one event against a member's state row (already sized)
+    void apply(uint32_t user, int64_t ts, WorkoutKind kind, uint16_t minutes, float kcal,
+               vector<AchievementAward> &out, uint64_t &lateCount) {
+        State *row = state.data() + (size_t)user * accs.size();
+        int32_t day = bucketOf(Day, ts), week = bucketOf(Week, ts);
+        for (uint32_t a : byKind[(size_t)kind]) {
+            const Accumulator &acc = accs[a];
+            if (acc.minMinutes > minutes) break;
+            State &s = row[a];
+            int32_t b = acc.window == Day ? day : week;
+            if (b < s.bucket) { ++lateCount; continue; } // window already closed
+            // a new window (or a broken streak) re-arms every threshold
+            if (acc.metric == Streak) {
+                if (b == s.bucket) continue;
+                if (s.bucket != INT32_MIN && b == s.bucket + 1) {
+                    s.value += 1;
+                } else {
+                    s.value = 1;
+                    s.level = 0;
+                }
+            } else {
+                if (b != s.bucket) {
+                    s.value = 0;
+                    s.level = 0;
+                }
+                s.value += acc.metric == Count ? 1.0f : acc.metric == Kcal ? kcal : (float)minutes;
+            }
+            s.bucket = b;
+            while (s.level < acc.thresholds.size() && s.value >= acc.thresholds[s.level])
+                out.push_back({user, acc.rules[s.level++], ts});
+        }
+    }
+
+    void ensureUsers(size_t count) {
+        if (count * accs.size() > state.size()) state.resize(count * accs.size());
+    }
+
+public:
+    explicit AchievementEngine(const string &rules) { compile(rules); }
+
+    static AchievementEngine fromFile(const string &path) {
+        ifstream in(path);
+        if (!in) throw FitnessException("Cannot open achievement rules: " + path);
+        stringstream ss;
+        ss << in.rdbuf();
+        return AchievementEngine(ss.str());
+    }
+
+    // Feeds one session; awards earned by it are appended to out. Returns the number added.
+    // Sessions must arrive in time order per member: one from a window the member has
+    // already moved past is counted in lateEvents() and ignored.
+    size_t onSession(uint32_t user, int64_t ts, WorkoutKind kind, uint16_t minutes, float kcal,
+                     vector<AchievementAward> &out) {
+        ensureUsers((size_t)user + 1);
+        size_t before = out.size();
+        apply(user, ts, kind, minutes, kcal, out, late);
+        return out.size() - before;
+    }
+
+    // Replays a session log, each member's sessions in time order whatever their order
+    // in the log. Members are sharded across threads (state rows never overlap), so each
+    // member's awards match a sequential run.
+    vector<AchievementAward> processLog(const SessionLog &log, unsigned threads = 0) {
+        uint32_t maxUser = 0;
+        for (uint32_t u : log.user) maxUser = max(maxUser, u);
+        if (log.size()) ensureUsers((size_t)maxUser + 1);
+        unsigned parts = workerCount(threads);
+        vector<vector<size_t>> shards = shardRowsByMember(log, parts);
+        vector<vector<AchievementAward>> partAwards(parts);
+        vector<uint64_t> partLate(parts, 0);
+        runParts(parts, [&](unsigned p) {
+            vector<size_t> &rows = shards[p];
+            auto byTime = [&](size_t a, size_t b) { return log.timestamp[a] < log.timestamp[b]; };
+            // logs are normally appended in time order; otherwise group by member, then time
+            if (!is_sorted(rows.begin(), rows.end(), byTime))
+                stable_sort(rows.begin(), rows.end(), [&](size_t a, size_t b) {
+                    return log.user[a] != log.user[b] ? log.user[a] < log.user[b] : byTime(a, b);
+                });
+            for (size_t i : rows)
+                apply(log.user[i], log.timestamp[i], log.kind[i], log.durationMin[i], log.calories[i], partAwards[p],
+                      partLate[p]);
+        });
+        late += accumulate(partLate.begin(), partLate.end(), (uint64_t)0);
+        vector<AchievementAward> all;
+        for (auto &p : partAwards) all.insert(all.end(), p.begin(), p.end());
+        stable_sort(all.begin(), all.end(), [](const AchievementAward &x, const AchievementAward &y) { return x.timestamp < y.timestamp; });
+        return all;
+    }
+
+    void reset() { state.clear(); late = 0; }
+
+    const string &ruleName(uint32_t rule) const { return names[rule]; }
+    size_t ruleCount() const { return names.size(); }
+    size_t accumulatorCount() const { return accs.size(); }
+    uint64_t lateEvents() const { return late; }
+    size_t stateBytes() const { return state.size() * sizeof(State); }
+};
+
+/* ---------------------------
+   MappedFile - read-only file view
+   --------------------------- */
+// mmap where available, otherwise the file is read into memory.
+class MappedFile {
+    const char *ptr = nullptr;
+    size_t len = 0;
+    bool mapped = false;
+    vector<char> fallback;
+public:
+    explicit MappedFile(const string &path) {
+#ifdef FITNESS_HAVE_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw FitnessException("Unable to open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *m = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED) {
+                ::madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+                ptr = static_cast<const char *>(m);
+                len = (size_t)st.st_size;
+                mapped = true;
+            }
+        }
+        ::close(fd);
+        if (mapped || (::stat(path.c_str(), &st) == 0 && st.st_size == 0)) return;
+#endif
+        ifstream ifs(path, ios::binary);
+        if (!ifs) throw FitnessException("Unable to open " + path);
+        fallback.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+        ptr = fallback.data();
+        len = fallback.size();
+    }
+    ~MappedFile() {
+#ifdef FITNESS_HAVE_MMAP
+        if (mapped) ::munmap(const_cast<char *>(ptr), len);
+#endif
+    }
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return ptr; }
+    size_t size() const { return len; }
+};
+
+/* ---------------------------
+   NUMA placement for population arrays
+   --------------------------- */
+// CPUs per memory node from sysfs; a machine without the node directory (or a
+// non-Linux host) is reported as one node holding every CPU.
+struct NumaTopology {
+    vector<int> nodeIds;
+    vector<vector<int>> nodeCpus;
+    bool fromSysfs = false;
+
+    static vector<int> parseCpuList(const string &text) {
+        vector<int> cpus;
+        stringstream ss(text);
+        string range;
+        while (getline(ss, range, ',')) {
+            if (range.find_first_not_of(" \n") == string::npos) continue;
+            int lo = 0, hi = 0;
+            size_t dash = range.find('-');
+            try {
+                lo = stoi(range.substr(0, dash));
+                hi = dash == string::npos ? lo : stoi(range.substr(dash + 1));
+            } catch (...) { continue; }
+            for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+        }
+        return cpus;
+    }
+
+    static NumaTopology detect() {
+        NumaTopology t;
+        ifstream online("/sys/devices/system/node/online");
+        string line;
+        if (online && getline(online, line)) {
+            for (int node : parseCpuList(line)) { // same list syntax as cpulist
+                ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+                string cpuLine;
+                if (!in || !getline(in, cpuLine)) continue;
+                vector<int> cpus = parseCpuList(cpuLine);
+                if (cpus.empty()) continue; // memory-only node
+                t.nodeIds.push_back(node);
+                t.nodeCpus.push_back(cpus);
+            }
+        }
+        t.fromSysfs = !t.nodeCpus.empty();
+        if (!t.fromSysfs) {
+            vector<int> all(max(1u, thread::hardware_concurrency()));
+            iota(all.begin(), all.end(), 0);
+            t.nodeIds.assign(1, 0);
+            t.nodeCpus.assign(1, all);
+        }
+        return t;
+    }
+
+    size_t nodes() const { return nodeCpus.size(); }
+};
+
+// Restricts the calling thread to the given CPUs; false where affinity is unsupported.
+inline bool pinCurrentThread(const vector<int> &cpus) {
+#ifdef FITNESS_HAVE_AFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c : cpus)
+        if (c >= 0 && c < CPU_SETSIZE) CPU_SET(c, &set);
+    return sched_setaffinity(0, sizeof set, &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// Transparent huge page mode from sysfs ("always", "madvise", "never" or "unavailable").
+inline string transparentHugePageMode() {
+    ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+    string line;
+    if (!in || !getline(in, line)) return "unavailable";
+    size_t open = line.find('['), close = line.find(']');
+    return open == string::npos || close == string::npos ? line : line.substr(open + 1, close - open - 1);
+}
+
+// Uninitialized array for large population columns. Memory comes from an anonymous
+// mapping (explicit huge pages if the system has a pool, otherwise 2 MiB-aligned with
+// MADV_HUGEPAGE), so pages land on the node of the thread that first writes them.
+template <typename T>
+class HugePageArray {
+    static_assert(is_trivially_copyable<T>::value, "population columns hold plain values");
+    static const size_t kHugePage = size_t(2) << 20;
+    T *ptr = nullptr;
+    size_t n = 0, bytes = 0;
+    bool mapped = false, explicitHuge = false;
+
+public:
+    HugePageArray() {}
+    explicit HugePageArray(size_t count): n(count) {
+        if (count == 0) return;
+        bytes = (count * sizeof(T) + kHugePage - 1) / kHugePage * kHugePage;
+#ifdef FITNESS_HAVE_MMAP
+#ifdef MAP_HUGETLB
+        void *m = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (m != MAP_FAILED) { ptr = static_cast<T *>(m); mapped = explicitHuge = true; return; }
+#endif
+        // over-allocate to place the array on a huge-page boundary
+        void *raw = ::mmap(nullptr, bytes + kHugePage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw != MAP_FAILED) {
+            uintptr_t base = reinterpret_cast<uintptr_t>(raw), aligned = (base + kHugePage - 1) & ~(uintptr_t)(kHugePage - 1);
+            if (aligned > base) ::munmap(raw, aligned - base);
+            size_t tail = base + bytes + kHugePage - (aligned + bytes);
+            if (tail) ::munmap(reinterpret_cast<void *>(aligned + bytes), tail);
+#ifdef MADV_HUGEPAGE
+            ::madvise(reinterpret_cast<void *>(aligned), bytes, MADV_HUGEPAGE);
+#endif
+            ptr = reinterpret_cast<T *>(aligned);
+            mapped = true;
+            return;
+        }
+#endif
+        ptr = static_cast<T *>(::operator new(count * sizeof(T)));
+    }
+    ~HugePageArray() {
+#ifdef FITNESS_HAVE_MMAP
+        if (mapped) { ::munmap(ptr, bytes); return; }
+#endif
+        ::operator delete(ptr);
+    }
+    HugePageArray(const HugePageArray &) = delete;
+    HugePageArray &operator=(const HugePageArray &) = delete;
+    HugePageArray(HugePageArray &&o) noexcept { swap(o); }
+    HugePageArray &operator=(HugePageArray &&o) noexcept { HugePageArray tmp(std::move(o)); swap(tmp); return *this; }
+    void swap(HugePageArray &o) noexcept {
+        std::swap(ptr, o.ptr); std::swap(n, o.n); std::swap(bytes, o.bytes);
+        std::swap(mapped, o.mapped); std::swap(explicitHuge, o.explicitHuge);
+    }
+
+    T *data() { return ptr; }
+    const T *data() const { return ptr; }
+    T &operator[](size_t i) { return ptr[i]; }
+    const T &operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return n; }
+    bool usesExplicitHugePages() const { return explicitHuge; }
+};
+
+// Scoring copy of the population split into one contiguous member range per node.
+// In NUMA mode each range is first touched and later scored by workers pinned to its
+// node; otherwise the loading thread touches everything and workers float.
+class NumaPopulation {
+public:
+    struct NodeStats {
+        int node; // sysfs node id, -1 when not partitioned
+        size_t members;
+        double seconds;
+        double gbPerSecond;
+    };
+
+private:
+    struct Partition {
+        int node; // index into the topology, -1 when not partitioned
+        size_t begin = 0, end = 0;
+        HugePageArray<float> weightKg;
+        HugePageArray<uint8_t> goal;
+        HugePageArray<float> score;
+    };
+
+    NumaTopology topo;
+    bool numaAware;
+    vector<Partition> parts;
+
+    // runs fn(partition, lo, hi) on every partition, workersPerNode threads each
+    // (default: one per CPU of the partition's node, or of the machine when unpartitioned)
+    template <typename Fn>
+    void onPartitions(unsigned workersPerNode, Fn fn) {
+        size_t allCpus = 0;
+        for (const vector<int> &cpus : topo.nodeCpus) allCpus += cpus.size();
+        vector<thread> pool;
+        for (Partition &p : parts) {
+            size_t cpuCount = p.node < 0 ? allCpus : topo.nodeCpus[p.node].size();
+            unsigned w = workersPerNode ? workersPerNode : (unsigned)max<size_t>(1, cpuCount);
+            size_t len = p.end - p.begin;
+            for (unsigned k = 0; k < w; ++k)
+                pool.emplace_back([&, k, w, len]() {
+                    if (p.node >= 0) pinCurrentThread(topo.nodeCpus[p.node]);
+                    fn(p, len * k / w, len * (k + 1) / w);
+                });
+        }
+        for (thread &t : pool) t.join();
+    }
+
+public:
+    NumaPopulation(const UserStore &users, const NumaTopology &topology, bool numa, unsigned workersPerNode = 0)
+        : topo(topology), numaAware(numa && topology.nodes() > 1) {
+        size_t n = users.size();
+        size_t nodeCount = numaAware ? topo.nodes() : 1;
+        const ProfileColumns &prof = users.columns();
+        vector<GoalKind> goalOfId = users.goalKinds();
+        for (size_t i = 0; i < nodeCount; ++i) {
+            parts.emplace_back();
+            Partition &p = parts.back();
+            p.node = numaAware ? (int)i : -1;
+            p.begin = n * i / nodeCount;
+            p.end = n * (i + 1) / nodeCount;
+            p.weightKg = HugePageArray<float>(p.end - p.begin);
+            p.goal = HugePageArray<uint8_t>(p.end - p.begin);
+            p.score = HugePageArray<float>(p.end - p.begin);
+        }
+        auto load = [&](Partition &p, size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; ++i) {
+                size_t u = p.begin + i;
+                p.weightKg[i] = (float)prof.weightKg[u];
+                p.goal[i] = (uint8_t)goalOfId[users.goalId(u)];
+                p.score[i] = 0.0f;
+            }
+        };
+        if (numaAware) onPartitions(workersPerNode, load); // first touch on the owning node
+        else for (Partition &p : parts) load(p, 0, p.end - p.begin);
+    }
+
+    // Weekly plan calories for every member (kcal/kg of the goal's plan times weight).
+    // Returns per-node timing; bandwidth counts the bytes read and written.
+    vector<NodeStats> score(const array<float, 3> &kcalPerKgByGoal, unsigned workersPerNode = 0) {
+        vector<double> seconds(parts.size(), 0.0);
+        mutex m;
+        onPartitions(workersPerNode, [&](Partition &p, size_t lo, size_t hi) {
+            auto t0 = chrono::steady_clock::now();
+            const float *w = p.weightKg.data();
+            const uint8_t *g = p.goal.data();
+            float *out = p.score.data();
+            for (size_t i = lo; i < hi; ++i) out[i] = kcalPerKgByGoal[g[i] < 3 ? g[i] : 2] * w[i];
+            double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            lock_guard<mutex> lk(m);
+            size_t idx = (size_t)(&p - parts.data());
+            seconds[idx] = max(seconds[idx], s);
+        });
+        vector<NodeStats> stats;
+        for (size_t i = 0; i < parts.size(); ++i) {
+            size_t members = parts[i].end - parts[i].begin;
+            double bytes = (double)members * (sizeof(float) * 2 + 1);
+            stats.push_back({parts[i].node < 0 ? -1 : topo.nodeIds[parts[i].node], members, seconds[i], seconds[i] > 0 ? bytes / seconds[i] / 1e9 : 0.0});
+        }
+        return stats;
+    }
+
+    float scoreOf(size_t member) const {
+        for (const Partition &p : parts)
+            if (member >= p.begin && member < p.end) return p.score[member - p.begin];
+        throw FitnessException("Member index out of range");
+    }
+    bool isNumaAware() const { return numaAware; }
+    size_t partitionCount() const { return parts.size(); }
+    bool usesExplicitHugePages() const { return !parts.empty() && parts[0].weightKg.usesExplicitHugePages(); }
+};
+
+/* ---------------------------
+   CSV scanning (SIMD structural search)
+   --------------------------- */
+struct CsvField { const char *b; const char *e; };
+
+// Bitmasks of quote / delimiter / newline bytes in a block of up to 16 bytes.
+inline void csvClassify(const char *p, size_t n, char delim, uint32_t &q, uint32_t &d, uint32_t &nl) {
+#if defined(__SSE2__)
+    if (n == 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        q = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+        d = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(delim)));
+        nl = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        return;
+    }
+#endif
+    q = d = nl = 0;
+    for (size_t i = 0; i < n; ++i) {
+        q |= uint32_t(p[i] == '"') << i;
+        d |= uint32_t(p[i] == delim) << i;
+        nl |= uint32_t(p[i] == '\n') << i;
+    }
+}
+
+// bit i = number of quotes at positions <= i is odd (i.e. byte i is inside quotes)
+inline uint32_t csvPrefixXor(uint32_t x) {
+    x ^= x << 1; x ^= x << 2; x ^= x << 4; x ^= x << 8;
+    return x & 0xFFFFu;
+}
+
+inline size_t csvCountQuotes(const char *p, const char *e) {
+    size_t n = 0;
+    uint32_t q, d, nl;
+    for (; p + 16 <= e; p += 16) { csvClassify(p, 16, '"', q, d, nl); n += __builtin_popcount(q); }
+    for (; p < e; ++p) n += (*p == '"');
+    return n;
+}
+
+// Calls onRow(fields, recordStart) for every record starting in [start, ownEnd).
+// `start` must be a record boundary; records may run past ownEnd up to fileEnd.
+template <typename RowFn>
+void csvScanRecords(const char *start, const char *ownEnd, const char *fileEnd, char delim,
+                    vector<CsvField> &fields, RowFn &&onRow) {
+    const char *recordStart = start, *fieldStart = start, *p = start;
+    bool inQuote = false;
+    fields.clear();
+    if (start >= ownEnd) return;
+    while (p < fileEnd) {
+        size_t n = min<size_t>(16, (size_t)(fileEnd - p));
+        uint32_t q, d, nl;
+        csvClassify(p, n, delim, q, d, nl);
+        uint32_t inside = csvPrefixXor(q) ^ (inQuote ? 0xFFFFu : 0u);
+        if (__builtin_popcount(q) & 1) inQuote = !inQuote;
+        uint32_t structural = (d | nl) & ~inside;
+        while (structural) {
+            int i = __builtin_ctz(structural);
+            const char *c = p + i;
+            fields.push_back({fieldStart, c});
+            fieldStart = c + 1;
+            if ((nl >> i) & 1u) {
+                onRow(fields, recordStart);
+                fields.clear();
+                recordStart = fieldStart;
+                if (recordStart >= ownEnd) return;
+            }
+            structural &= structural - 1;
+        }
+        p += n;
+    }
+    if (recordStart < fileEnd) { // last record without trailing newline
+        fields.push_back({fieldStart, fileEnd});
+        onRow(fields, recordStart);
+    }
+}
+
+// field text without surrounding whitespace / CR and without quotes ("" unescaped into scratch)
+inline string_view csvText(CsvField f, string &scratch) {
+    while (f.b < f.e && (*f.b == ' ' || *f.b == '\t')) ++f.b;
+    while (f.e > f.b && (f.e[-1] == ' ' || f.e[-1] == '\r' || f.e[-1] == '\t')) --f.e;
+    if (f.e - f.b < 2 || *f.b != '"' || f.e[-1] != '"') return string_view(f.b, (size_t)(f.e - f.b));
+    ++f.b; --f.e;
+    if (find(f.b, f.e, '"') == f.e) return string_view(f.b, (size_t)(f.e - f.b));
+    scratch.clear();
+    for (const char *c = f.b; c < f.e; ++c) {
+        scratch.push_back(*c);
+        if (*c == '"' && c + 1 < f.e && c[1] == '"') ++c;
+    }
+    return scratch;
+}
+
+template <typename T>
+bool csvNumber(CsvField f, T &out) {
+    while (f.b < f.e && *f.b == ' ') ++f.b;
+    while (f.e > f.b && (f.e[-1] == ' ' || f.e[-1] == '\r')) --f.e;
+    if (f.b == f.e) return false;
+    from_chars_result r = from_chars(f.b, f.e, out);
+    return r.ec == errc() && r.ptr == f.e;
+}
+
+/* ---------------------------
+   StagedPipeline - worker stages joined by bounded lock-free queues
+   --------------------------- */
+inline void cpuRelax() {
+#if defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+// Spin briefly, then yield, then sleep: waiting stages stay cheap on oversubscribed cores.
+struct SpinBackoff {
+    unsigned rounds = 0;
+    void pause() {
+        ++rounds;
+        if (rounds < 64) cpuRelax();
+        else if (rounds < 1024) this_thread::yield();
+        else this_thread::sleep_for(chrono::microseconds(50));
+    }
+};
+
+// Bounded multi-producer/multi-consumer ring (Vyukov): every slot carries a sequence
+// number, so push and pop each cost one CAS and never take a lock. T should be cheap
+// to copy (the pipeline passes batch pointers).
+template <typename T>
+class BoundedMpmcQueue {
+    struct alignas(64) Cell {
+        atomic<size_t> seq;
+        T value;
+    };
+    unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> tail{0};
+    alignas(64) atomic<size_t> head{0};
+
+public:
+    explicit BoundedMpmcQueue(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) n <<= 1;
+        cells.reset(new Cell[n]);
+        mask = n - 1;
+        for (size_t i = 0; i < n; ++i) cells[i].seq.store(i, memory_order_relaxed);
+    }
+    BoundedMpmcQueue(const BoundedMpmcQueue &) = delete;
+    BoundedMpmcQueue &operator=(const BoundedMpmcQueue &) = delete;
+
+    // false when full
+    bool tryPush(const T &v) {
+        size_t pos = tail.load(memory_order_relaxed);
+        for (;;) {
+            Cell &c = cells[pos & mask];
+            intptr_t dif = (intptr_t)c.seq.load(memory_order_acquire) - (intptr_t)pos;
+            if (dif == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    c.value = v;
+                    c.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+    // false when empty
+    bool tryPop(T &out) {
+        size_t pos = head.load(memory_order_relaxed);
+        for (;;) {
+            Cell &c = cells[pos & mask];
+            intptr_t dif = (intptr_t)c.seq.load(memory_order_acquire) - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    out = c.value;
+                    c.seq.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t capacity() const { return mask + 1; }
+    // approximate under concurrent use
+    size_t depth() const {
+        size_t t = tail.load(memory_order_relaxed), h = head.load(memory_order_relaxed);
+        return t > h ? t - h : 0;
+    }
+};
+
+struct PipelineStageStats {
+    string name;
+    unsigned threads = 0;
+    uint64_t batches = 0;
+    uint64_t items = 0;
+    double busySeconds = 0.0;    // summed over the stage's threads
+    double stalledSeconds = 0.0; // waiting for room downstream (backpressure)
+    double starvedSeconds = 0.0; // waiting for input
+    size_t inputCapacity = 0;
+    size_t maxInputDepth = 0;
+    double meanInputDepth = 0.0; // sampled at every pop
+
+    // throughput of one thread of this stage while it was working
+    double itemsPerBusySecond() const { return busySeconds > 0 ? items / busySeconds : 0.0; }
+};
+
+// Runs a chain of stages, each on its own threads. Batches flow from the source through
+// a bounded queue in front of every stage; a full queue blocks its producers, so a slow
+// stage throttles everything upstream instead of buffering without limit. Finished
+// batches are recycled to the source. Batch needs size() (items, for the stats); the
+// source must reset recycled batches. The first exception thrown by a stage stops the
+// source, later batches pass through without running their stages, and run() rethrows it.
+template <typename Batch>
+class StagedPipeline {
+    struct Stage {
+        string name;
+        unsigned threads;
+        function<void(Batch &)> fn;
+    };
+    struct Channel {
+        unique_ptr<BoundedMpmcQueue<Batch *>> queue;
+        atomic<unsigned> producersLeft{0};
+        atomic<bool> closed{false};
+    };
+    vector<Stage> stages;
+    size_t capacity;
+    atomic<bool> failedFlag{false};
+    exception_ptr firstError;
+    mutex errorLock;
+
+public:
+    explicit StagedPipeline(size_t queueCapacity = 16): capacity(max<size_t>(2, queueCapacity)) {}
+
+    // true once a stage has thrown; a source waiting on downstream progress should give up
+    bool failed() const { return failedFlag.load(memory_order_acquire); }
+
+    StagedPipeline &addStage(string name, unsigned threads, function<void(Batch &)> fn) {
+        stages.push_back({std::move(name), max(1u, threads), std::move(fn)});
+        return *this;
+    }
+
+    // source(batch) fills a batch and returns false once exhausted; it runs on the
+    // calling thread. Returns the stats of the source followed by each stage.
+    vector<PipelineStageStats> run(const function<bool(Batch &)> &source) {
+        size_t n = stages.size();
+        if (n == 0) throw FitnessException("Pipeline has no stages");
+        failedFlag.store(false, memory_order_relaxed);
+        firstError = nullptr;
+        size_t inFlight = 1;
+        vector<Channel> channels(n);
+        for (size_t i = 0; i < n; ++i) {
+            channels[i].queue = make_unique<BoundedMpmcQueue<Batch *>>(capacity);
+            channels[i].producersLeft.store(i == 0 ? 1 : stages[i - 1].threads, memory_order_relaxed);
+            inFlight += channels[i].queue->capacity() + stages[i].threads;
+        }
+        BoundedMpmcQueue<Batch *> recycled(inFlight); // can hold every batch ever allocated
+
+        vector<PipelineStageStats> stats(n + 1);
+        stats[0].name = "source";
+        stats[0].threads = 1;
+        for (size_t i = 0; i < n; ++i) {
+            stats[i + 1].name = stages[i].name;
+            stats[i + 1].threads = stages[i].threads;
+            stats[i + 1].inputCapacity = channels[i].queue->capacity();
+        }
+        mutex statsLock;
+        vector<uint64_t> depthSamples(n + 1, 0), depthSum(n + 1, 0);
+
+        auto push = [&](size_t ch, Batch *b, PipelineStageStats &st) {
+            if (channels[ch].queue->tryPush(b)) return;
+            auto t0 = chrono::steady_clock::now();
+            SpinBackoff backoff;
+            while (!channels[ch].queue->tryPush(b)) backoff.pause();
+            st.stalledSeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        };
+        auto closeOne = [&](size_t ch) {
+            if (ch < n && channels[ch].producersLeft.fetch_sub(1, memory_order_acq_rel) == 1)
+                channels[ch].closed.store(true, memory_order_release);
+        };
+
+        vector<thread> workers;
+        for (size_t s = 0; s < n; ++s)
+            for (unsigned t = 0; t < stages[s].threads; ++t)
+                workers.emplace_back([&, s] {
+                    PipelineStageStats st;
+                    uint64_t samples = 0, sum = 0;
+                    BoundedMpmcQueue<Batch *> &in = *channels[s].queue;
+                    Batch *b = nullptr;
+                    for (;;) {
+                        size_t depth = in.depth();
+                        ++samples;
+                        sum += depth;
+                        st.maxInputDepth = max(st.maxInputDepth, depth);
+                        if (!in.tryPop(b)) {
+                            auto t0 = chrono::steady_clock::now();
+                            SpinBackoff backoff;
+                            bool got = false;
+                            for (;;) {
+                                if (in.tryPop(b)) { got = true; break; }
+                                if (channels[s].closed.load(memory_order_acquire)) {
+                                    got = in.tryPop(b);
+                                    break;
+                                }
+                                backoff.pause();
+                            }
+                            st.starvedSeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                            if (!got) break;
+                        }
+                        auto t0 = chrono::steady_clock::now();
+                        if (!failed()) {
+                            try {
+                                stages[s].fn(*b);
+                            } catch (...) {
+                                lock_guard<mutex> lk(errorLock);
+                                if (!firstError) firstError = current_exception();
+                                failedFlag.store(true, memory_order_release);
+                            }
+                        }
+                        st.busySeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                        ++st.batches;
+                        st.items += b->size();
+                        if (s + 1 < n) push(s + 1, b, st);
+                        else recycled.tryPush(b); // sized for every batch, never full
+                    }
+                    closeOne(s + 1);
+                    lock_guard<mutex> lk(statsLock);
+                    PipelineStageStats &agg = stats[s + 1];
+                    agg.batches += st.batches;
+                    agg.items += st.items;
+                    agg.busySeconds += st.busySeconds;
+                    agg.stalledSeconds += st.stalledSeconds;
+                    agg.starvedSeconds += st.starvedSeconds;
+                    agg.maxInputDepth = max(agg.maxInputDepth, st.maxInputDepth);
+                    depthSamples[s + 1] += samples;
+                    depthSum[s + 1] += sum;
+                });
+
+        vector<unique_ptr<Batch>> owned;
+        PipelineStageStats &src = stats[0];
+        try {
+            while (!failed()) {
+                Batch *b = nullptr;
+                if (!recycled.tryPop(b)) {
+                    owned.push_back(make_unique<Batch>());
+                    b = owned.back().get();
+                }
+                auto t0 = chrono::steady_clock::now();
+                bool more = source(*b);
+                src.busySeconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+                if (!more) break;
+                ++src.batches;
+                src.items += b->size();
+                push(0, b, src);
+            }
+        } catch (...) {
+            closeOne(0);
+            for (thread &w : workers) w.join();
+            throw;
+        }
+        closeOne(0);
+        for (thread &w : workers) w.join();
+        if (firstError) rethrow_exception(firstError);
+        for (size_t i = 1; i <= n; ++i)
+            stats[i].meanInputDepth = depthSamples[i] ? (double)depthSum[i] / depthSamples[i] : 0.0;
+        return stats;
+    }
+};
+
+inline void printPipelineStats(ostream &os, const vector<PipelineStageStats> &stats, double wallSeconds) {
+    os << left << setw(10) << "stage" << right << setw(4) << "thr" << setw(10) << "batches" << setw(12) << "items/s"
+       << setw(9) << "busy%" << setw(9) << "stall%" << setw(9) << "starve%" << setw(12) << "depth avg" << setw(6)
+       << "max" << "\n";
+    for (const PipelineStageStats &s : stats) {
+        double threadSeconds = wallSeconds * s.threads;
+        auto pct = [&](double x) { return threadSeconds > 0 ? 100.0 * x / threadSeconds : 0.0; };
+        os << left << setw(10) << s.name << right << setw(4) << s.threads << setw(10) << s.batches << setw(12) << fixed
+           << setprecision(0);
+        if (s.items && wallSeconds > 0) os << s.items / wallSeconds;
+        else os << "-";
+        os << setw(9) << setprecision(1)
+           << pct(s.busySeconds) << setw(9) << pct(s.stalledSeconds) << setw(9) << pct(s.starvedSeconds);
+        if (s.inputCapacity)
+            os << setw(12) << setprecision(1) << s.meanInputDepth << setw(6) << s.maxInputDepth << "/" << s.inputCapacity;
+        os << "\n";
+    }
+}
+
+/* ---------------------------
+   PriorityScheduler - interactive requests ahead of batch jobs
+   --------------------------- */
+enum class WorkClass : uint8_t { Interactive = 0, Batch = 1 };
+
+struct WorkClassStats {
+    uint64_t tasks = 0;       // task runs (a batch job counts once per chunk)
+    double runSeconds = 0.0;  // time spent inside tasks
+    unsigned share = 0;
+};
+
+// Worker pool with one queue per class. Workers never interrupt a running task; at every
+// task boundary they pick the non-empty class that has used the least CPU time relative
+// to its share (like a fair-share run queue), so with the default 90/10 split a waiting
+// request runs after at most one batch chunk, while batch work is never starved. Batch
+// jobs are cooperative: a step runs one chunk and returns whether more is left, and is
+// requeued behind whatever arrived meanwhile. Tasks must not throw; submit() and
+// forEachChunk() route exceptions into their futures.
+class PriorityScheduler {
+    struct ClassQueue {
+        deque<function<bool()>> tasks;
+        unsigned share = 1;
+        double virtualTime = 0.0; // runSeconds / share
+        WorkClassStats stats;
+    };
+
+    array<ClassQueue, 2> classes;
+    mutex m;
+    condition_variable wake, idle;
+    size_t running = 0;
+    bool stopping = false;
+    vector<thread> workers;
+
+    // a class that was idle starts level with the busiest-served one, so it cannot
+    // bank CPU time while it had nothing to run
+    void enqueue(WorkClass c, function<bool()> step) {
+        {
+            lock_guard<mutex> lk(m);
+            ClassQueue &q = classes[(size_t)c];
+            if (q.tasks.empty())
+                for (const ClassQueue &o : classes)
+                    if (&o != &q && !o.tasks.empty()) q.virtualTime = max(q.virtualTime, o.virtualTime);
+            q.tasks.push_back(std::move(step));
+        }
+        wake.notify_one();
+    }
+
+    ClassQueue *pick() {
+        ClassQueue *best = nullptr;
+        for (ClassQueue &q : classes)
+            if (!q.tasks.empty() && (!best || q.virtualTime < best->virtualTime)) best = &q;
+        return best;
+    }
+
+    void workerLoop() {
+        unique_lock<mutex> lk(m);
+        for (;;) {
+            ClassQueue *q = nullptr;
+            wake.wait(lk, [&] { return (q = pick()) != nullptr || stopping; });
+            if (!q) return;
+            function<bool()> step = std::move(q->tasks.front());
+            q->tasks.pop_front();
+            ++running;
+            lk.unlock();
+            auto t0 = chrono::steady_clock::now();
+            bool more = step();
+            double s = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+            lk.lock();
+            --running;
+            q->stats.tasks++;
+            q->stats.runSeconds += s;
+            q->virtualTime += s / q->share;
+            if (more) q->tasks.push_back(std::move(step));
+            if (running == 0 && !pick()) idle.notify_all();
+        }
+    }
+
+public:
+    explicit PriorityScheduler(unsigned threads = 0, unsigned interactiveShare = 90, unsigned batchShare = 10) {
+        classes[(size_t)WorkClass::Interactive].share = max(1u, interactiveShare);
+        classes[(size_t)WorkClass::Batch].share = max(1u, batchShare);
+        unsigned n = workerCount(threads);
+        for (unsigned i = 0; i < n; ++i) workers.emplace_back([this] { workerLoop(); });
+    }
+    // drains queued work, including unfinished batch jobs
+    ~PriorityScheduler() {
+        {
+            lock_guard<mutex> lk(m);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (thread &t : workers) t.join();
+    }
+    PriorityScheduler(const PriorityScheduler &) = delete;
+    PriorityScheduler &operator=(const PriorityScheduler &) = delete;
+
+    void setShare(WorkClass c, unsigned share) {
+        lock_guard<mutex> lk(m);
+        classes[(size_t)c].share = max(1u, share);
+    }
+
+    // one task; the result (or exception) arrives through the future
+    template <typename Fn>
+    future<invoke_result_t<Fn>> submit(WorkClass c, Fn fn) {
+        auto task = make_shared<packaged_task<invoke_result_t<Fn>()>>(std::move(fn));
+        future<invoke_result_t<Fn>> result = task->get_future();
+        enqueue(c, [task] {
+            (*task)();
+            return false;
+        });
+        return result;
+    }
+
+    // Cooperative batch job over [0, n): fn(lo, hi) per chunk of at most `chunk` items,
+    // spread over up to `parallel` workers (0 = all). Other work runs between chunks.
+    future<void> forEachChunk(size_t n, size_t chunk, function<void(size_t, size_t)> fn, unsigned parallel = 0) {
+        struct Job {
+            atomic<size_t> next{0};
+            atomic<unsigned> live{0};
+            size_t n, chunk;
+            function<void(size_t, size_t)> fn;
+            promise<void> done;
+            mutex errorLock;
+            exception_ptr error;
+        };
+        auto job = make_shared<Job>();
+        job->n = n;
+        job->chunk = max<size_t>(1, chunk);
+        job->fn = std::move(fn);
+        future<void> result = job->done.get_future();
+        size_t chunks = (n + job->chunk - 1) / job->chunk;
+        unsigned steps = (unsigned)min<size_t>(parallel ? parallel : workers.size(), max<size_t>(1, chunks));
+        job->live.store(steps, memory_order_relaxed);
+        for (unsigned i = 0; i < steps; ++i)
+            enqueue(WorkClass::Batch, [job] {
+                size_t lo = job->next.fetch_add(job->chunk, memory_order_relaxed);
+                if (lo < job->n) {
+                    try {
+                        job->fn(lo, min(job->n, lo + job->chunk));
+                    } catch (...) {
+                        lock_guard<mutex> lk(job->errorLock);
+                        if (!job->error) job->error = current_exception();
+                        job->next.store(job->n, memory_order_relaxed); // abandon the rest
+                    }
+                    if (lo + job->chunk < job->n) return true;
+                }
+                if (job->live.fetch_sub(1, memory_order_acq_rel) == 1) {
+                    if (job->error) job->done.set_exception(job->error);
+                    else job->done.set_value();
+                }
+                return false;
+            });
+        return result;
+    }
+
+    // blocks until every queue is empty and no task is running
+    void waitIdle() {
+        unique_lock<mutex> lk(m);
+        idle.wait(lk, [&] { return running == 0 && !pick(); });
+    }
+
+    WorkClassStats stats(WorkClass c) {
+        lock_guard<mutex> lk(m);
+        WorkClassStats s = classes[(size_t)c].stats;
+        s.share = classes[(size_t)c].share;
+        return s;
+    }
+    size_t threadCount() const { return workers.size(); }
+};
+
+/* ---------------------------
+   BulkImporter - CSV/TSV profile and session import
+   --------------------------- */
+struct ImportError {
+    size_t record;     // 1-based data record (header excluded)
+    size_t byteOffset; // where the record starts in the file
+    const char *reason;
+};
+
+struct ImportReport {
+    size_t records = 0;
+    size_t imported = 0;
+    size_t bytes = 0;
+    double seconds = 0.0;
+    vector<ImportError> errors;
+
+    double megabytesPerSecond() const { return seconds > 0 ? bytes / 1e6 / seconds : 0.0; }
+    void summarize(ostream &os, size_t maxErrors = 10) const {
+        os << "Imported " << imported << " of " << records << " records (" << errors.size() << " rejected), "
+           << fixed << setprecision(1) << bytes / 1e6 << " MB in " << setprecision(3) << seconds
+           << " s = " << setprecision(1) << megabytesPerSecond() << " MB/s\n";
+        for (size_t i = 0; i < errors.size() && i < maxErrors; ++i)
+            os << "  record " << errors[i].record << " (byte " << errors[i].byteOffset << "): "
+               << errors[i].reason << "\n";
+        if (errors.size() > maxErrors) os << "  ... " << errors.size() - maxErrors << " more\n";
+    }
+};
+
+// Threads per stage of BulkImporter::importSessionsStaged; 0 picks a share of the
+// importer's threads.
+struct StagedImportOptions {
+    unsigned parseThreads = 0;
+    unsigned validateThreads = 1;
+    unsigned enrichThreads = 0;
+    unsigned estimateThreads = 1;
+    size_t chunkBytes = 256 << 10;
+    size_t queueCapacity = 16;
+    size_t reorderWindow = 64; // batches the source may run ahead of the oldest one not yet logged
+};
+
+// Profiles:  member_id,name,age,weight_kg,height_cm,gender,goal
+// Sessions:  member_id,timestamp,workout,kind,duration_min,intensity,avg_hr,calories
+// The first line is a header; tab-separated files are detected from it.
+// avg_hr and calories may be empty (calories are then estimated from the profile).
+class BulkImporter {
+    unsigned threads;
+    static const size_t kMinChunkBytes = 1 << 20;
+
+    struct Chunked {
+        const char *body = nullptr, *end = nullptr;
+        char delim = ',';
+        vector<const char *> bounds; // chunk i owns records starting in [bounds[i], bounds[i+1])
+        vector<const char *> starts; // first record boundary of each chunk
+    };
+
+    // Splits the file body into chunks aligned to record boundaries: one per thread, or
+    // about chunkBytes each when given.
+    Chunked split(const MappedFile &file, size_t chunkBytes = 0) const {
+        Chunked c;
+        const char *data = file.data(), *end = data + file.size();
+        const char *nl = find(data, end, '\n');
+        size_t tabs = (size_t)count(data, nl, '\t'), commas = (size_t)count(data, nl, ',');
+        c.delim = tabs > commas ? '\t' : ',';
+        c.body = nl == end ? end : nl + 1;
+        c.end = end;
+        size_t len = (size_t)(end - c.body);
+        unsigned parts = chunkBytes ? (unsigned)max<size_t>(1, len / chunkBytes)
+                                    : (unsigned)max<size_t>(1, min<size_t>(workerCount(threads), len / kMinChunkBytes));
+        for (unsigned i = 0; i <= parts; ++i) c.bounds.push_back(c.body + len * i / parts);
+
+        // pass 1: quote parity per chunk, so each chunk knows if it starts inside a quoted field
+        vector<size_t> quotes(parts);
+        parallelFor(parts, threads, [&](size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; ++i) quotes[i] = csvCountQuotes(c.bounds[i], c.bounds[i + 1]);
+        });
+        c.starts.assign(parts, c.end);
+        c.starts[0] = c.body;
+        size_t parity = quotes[0];
+        for (unsigned i = 1; i < parts; ++i) {
+            // state just before bounds[i]-1, then walk to the first unquoted newline
+            const char *p = c.bounds[i] - 1;
+            bool inQuote = ((parity - (*p == '"')) & 1) != 0;
+            for (; p < c.end; ++p) {
+                if (*p == '"') inQuote = !inQuote;
+                else if (*p == '\n' && !inQuote) { c.starts[i] = p + 1; break; }
+            }
+            parity += quotes[i];
+        }
+        return c;
+    }
+
+    template <typename Part>
+    static void renumber(vector<Part> &parts, ImportReport &rep) {
+        size_t base = 0;
+        for (Part &part : parts) {
+            for (ImportError &e : part.errors) { e.record += base; rep.errors.push_back(e); }
+            base += part.records;
+        }
+        rep.records = base;
+    }
+
+    static bool parseGender(CsvField f, string &scratch, char &g) {
+        string_view v = csvText(f, scratch);
+        if (v.empty()) return false;
+        g = (char)toupper((unsigned char)v[0]);
+        return true;
+    }
+
+    static bool parseKind(string_view v, WorkoutKind &k) {
+        if (v.empty()) return false;
+        switch (tolower((unsigned char)v[0])) {
+            case 'c': k = WorkoutKind::Cardio; return true;
+            case 's': k = WorkoutKind::Strength; return true;
+            case 'f': k = WorkoutKind::Flexibility; return true;
+            default: return false;
+        }
+    }
+
+public:
+    explicit BulkImporter(unsigned threadCount = 0): threads(threadCount) {}
+
+    ImportReport importProfiles(const string &path, UserStore &store) {
+        auto t0 = chrono::steady_clock::now();
+        MappedFile file(path);
+        Chunked c = split(file);
+
+        struct Part {
+            vector<uint64_t> ids;
+            vector<string> names;
+            vector<uint32_t> goal;
+            ProfileColumns cols;
+            StringPool goals;
+            vector<size_t> record; // local record number of each parsed row
+            vector<size_t> offset;
+            vector<ImportError> errors;
+            size_t records = 0;
+        };
+        vector<Part> parts(c.starts.size());
+        runParts((unsigned)parts.size(), [&](unsigned i) {
+            Part &part = parts[i];
+            vector<CsvField> fields;
+            string scratch;
+            csvScanRecords(c.starts[i], c.bounds[i + 1], c.end, c.delim, fields,
+                [&](const vector<CsvField> &f, const char *rs) {
+                    if (f.size() == 1 && csvText(f[0], scratch).empty()) return; // blank line
+                    size_t rec = ++part.records, off = (size_t)(rs - file.data());
+                    uint64_t id; int age; double w, h; char g;
+                    if (f.size() != 7) { part.errors.push_back({rec, off, "Wrong number of fields"}); return; }
+                    if (!csvNumber(f[0], id)) { part.errors.push_back({rec, off, "Bad member id"}); return; }
+                    if (!csvNumber(f[2], age) || !csvNumber(f[3], w) || !csvNumber(f[4], h)) {
+                        part.errors.push_back({rec, off, "Bad number"}); return;
+                    }
+                    if (!parseGender(f[5], scratch, g)) g = '?';
+                    string name(csvText(f[1], scratch));
+                    ProfileError e = validateProfile(name.data(), name.size(), age, w, h, g);
+                    if (e != ProfileError::None) { part.errors.push_back({rec, off, profileErrorMessage(e)}); return; }
+                    part.ids.push_back(id);
+                    part.names.push_back(std::move(name));
+                    part.goal.push_back(part.goals.intern(csvText(f[6], scratch)));
+                    part.cols.push_back(age, w, h, g);
+                    part.record.push_back(rec);
+                    part.offset.push_back(off);
+                });
+        });
+
+        ImportReport rep;
+        size_t total = store.size();
+        for (Part &part : parts) total += part.ids.size();
+        store.reserve(total);
+        int64_t importedAt = (int64_t)time(nullptr); // the file carries no profile dates
+        for (Part &part : parts) {
+            for (size_t r = 0; r < part.ids.size(); ++r) {
+                bool added = store.add(part.ids[r], std::move(part.names[r]), part.cols.age[r], part.cols.weightKg[r],
+                                       part.cols.heightCm[r], part.cols.gender[r], part.goals.at(part.goal[r]), importedAt);
+                if (added) ++rep.imported;
+                else part.errors.push_back({part.record[r], part.offset[r], "Duplicate member id"});
+            }
+        }
+        renumber(parts, rep);
+        sort(rep.errors.begin(), rep.errors.end(),
+             [](const ImportError &a, const ImportError &b) { return a.record < b.record; });
+        rep.bytes = file.size();
+        rep.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        return rep;
+    }
+
+    // Rows are written straight into `log`: a newline count per chunk bounds its rows, the
+    // log is grown once by the total, and every thread fills its own slot range. Rows a
+    // chunk did not fill (rejected records, blank lines, quoted newlines) are closed up
+    // afterwards, and workout ids are mapped from each thread's names to the log's.
+    ImportReport importSessions(const string &path, const UserStore &users, SessionLog &log) {
+        auto t0 = chrono::steady_clock::now();
+        MappedFile file(path);
+        Chunked c = split(file);
+
+        struct Part {
+            size_t first = 0, rows = 0; // slots [first, first + rows) of log
+            StringPool workoutNames;    // ids written by this part are local to it
+            vector<ImportError> errors;
+            size_t records = 0;
+        };
+        vector<Part> parts(c.starts.size());
+        runParts((unsigned)parts.size(), [&](unsigned i) {
+            const char *e = i + 1 < parts.size() ? c.starts[i + 1] : c.end;
+            parts[i].rows = (size_t)count(c.starts[i], e, '\n') + (i + 1 == parts.size() && e > c.body && e[-1] != '\n');
+        });
+        const size_t before = log.size();
+        size_t slots = before;
+        for (Part &part : parts) {
+            part.first = slots;
+            slots += part.rows;
+            part.rows = 0;
+        }
+        log.resize(slots);
+
+        const ProfileColumns &prof = users.columns();
+        try {
+            runParts((unsigned)parts.size(), [&](unsigned i) {
+                Part &part = parts[i];
+                vector<CsvField> fields;
+                string scratch;
+                csvScanRecords(c.starts[i], c.bounds[i + 1], c.end, c.delim, fields,
+                    [&](const vector<CsvField> &f, const char *rs) {
+                        if (f.size() == 1 && csvText(f[0], scratch).empty()) return;
+                        size_t rec = ++part.records, off = (size_t)(rs - file.data());
+                        uint64_t id; int64_t ts; int dur, inten, hr = 0; float cal;
+                        WorkoutKind k;
+                        if (f.size() != 8) { part.errors.push_back({rec, off, "Wrong number of fields"}); return; }
+                        if (!csvNumber(f[0], id)) { part.errors.push_back({rec, off, "Bad member id"}); return; }
+                        int64_t u = users.indexOf(id);
+                        if (u < 0) { part.errors.push_back({rec, off, "Unknown member id"}); return; }
+                        if (!csvNumber(f[1], ts) || !csvNumber(f[4], dur) || !csvNumber(f[5], inten)) {
+                            part.errors.push_back({rec, off, "Bad number"}); return;
+                        }
+                        if (!parseKind(csvText(f[3], scratch), k)) { part.errors.push_back({rec, off, "Unknown workout kind"}); return; }
+                        if (dur <= 0 || dur > 24 * 60 || inten < 1 || inten > 10) {
+                            part.errors.push_back({rec, off, "Duration or intensity out of range"}); return;
+                        }
+                        if (!csvText(f[6], scratch).empty() && (!csvNumber(f[6], hr) || hr < 0 || hr > 250)) {
+                            part.errors.push_back({rec, off, "Bad heart rate"}); return;
+                        }
+                        if (csvText(f[7], scratch).empty())
+                            cal = (float)(caloriesPerKg(k, defaultMet(k), dur, inten) * prof.weightKg[(size_t)u]);
+                        else if (!csvNumber(f[7], cal) || !(cal >= 0)) { part.errors.push_back({rec, off, "Bad calories"}); return; }
+                        uint32_t w = part.workoutNames.intern(csvText(f[2], scratch));
+                        log.set(part.first + part.rows++, (uint32_t)u, ts, w, k, (uint16_t)dur, (uint8_t)inten,
+                                (uint16_t)hr, cal);
+                    });
+            });
+
+            vector<vector<uint32_t>> remap(parts.size());
+            for (size_t i = 0; i < parts.size(); ++i) {
+                const StringPool &names = parts[i].workoutNames;
+                for (uint32_t w = 0; w < names.size(); ++w) remap[i].push_back(log.workoutNames.intern(names.at(w)));
+            }
+            runParts((unsigned)parts.size(), [&](unsigned i) {
+                uint32_t *w = log.workout.data() + parts[i].first;
+                for (size_t j = 0; j < parts[i].rows; ++j) w[j] = remap[i][w[j]];
+            });
+        } catch (...) {
+            log.resize(before);
+            throw;
+        }
+
+        ImportReport rep;
+        size_t end = before;
+        for (Part &part : parts) {
+            if (part.first != end) log.moveRows(part.first, part.rows, end);
+            end += part.rows;
+            rep.imported += part.rows;
+        }
+        log.resize(end);
+        renumber(parts, rep);
+        rep.bytes = file.size();
+        rep.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        return rep;
+    }
+
+private:
+    struct StagedRow {
+        uint64_t member;
+        int64_t timestamp;
+        uint32_t workout; // id in the batch's workoutNames
+        uint32_t user;
+        int duration, intensity, heartRate;
+        float calories, weightKg;
+        WorkoutKind kind;
+        bool hasCalories;
+        size_t record, offset;
+    };
+    struct StagedBatch {
+        size_t seq = 0;
+        const char *begin = nullptr, *end = nullptr;
+        size_t records = 0;
+        vector<StagedRow> rows;
+        StringPool workoutNames;
+        vector<ImportError> errors; // record numbers local to the batch until logged
+        size_t size() const { return records; }
+    };
+
+    // drops rows for which reject() returns a reason, recording it as an import error
+    template <typename Fn>
+    static void rejectRows(StagedBatch &b, Fn reject) {
+        size_t keep = 0;
+        for (size_t i = 0; i < b.rows.size(); ++i) {
+            StagedRow &r = b.rows[i];
+            if (const char *reason = reject(r)) b.errors.push_back({r.record, r.offset, reason});
+            else b.rows[keep++] = r;
+        }
+        b.rows.resize(keep);
+    }
+
+public:
+    // importSessions() as a pipeline: parse -> validate -> enrich (profile lookup) ->
+    // estimate -> log, each stage on its own threads, joined by bounded queues. The log
+    // stage restores file order, so the result matches importSessions() except that a
+    // record failing several checks reports the one from the earliest stage. onLogged
+    // (optional) sees each appended range [first, last) of the log, for aggregates.
+    ImportReport importSessionsStaged(const string &path, const UserStore &users, SessionLog &log,
+                                      const StagedImportOptions &opt = StagedImportOptions(),
+                                      vector<PipelineStageStats> *stageStats = nullptr,
+                                      const function<void(const SessionLog &, size_t, size_t)> &onLogged = nullptr) {
+        auto t0 = chrono::steady_clock::now();
+        MappedFile file(path);
+        Chunked c = split(file, opt.chunkBytes);
+        const ProfileColumns &prof = users.columns();
+        unsigned n = workerCount(threads);
+        StagedPipeline<StagedBatch> pipeline(opt.queueCapacity);
+
+        pipeline.addStage("parse", opt.parseThreads ? opt.parseThreads : max(1u, n / 2), [&](StagedBatch &b) {
+            vector<CsvField> fields;
+            string scratch;
+            csvScanRecords(b.begin, b.end, c.end, c.delim, fields, [&](const vector<CsvField> &f, const char *rs) {
+                if (f.size() == 1 && csvText(f[0], scratch).empty()) return;
+                StagedRow r{};
+                r.record = ++b.records;
+                r.offset = (size_t)(rs - file.data());
+                auto fail = [&](const char *reason) { b.errors.push_back({r.record, r.offset, reason}); };
+                if (f.size() != 8) return fail("Wrong number of fields");
+                if (!csvNumber(f[0], r.member)) return fail("Bad member id");
+                if (!csvNumber(f[1], r.timestamp) || !csvNumber(f[4], r.duration) || !csvNumber(f[5], r.intensity))
+                    return fail("Bad number");
+                if (!parseKind(csvText(f[3], scratch), r.kind)) return fail("Unknown workout kind");
+                if (!csvText(f[6], scratch).empty() && !csvNumber(f[6], r.heartRate)) return fail("Bad heart rate");
+                r.hasCalories = !csvText(f[7], scratch).empty();
+                if (r.hasCalories && !csvNumber(f[7], r.calories)) return fail("Bad calories");
+                r.workout = b.workoutNames.intern(csvText(f[2], scratch));
+                b.rows.push_back(r);
+            });
+        });
+        pipeline.addStage("validate", opt.validateThreads, [](StagedBatch &b) {
+            rejectRows(b, [](const StagedRow &r) -> const char * {
+                if (r.duration <= 0 || r.duration > 24 * 60 || r.intensity < 1 || r.intensity > 10)
+                    return "Duration or intensity out of range";
+                if (r.heartRate < 0 || r.heartRate > 250) return "Bad heart rate";
+                if (r.hasCalories && !(r.calories >= 0)) return "Bad calories";
+                return nullptr;
+            });
+        });
+        pipeline.addStage("enrich", opt.enrichThreads ? opt.enrichThreads : max(1u, n / 4), [&](StagedBatch &b) {
+            rejectRows(b, [&](StagedRow &r) -> const char * {
+                int64_t u = users.indexOf(r.member);
+                if (u < 0) return "Unknown member id";
+                r.user = (uint32_t)u;
+                r.weightKg = (float)prof.weightKg[(size_t)u];
+                return nullptr;
+            });
+        });
+        pipeline.addStage("estimate", opt.estimateThreads, [](StagedBatch &b) {
+            for (StagedRow &r : b.rows)
+                if (!r.hasCalories)
+                    r.calories = (float)(caloriesPerKg(r.kind, defaultMet(r.kind), r.duration, r.intensity) * r.weightKg);
+        });
+
+        // Single logger thread; batches finishing early wait here until their turn. Their
+        // contents are swapped out so the batch objects can be recycled, which the source
+        // bounds by staying within reorderWindow batches of the next one to log.
+        ImportReport rep;
+        size_t nextSeq = 0, recordBase = 0;
+        atomic<size_t> loggedSeq{0};
+        map<size_t, StagedBatch> waiting;
+        vector<uint32_t> remap;
+        auto append = [&](StagedBatch &b) {
+            remap.resize(b.workoutNames.size());
+            for (uint32_t w = 0; w < remap.size(); ++w) remap[w] = log.workoutNames.intern(b.workoutNames.at(w));
+            size_t first = log.size();
+            for (const StagedRow &r : b.rows)
+                log.append(r.user, r.timestamp, remap[r.workout], r.kind, (uint16_t)r.duration, (uint8_t)r.intensity,
+                           (uint16_t)r.heartRate, r.calories);
+            for (ImportError &e : b.errors) {
+                e.record += recordBase;
+                rep.errors.push_back(e);
+            }
+            recordBase += b.records;
+            rep.imported += b.rows.size();
+            if (onLogged && log.size() > first) onLogged(log, first, log.size());
+        };
+        pipeline.addStage("log", 1, [&](StagedBatch &b) {
+            if (b.seq != nextSeq) {
+                StagedBatch &held = waiting[b.seq];
+                held.seq = b.seq;
+                held.records = b.records;
+                held.rows.swap(b.rows);
+                held.errors.swap(b.errors);
+                swap(held.workoutNames, b.workoutNames);
+                return;
+            }
+            append(b);
+            ++nextSeq;
+            for (auto it = waiting.begin(); it != waiting.end() && it->first == nextSeq; it = waiting.erase(it)) {
+                append(it->second);
+                ++nextSeq;
+            }
+            loggedSeq.store(nextSeq, memory_order_release);
+        });
+
+        size_t next = 0, window = max<size_t>(1, opt.reorderWindow);
+        vector<PipelineStageStats> stats = pipeline.run([&](StagedBatch &b) {
+            if (next == c.starts.size()) return false;
+            SpinBackoff backoff;
+            while (next >= loggedSeq.load(memory_order_acquire) + window && !pipeline.failed()) backoff.pause();
+            b.seq = next;
+            b.begin = c.starts[next];
+            b.end = c.bounds[next + 1];
+            b.records = 0;
+            b.rows.clear();
+            b.errors.clear();
+            b.workoutNames = StringPool();
+            ++next;
+            return true;
+        });
+        if (stageStats) *stageStats = std::move(stats);
+        sort(rep.errors.begin(), rep.errors.end(),
+             [](const ImportError &a, const ImportError &b) { return a.record < b.record; });
+        rep.records = recordBase;
+        rep.bytes = file.size();
+        rep.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        return rep;
+    }
+};
+
+/* ---------------------------
+   FoodDatabase - memory-mapped nutrient lookup
+   --------------------------- */
+// Built once from a CSV export (food_id,name,kcal_per_100g,protein_g,carbs_g,fat_g)
+// into a flat file that is mmapped as-is:
+//   header | records sorted by lower-cased name | id index | 2-byte prefix table | names
+struct FoodRecord {
+    uint64_t id;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    float kcalPer100g, proteinG, carbsG, fatG; // per 100 g
+};
+
+class FoodDatabase {
+    struct Header {
+        char magic[8];
+        uint64_t count;
+        uint64_t recordsOffset, idIndexOffset, prefixOffset, namesOffset;
+    };
+    struct IdEntry { uint64_t id; uint64_t record; };
+    static const size_t kPrefixSlots = 65536 + 1;
+
+    unique_ptr<MappedFile> file;
+    const Header *header = nullptr;
+    const FoodRecord *records = nullptr;
+    const IdEntry *ids = nullptr;
+    const uint32_t *prefixTable = nullptr;
+    const char *names = nullptr;
+
+    static unsigned char lower(char c) { return (unsigned char)tolower((unsigned char)c); }
+    // records are grouped by their first two lower-cased bytes
+    static size_t prefixSlot(string_view s) {
+        size_t a = s.size() > 0 ? lower(s[0]) : 0, b = s.size() > 1 ? lower(s[1]) : 0;
+        return a << 8 | b;
+    }
+    // case-insensitive compare of the first n bytes of name against key
+    static int comparePrefix(string_view name, string_view key) {
+        size_t n = min(name.size(), key.size());
+        for (size_t i = 0; i < n; ++i) {
+            unsigned char a = lower(name[i]), b = lower(key[i]);
+            if (a != b) return a < b ? -1 : 1;
+        }
+        return name.size() < key.size() ? -1 : 0;
+    }
+
+public:
+    // Writes the binary database; returns the number of foods (bad rows are skipped).
+    static size_t build(const string &csvPath, const string &dbPath) {
+        MappedFile src(csvPath);
+        const char *data = src.data(), *end = data + src.size();
+        const char *body = find(data, end, '\n');
+        body = body == end ? end : body + 1;
+        struct Row { FoodRecord rec; string name; };
+        vector<Row> rows;
+        vector<CsvField> fields;
+        string scratch;
+        csvScanRecords(body, end, end, ',', fields, [&](const vector<CsvField> &f, const char *) {
+            Row r{};
+            if (f.size() != 6 || !csvNumber(f[0], r.rec.id) || !csvNumber(f[2], r.rec.kcalPer100g)) return;
+            if (!csvNumber(f[3], r.rec.proteinG)) r.rec.proteinG = 0;
+            if (!csvNumber(f[4], r.rec.carbsG)) r.rec.carbsG = 0;
+            if (!csvNumber(f[5], r.rec.fatG)) r.rec.fatG = 0;
+            r.name = string(csvText(f[1], scratch));
+            if (!r.name.empty()) rows.push_back(std::move(r));
+        });
+        sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+            return lexicographical_compare(a.name.begin(), a.name.end(), b.name.begin(), b.name.end(),
+                                           [](char x, char y) { return lower(x) < lower(y); });
+        });
+
+        Header h{};
+        memcpy(h.magic, "FOODDB1", 8);
+        h.count = rows.size();
+        h.recordsOffset = sizeof(Header);
+        h.idIndexOffset = h.recordsOffset + rows.size() * sizeof(FoodRecord);
+        h.prefixOffset = h.idIndexOffset + rows.size() * sizeof(IdEntry);
+        h.namesOffset = h.prefixOffset + kPrefixSlots * sizeof(uint32_t);
+
+        vector<FoodRecord> recs(rows.size());
+        vector<IdEntry> idx(rows.size());
+        vector<uint32_t> prefix(kPrefixSlots, 0);
+        string blob;
+        for (size_t i = 0; i < rows.size(); ++i) {
+            recs[i] = rows[i].rec;
+            recs[i].nameOffset = (uint32_t)blob.size();
+            recs[i].nameLength = (uint32_t)rows[i].name.size();
+            blob += rows[i].name;
+            idx[i] = {rows[i].rec.id, i};
+            ++prefix[prefixSlot(rows[i].name) + 1];
+        }
+        for (size_t s = 1; s < kPrefixSlots; ++s) prefix[s] += prefix[s - 1];
+        sort(idx.begin(), idx.end(), [](const IdEntry &a, const IdEntry &b) { return a.id < b.id; });
+
+        ofstream ofs(dbPath, ios::binary | ios::trunc);
+        if (!ofs) throw FitnessException("Unable to write " + dbPath);
+        ofs.write(reinterpret_cast<const char *>(&h), sizeof h);
+        ofs.write(reinterpret_cast<const char *>(recs.data()), (streamsize)(recs.size() * sizeof(FoodRecord)));
+        ofs.write(reinterpret_cast<const char *>(idx.data()), (streamsize)(idx.size() * sizeof(IdEntry)));
+        ofs.write(reinterpret_cast<const char *>(prefix.data()), (streamsize)(prefix.size() * sizeof(uint32_t)));
+        ofs.write(blob.data(), (streamsize)blob.size());
+        if (!ofs) throw FitnessException("Unable to write " + dbPath);
+        return rows.size();
+    }
+
+    // Maps the file and checks every section, and every offset stored in one, against the
+    // file size; a truncated or corrupt file throws and leaves the database as it was.
+    void open(const string &dbPath) {
+        unique_ptr<MappedFile> f(new MappedFile(dbPath));
+        const char *base = f->data();
+        const size_t size = f->size();
+        const Header *h = reinterpret_cast<const Header *>(base);
+        if (size < sizeof(Header) || memcmp(h->magic, "FOODDB1", 8) != 0)
+            throw FitnessException("Not a food database: " + dbPath);
+        auto fits = [size](uint64_t offset, uint64_t count, size_t width, size_t align) {
+            return offset % align == 0 && offset <= size && count <= (size - offset) / width;
+        };
+        if (!fits(h->recordsOffset, h->count, sizeof(FoodRecord), alignof(FoodRecord)) ||
+            !fits(h->idIndexOffset, h->count, sizeof(IdEntry), alignof(IdEntry)) ||
+            !fits(h->prefixOffset, kPrefixSlots, sizeof(uint32_t), alignof(uint32_t)) || h->namesOffset > size)
+            throw FitnessException("Corrupt food database: " + dbPath);
+        const FoodRecord *recs = reinterpret_cast<const FoodRecord *>(base + h->recordsOffset);
+        const IdEntry *index = reinterpret_cast<const IdEntry *>(base + h->idIndexOffset);
+        const uint32_t *prefix = reinterpret_cast<const uint32_t *>(base + h->prefixOffset);
+        const uint64_t namesSize = size - h->namesOffset;
+        bool ok = prefix[0] == 0 && prefix[kPrefixSlots - 1] == h->count;
+        for (size_t s = 1; ok && s < kPrefixSlots; ++s) ok = prefix[s - 1] <= prefix[s];
+        for (uint64_t i = 0; ok && i < h->count; ++i)
+            ok = (uint64_t)recs[i].nameOffset + recs[i].nameLength <= namesSize && index[i].record < h->count &&
+                 (i == 0 || index[i - 1].id <= index[i].id);
+        if (!ok) throw FitnessException("Corrupt food database: " + dbPath);
+
+        file = std::move(f);
+        header = h;
+        records = recs;
+        ids = index;
+        prefixTable = prefix;
+        names = base + h->namesOffset;
+    }
+
+    size_t size() const { return header ? header->count : 0; }
+    const FoodRecord &record(size_t i) const { return records[i]; }
+    string_view name(const FoodRecord &r) const { return string_view(names + r.nameOffset, r.nameLength); }
+    size_t indexOf(const FoodRecord &r) const { return (size_t)(&r - records); }
+
+    const FoodRecord *byId(uint64_t id) const {
+        if (!header) return nullptr;
+        const IdEntry *b = ids, *e = ids + header->count;
+        const IdEntry *it = lower_bound(b, e, id, [](const IdEntry &x, uint64_t v) { return x.id < v; });
+        return (it != e && it->id == id) ? &records[it->record] : nullptr;
+    }
+
+    // byId for up to kLookupBatch ids at once. The binary searches run in lockstep (all of
+    // them take the same number of steps), so their cache misses in the id index overlap.
+    static constexpr size_t kLookupBatch = 16;
+    void byIds(const uint64_t *query, size_t n, const FoodRecord **out) const {
+        n = min(n, kLookupBatch);
+        if (!header || header->count == 0) {
+            fill(out, out + n, nullptr);
+            return;
+        }
+        const IdEntry *base[kLookupBatch];
+        fill(base, base + n, ids);
+        for (size_t len = header->count; len > 1;) {
+            size_t half = len / 2;
+            len -= half;
+            for (size_t k = 0; k < n; ++k) {
+                base[k] = base[k][half].id < query[k] ? base[k] + half : base[k];
+                __builtin_prefetch(base[k] + len / 2);
+            }
+        }
+        for (size_t k = 0; k < n; ++k) {
+            const IdEntry *it = base[k] + (base[k]->id < query[k]);
+            out[k] = (it != ids + header->count && it->id == query[k]) ? &records[it->record] : nullptr;
+        }
+    }
+
+    // up to k foods whose name starts with `prefix`, alphabetically
+    vector<const FoodRecord *> byPrefix(string_view prefix, size_t k) const {
+        vector<const FoodRecord *> out;
+        if (!header || prefix.empty()) return out;
+        size_t lo, hi;
+        if (prefix.size() >= 2) {
+            size_t s = prefixSlot(prefix);
+            lo = prefixTable[s];
+            hi = prefixTable[s + 1];
+        } else {
+            size_t s = (size_t)lower(prefix[0]) << 8;
+            lo = prefixTable[s];
+            hi = prefixTable[s + 256];
+        }
+        const FoodRecord *b = records + lo, *e = records + hi;
+        const FoodRecord *it = lower_bound(b, e, prefix, [this](const FoodRecord &r, string_view key) {
+            return comparePrefix(name(r), key) < 0;
+        });
+        for (; it != e && out.size() < k && comparePrefix(name(*it), prefix) == 0; ++it) out.push_back(it);
+        return out;
+    }
+};
+
+/* ---------------------------
+   IntakeLog - food eaten per member
+   --------------------------- */
+struct IntakeLog {
+    vector<uint32_t> user;     // UserStore index
+    vector<int64_t> timestamp; // unix seconds
+    vector<uint64_t> food;     // food_id, stable across database rebuilds
+    vector<float> grams;
+
+    size_t size() const { return user.size(); }
+    void append(uint32_t u, int64_t ts, uint64_t foodId, float g) {
+        user.push_back(u); timestamp.push_back(ts); food.push_back(foodId); grams.push_back(g);
+    }
+    // 0 for foods no longer in the database
+    double kcal(size_t i, const FoodDatabase &db) const {
+        const FoodRecord *r = db.byId(food[i]);
+        return r ? r->kcalPer100g * grams[i] / 100.0 : 0.0;
+    }
+};
+
+struct DailyNet {
+    float intake = 0, burned = 0;
+    float net() const { return intake - burned; }
+};
+
+// Intake minus workout burn for every member on one UTC day, both logs scanned in parallel.
+inline vector<DailyNet> dailyNetCalories(const IntakeLog &intake, const SessionLog &sessions, const FoodDatabase &db,
+                                         size_t users, int64_t day, unsigned threads = 0) {
+    const int64_t from = day * 86400, to = from + 86400;
+    vector<DailyNet> out(users);
+    unsigned parts = workerCount(threads);
+    vector<vector<pair<uint32_t, float>>> in(parts), burn(parts);
+    runParts(parts, [&](unsigned t) {
+        // food ids are resolved FoodDatabase::kLookupBatch rows at a time
+        size_t rows[FoodDatabase::kLookupBatch], n = 0;
+        uint64_t foodIds[FoodDatabase::kLookupBatch];
+        const FoodRecord *foods[FoodDatabase::kLookupBatch];
+        auto flush = [&] {
+            db.byIds(foodIds, n, foods);
+            for (size_t k = 0; k < n; ++k)
+                if (foods[k]) in[t].push_back({intake.user[rows[k]], foods[k]->kcalPer100g * intake.grams[rows[k]] / 100.0f});
+            n = 0;
+        };
+        for (size_t i = intake.size() * t / parts, e = intake.size() * (t + 1) / parts; i < e; ++i)
+            if (intake.timestamp[i] >= from && intake.timestamp[i] < to) {
+                rows[n] = i;
+                foodIds[n] = intake.food[i];
+                if (++n == FoodDatabase::kLookupBatch) flush();
+            }
+        flush();
+        for (size_t i = sessions.size() * t / parts, e = sessions.size() * (t + 1) / parts; i < e; ++i)
+            if (sessions.timestamp[i] >= from && sessions.timestamp[i] < to)
+                burn[t].push_back({sessions.user[i], sessions.calories[i]});
+    });
+    for (unsigned t = 0; t < parts; ++t) {
+        for (auto &e : in[t]) if (e.first < users) out[e.first].intake += e.second;
+        for (auto &e : burn[t]) if (e.first < users) out[e.first].burned += e.second;
+    }
+    return out;
+}
+
+/* ---------------------------
+   WorkoutCatalog - searchable workout names
+   --------------------------- */
+// muscle groups a workout trains (bit flags)
+enum : uint8_t { MuscleLegs = 1, MuscleUpper = 2, MuscleCore = 4, MuscleHeart = 8, MuscleMobility = 16 };
+
+struct CatalogEntry {
+    string name;
+    WorkoutKind kind;
+    double met;
+    uint32_t popularity; // higher ranks first among equally good matches
+    uint8_t muscles = 0; // Muscle* flags
+};
+
+struct CatalogMatch {
+    uint32_t entry;   // index into the catalog
+    uint8_t distance; // edit distance between the query and a prefix of the name
+};
+
+// Radix trie over lower-cased names (sorted, so every node is a contiguous range of
+// keys) for prefix autocomplete, plus Myers' bit-parallel edit distance evaluated
+// along trie paths for typo-tolerant lookups.
+class CatalogSearchIndex {
+    struct Node {
+        uint32_t lo, hi;       // keys in [lo, hi) share this node's prefix
+        uint32_t firstChild;   // children are contiguous, sorted by first char
+        uint16_t childCount;
+        uint16_t depth;        // prefix length at the end of this node's edge
+        int32_t topOffset;     // into `tops`, or -1 for small ranges (scanned instead)
+    };
+    static const uint32_t kScanLimit = 64; // ranges above this get precomputed top entries
+    static constexpr size_t kTopCached = 8;
+    static const size_t kMaxQuery = 64;    // one machine word of Myers state
+
+    vector<string> keys;          // lower-cased, sorted
+    vector<uint32_t> entryOf;     // key index -> catalog entry
+    vector<uint32_t> popularity;  // per key index
+    vector<Node> nodes;
+    vector<char> childChar;       // first char of each node's edge, for binary search
+    vector<uint32_t> tops;        // kTopCached key indices per large node
+
+    static string normalize(string_view s) {
+        string out(s);
+        for (char &c : out) c = (char)tolower((unsigned char)c);
+        return out;
+    }
+
+    void buildNode(uint32_t id, uint16_t parentDepth) {
+        Node n = nodes[id];
+        const string &a = keys[n.lo], &b = keys[n.hi - 1];
+        size_t lcp = parentDepth;
+        while (lcp < a.size() && lcp < b.size() && a[lcp] == b[lcp]) ++lcp;
+        n.depth = (uint16_t)lcp;
+        // keys ending exactly here sort first; the rest are grouped by next char
+        uint32_t i = n.lo;
+        while (i < n.hi && keys[i].size() == lcp) ++i;
+        n.firstChild = (uint32_t)nodes.size();
+        n.childCount = 0;
+        while (i < n.hi) {
+            char c = keys[i][lcp];
+            uint32_t j = i;
+            while (j < n.hi && keys[j][lcp] == c) ++j;
+            nodes.push_back({i, j, 0, 0, 0, -1});
+            childChar.push_back(c);
+            ++n.childCount;
+            i = j;
+        }
+        if (n.hi - n.lo > kScanLimit) {
+            n.topOffset = (int32_t)tops.size();
+            vector<uint32_t> best = topByPopularity(n.lo, n.hi, kTopCached);
+            tops.insert(tops.end(), best.begin(), best.end());
+        }
+        nodes[id] = n;
+        for (uint32_t c = 0; c < n.childCount; ++c) buildNode(n.firstChild + c, n.depth);
+    }
+
+    vector<uint32_t> topByPopularity(uint32_t lo, uint32_t hi, size_t k) const {
+        vector<uint32_t> idx;
+        auto worse = [this](uint32_t x, uint32_t y) { return popularity[x] > popularity[y] || (popularity[x] == popularity[y] && x < y); };
+        for (uint32_t i = lo; i < hi; ++i) {
+            if (idx.size() < k) { idx.push_back(i); push_heap(idx.begin(), idx.end(), worse); }
+            else if (worse(i, idx.front())) {
+                pop_heap(idx.begin(), idx.end(), worse);
+                idx.back() = i;
+                push_heap(idx.begin(), idx.end(), worse);
+            }
+        }
+        sort_heap(idx.begin(), idx.end(), worse);
+        return idx;
+    }
+
+    // top-k keys of a node's subtree, from the cache when possible
+    void collect(uint32_t node, size_t k, vector<uint32_t> &out) const {
+        const Node &n = nodes[node];
+        if (n.topOffset >= 0 && k <= kTopCached) {
+            size_t cnt = min<size_t>(k, kTopCached);
+            out.insert(out.end(), tops.begin() + n.topOffset, tops.begin() + n.topOffset + cnt);
+        } else {
+            vector<uint32_t> best = topByPopularity(n.lo, n.hi, k);
+            out.insert(out.end(), best.begin(), best.end());
+        }
+    }
+
+    int findChild(const Node &n, char c) const {
+        auto b = childChar.begin() + n.firstChild, e = b + n.childCount;
+        auto it = lower_bound(b, e, c);
+        return (it != e && *it == c) ? (int)(n.firstChild + (it - b)) : -1;
+    }
+
+    // Myers (1999) state for one column of the DP matrix, global alignment variant
+    struct Myers { uint64_t pv, mv; int score; };
+
+    struct FuzzyCtx {
+        uint64_t peq[256];
+        int m;
+        int maxDist;
+        uint64_t high;
+        vector<pair<uint32_t, int>> hits; // (node, best prefix distance)
+    };
+
+    static void myersStep(Myers &s, uint64_t eq, const FuzzyCtx &cx) {
+        uint64_t xv = eq | s.mv;
+        uint64_t xh = (((eq & s.pv) + s.pv) ^ s.pv) | eq;
+        uint64_t ph = s.mv | ~(xh | s.pv);
+        uint64_t mh = s.pv & xh;
+        if (ph & cx.high) ++s.score;
+        else if (mh & cx.high) --s.score;
+        ph = (ph << 1) | 1; // top row D[0][j] = j grows by one per text char
+        mh <<= 1;
+        s.pv = mh | ~(xv | ph);
+        s.mv = ph & xv;
+    }
+
+    // smallest value in the current column: D[0][j] = j plus vertical deltas
+    static int columnMin(const Myers &s, int j, int m) {
+        int cur = j, best = j;
+        for (int i = 0; i < m; ++i) {
+            cur += (int)((s.pv >> i) & 1) - (int)((s.mv >> i) & 1);
+            best = min(best, cur);
+        }
+        return best;
+    }
+
+    void fuzzyWalk(uint32_t node, uint16_t parentDepth, Myers s, FuzzyCtx &cx) const {
+        const Node &n = nodes[node];
+        const string &key = keys[n.lo];
+        int best = INT_MAX;
+        for (uint16_t j = parentDepth; j < n.depth; ++j) {
+            myersStep(s, cx.peq[(unsigned char)key[j]], cx);
+            best = min(best, s.score);
+            if (s.score == 0) break;
+            if (columnMin(s, j + 1, cx.m) > cx.maxDist) {
+                // nothing deeper can match, but a prefix on this edge may already have
+                if (best <= cx.maxDist) cx.hits.push_back({node, best});
+                return;
+            }
+        }
+        if (best <= cx.maxDist) {
+            cx.hits.push_back({node, best});
+            if (best == 0) return; // whole subtree already matches exactly
+        }
+        for (uint32_t c = 0; c < n.childCount; ++c) fuzzyWalk(n.firstChild + c, n.depth, s, cx);
+    }
+
+public:
+    void build(const vector<CatalogEntry> &entries) {
+        vector<pair<string, uint32_t>> sorted;
+        sorted.reserve(entries.size());
+        for (uint32_t i = 0; i < entries.size(); ++i) sorted.push_back({normalize(entries[i].name), i});
+        sort(sorted.begin(), sorted.end());
+        keys.clear(); entryOf.clear(); popularity.clear();
+        nodes.clear(); childChar.clear(); tops.clear();
+        for (auto &kv : sorted) {
+            keys.push_back(std::move(kv.first));
+            entryOf.push_back(kv.second);
+            popularity.push_back(entries[kv.second].popularity);
+        }
+        if (keys.empty()) return;
+        nodes.push_back({0, (uint32_t)keys.size(), 0, 0, 0, -1});
+        childChar.push_back('\0');
+        buildNode(0, 0);
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+
+    // Names starting with `prefix` (case-insensitive), most popular first.
+    vector<CatalogMatch> autocomplete(string_view prefix, size_t k) const {
+        vector<CatalogMatch> out;
+        if (nodes.empty()) return out;
+        string q = normalize(prefix);
+        uint32_t node = 0;
+        for (;;) {
+            const Node &n = nodes[node];
+            size_t upto = min<size_t>(q.size(), n.depth);
+            if (keys[n.lo].compare(0, upto, q, 0, upto) != 0) return out;
+            if (q.size() <= n.depth) break;
+            int c = findChild(n, q[n.depth]);
+            if (c < 0) return out;
+            node = (uint32_t)c;
+        }
+        vector<uint32_t> keyIdx;
+        collect(node, k, keyIdx);
+        for (uint32_t ki : keyIdx) out.push_back({entryOf[ki], 0});
+        return out;
+    }
+
+    // Names whose prefix is within maxDist edits of the query; ranked by distance,
+    // then popularity. maxDist < 0 picks 0/1/2 from the query length.
+    vector<CatalogMatch> search(string_view query, size_t k, int maxDist = -1) const {
+        vector<CatalogMatch> out;
+        if (nodes.empty() || query.empty()) return autocomplete(query, k);
+        string q = normalize(query.substr(0, kMaxQuery));
+        if (maxDist < 0) maxDist = q.size() < 4 ? 0 : q.size() < 8 ? 1 : 2;
+        if (maxDist == 0) return autocomplete(q, k);
+
+        FuzzyCtx cx;
+        memset(cx.peq, 0, sizeof(cx.peq));
+        cx.m = (int)q.size();
+        cx.maxDist = maxDist;
+        cx.high = 1ull << (cx.m - 1);
+        for (int i = 0; i < cx.m; ++i) cx.peq[(unsigned char)q[i]] |= 1ull << i;
+        Myers s{cx.m == 64 ? ~0ull : (1ull << cx.m) - 1, 0, cx.m};
+        fuzzyWalk(0, 0, s, cx);
+
+        // best distances first; dedupe keys reached through nested nodes
+        stable_sort(cx.hits.begin(), cx.hits.end(),
+                    [](const pair<uint32_t, int> &a, const pair<uint32_t, int> &b) { return a.second < b.second; });
+        vector<pair<uint32_t, int>> ranked; // (key index, distance)
+        unordered_set<uint32_t> seen;
+        for (size_t h = 0; h < cx.hits.size(); ++h) {
+            vector<uint32_t> keyIdx;
+            collect(cx.hits[h].first, k, keyIdx);
+            for (uint32_t ki : keyIdx)
+                if (seen.insert(ki).second) ranked.push_back({ki, cx.hits[h].second});
+        }
+        sort(ranked.begin(), ranked.end(), [this](const pair<uint32_t, int> &a, const pair<uint32_t, int> &b) {
+            if (a.second != b.second) return a.second < b.second;
+            if (popularity[a.first] != popularity[b.first]) return popularity[a.first] > popularity[b.first];
+            return a.first < b.first;
+        });
+        for (size_t i = 0; i < ranked.size() && i < k; ++i)
+            out.push_back({entryOf[ranked[i].first], (uint8_t)ranked[i].second});
+        return out;
+    }
+};
+
+class WorkoutCatalog {
+    vector<CatalogEntry> entries;
+    CatalogSearchIndex index;
+public:
+    WorkoutCatalog() {}
+    explicit WorkoutCatalog(vector<CatalogEntry> e): entries(std::move(e)) { index.build(entries); }
+
+    void add(const CatalogEntry &e) { entries.push_back(e); }
+    void rebuildIndex() { index.build(entries); } // call after a series of add()
+
+    size_t size() const { return entries.size(); }
+    const CatalogEntry &at(size_t i) const { return entries[i]; }
+    const CatalogSearchIndex &searchIndex() const { return index; }
+
+    vector<CatalogMatch> autocomplete(string_view prefix, size_t k = 5) const { return index.autocomplete(prefix, k); }
+    vector<CatalogMatch> search(string_view query, size_t k = 5) const { return index.search(query, k); }
+
+    // caller owns the returned workout
+    Workout* makeWorkout(size_t i, int durationMin, int intensity) const {
+        const CatalogEntry &e = entries[i];
+        switch (e.kind) {
+            case WorkoutKind::Cardio: return new Cardio(e.name, durationMin, intensity, e.met);
+            case WorkoutKind::Strength: return new Strength(e.name, durationMin, intensity);
+            default: return new Flexibility(e.name, durationMin, intensity);
+        }
+    }
+
+    // the workouts the app recommends out of the box
+    static WorkoutCatalog defaults() {
+        return WorkoutCatalog({
+            {"Jogging", WorkoutKind::Cardio, 7.0, 900, MuscleHeart | MuscleLegs},
+            {"HIIT", WorkoutKind::Cardio, 10.0, 800, MuscleHeart | MuscleLegs | MuscleCore},
+            {"Steady-state", WorkoutKind::Cardio, 6.0, 500, MuscleHeart},
+            {"Light cardio", WorkoutKind::Cardio, 5.5, 450, MuscleHeart},
+            {"Cycling", WorkoutKind::Cardio, 7.5, 700, MuscleHeart | MuscleLegs},
+            {"Swimming", WorkoutKind::Cardio, 8.0, 600, MuscleHeart | MuscleUpper},
+            {"Rowing", WorkoutKind::Cardio, 7.0, 350, MuscleHeart | MuscleUpper | MuscleCore},
+            {"Full-body strength", WorkoutKind::Strength, 6.0, 650, MuscleLegs | MuscleUpper | MuscleCore},
+            {"Hypertrophy", WorkoutKind::Strength, 6.0, 550, MuscleUpper},
+            {"Circuit training", WorkoutKind::Strength, 6.0, 500, MuscleLegs | MuscleUpper | MuscleHeart},
+            {"Maintenance strength", WorkoutKind::Strength, 6.0, 300, MuscleLegs | MuscleUpper},
+            {"Yoga", WorkoutKind::Flexibility, 3.0, 750, MuscleMobility | MuscleCore},
+            {"Stretch", WorkoutKind::Flexibility, 3.0, 400, MuscleMobility},
+            {"Mobility", WorkoutKind::Flexibility, 3.0, 350, MuscleMobility},
+            {"Pilates", WorkoutKind::Flexibility, 3.0, 450, MuscleMobility | MuscleCore},
+        });
+    }
+};
+
+/* ---------------------------
+   WeeklyPlanOptimizer - branch-and-bound weekly schedule
+   --------------------------- */
+// Chooses, for each day, rest or one catalog workout at one of a few durations:
+//   minimize  max(0, |weekly kcal - target| - tolerance)
+//             + overlapPenalty * (consecutive days loading the same muscles)
+//   s.t.      duration <= day limit, >= minRestDays rest days, every required muscle group trained.
+// Depth-first branch and bound over days; the bound combines the calorie range still
+// reachable with coverage and rest feasibility. Objectives are whole kcal, so an
+// incumbent of 0 is provably optimal and ends the search.
+struct WeeklyProblem {
+    double weightKg = 70.0;
+    double targetKcal = 2000.0;
+    double tolerance = 0.02; // fraction of the target treated as on target
+    uint8_t requiredMuscles = MuscleLegs | MuscleUpper | MuscleCore | MuscleHeart;
+    int minRestDays = 1;
+    array<uint16_t, 7> dayLimitMin{{60, 60, 60, 60, 60, 90, 90}};
+    int overlapPenalty = 50;
+    chrono::microseconds timeLimit{0}; // search budget for this member; 0 = the caller's default
+};
+
+struct DayChoice {
+    int16_t entry = -1; // catalog index, -1 = rest
+    uint16_t durationMin = 0;
+};
+
+struct WeeklySolution {
+    array<DayChoice, 7> days;
+    bool feasible = false;
+    bool optimal = false;    // search completed (or hit a zero objective)
+    double objective = 0.0;
+    double kcal = 0.0;
+    double lowerBound = 0.0; // best bound proven
+    uint64_t nodes = 0;
+    double seconds = 0.0;
+    double gap() const { return feasible ? objective - lowerBound : INFINITY; }
+};
+
+class WeeklyPlanOptimizer {
+    static const int kIntensity = 6;
+    static constexpr uint16_t kDurations[4] = {20, 30, 45, 60};
+
+    struct Option { int16_t entry; uint16_t duration; uint8_t muscles; double kcal; };
+
+    const WeeklyProblem &prob;
+    const WorkoutCatalog &catalog;
+    vector<Option> options;            // options[0] is rest, then every catalog entry x duration
+    array<double, 7> maxKcalOn{};      // best calories achievable on day d
+    array<double, 8> maxKcalFrom{};    // ... and from day d onward
+    int maxGroupsPerOption = 1;
+    chrono::steady_clock::time_point deadline;
+    bool timedOut = false;
+
+    WeeklySolution best;
+    array<int, 7> current{};
+    array<int, 7> warmIndex{};
+    array<vector<int>, 7> order;       // per-day candidate scratch for dfs
+
+    int optionIndex(const DayChoice &c) const {
+        for (size_t i = 0; i < options.size(); ++i)
+            if (options[i].entry == c.entry && options[i].duration == c.durationMin) return (int)i;
+        return -1;
+    }
+
+    static int overlap(uint8_t a, uint8_t b) { return ((a & b) & (MuscleLegs | MuscleUpper)) ? 1 : 0; }
+
+    // full evaluation of an assignment (used for the warm start)
+    bool evaluate(const array<int, 7> &pick, double &objective, double &kcal) const {
+        uint8_t covered = 0;
+        int rests = 0, pen = 0;
+        kcal = 0;
+        for (int d = 0; d < 7; ++d) {
+            const Option &o = options[pick[d]];
+            if (o.duration > prob.dayLimitMin[d]) return false;
+            rests += o.entry < 0;
+            covered |= o.muscles;
+            kcal += o.kcal;
+            if (d > 0) pen += overlap(options[pick[d - 1]].muscles, o.muscles);
+        }
+        if (rests < prob.minRestDays || (covered & prob.requiredMuscles) != prob.requiredMuscles) return false;
+        objective = calorieCost(kcal) + prob.overlapPenalty * pen;
+        return true;
+    }
+
+    // Best single-day change, repeated until none helps. Carries last week's plan over
+    // to this week's target before the search starts, so the incumbent is already close.
+    void improve(array<int, 7> &pick, double &objective, double &kcal) const {
+        for (bool changed = true; changed && objective > 0;) {
+            changed = false;
+            for (int d = 0; d < 7; ++d) {
+                array<int, 7> trial = pick;
+                for (int i = 0; i < (int)options.size(); ++i) {
+                    if (i == pick[d]) continue;
+                    trial[d] = i;
+                    double obj, k;
+                    if (evaluate(trial, obj, k) && obj < objective) {
+                        pick = trial;
+                        objective = obj;
+                        kcal = k;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    double calorieCost(double kcal) const {
+        return nearbyint(max(0.0, fabs(kcal - prob.targetKcal) - prob.tolerance * prob.targetKcal));
+    }
+
+    // restsNeeded of the remaining days burn nothing: at best the ones with the lowest ceilings
+    double bound(int day, double kcal, int pen, int restsNeeded = 0) const {
+        double hi = kcal + maxKcalFrom[day];
+        if (restsNeeded > 0) {
+            array<double, 7> ceil;
+            int left = 7 - day;
+            copy(maxKcalOn.begin() + day, maxKcalOn.end(), ceil.begin());
+            partial_sort(ceil.begin(), ceil.begin() + min(restsNeeded, left), ceil.begin() + left);
+            for (int k = 0; k < min(restsNeeded, left); ++k) hi -= ceil[k];
+        }
+        double lo = kcal;
+        double nearest = min(max(prob.targetKcal, lo), hi);
+        return calorieCost(nearest) + prob.overlapPenalty * pen;
+    }
+
+    void dfs(int day, double kcal, int rests, uint8_t covered, int pen) {
+        if (timedOut || (best.feasible && best.objective == 0)) return;
+        if ((++best.nodes & 255) == 0 && chrono::steady_clock::now() > deadline) { timedOut = true; return; }
+        if (day == 7) {
+            double obj = calorieCost(kcal) + prob.overlapPenalty * pen;
+            if (!best.feasible || obj < best.objective) {
+                best.feasible = true;
+                best.objective = obj;
+                best.kcal = kcal;
+                for (int d = 0; d < 7; ++d) best.days[d] = {options[current[d]].entry, options[current[d]].duration};
+            }
+            return;
+        }
+        int left = 7 - day;
+        int restsNeeded = max(0, prob.minRestDays - rests);
+        int groupsMissing = __builtin_popcount(prob.requiredMuscles & ~covered);
+        int trainingNeeded = (groupsMissing + maxGroupsPerOption - 1) / maxGroupsPerOption;
+        if (restsNeeded + trainingNeeded > left) return;
+        if (best.feasible && bound(day, kcal, pen, restsNeeded) >= best.objective) return;
+
+        // try the warm-start choice first, then options closest to the calories still needed per day
+        double want = (prob.targetKcal - kcal) / max(1, left - restsNeeded);
+        vector<int> &cand = order[day];
+        cand.clear();
+        for (int i = 0; i < (int)options.size(); ++i)
+            if (options[i].duration <= prob.dayLimitMin[day]) cand.push_back(i);
+        sort(cand.begin(), cand.end(), [&](int a, int b) {
+            if ((a == warmIndex[day]) != (b == warmIndex[day])) return a == warmIndex[day];
+            return fabs(options[a].kcal - want) < fabs(options[b].kcal - want);
+        });
+        for (int c : cand) {
+            const Option &o = options[c];
+            // with only rest days left to place, training options are pointless
+            if (o.entry >= 0 && restsNeeded >= left && trainingNeeded == 0) continue;
+            current[day] = c;
+            int p = pen + (day > 0 ? overlap(options[current[day - 1]].muscles, o.muscles) : 0);
+            dfs(day + 1, kcal + o.kcal, rests + (o.entry < 0), covered | o.muscles, p);
+        }
+    }
+
+public:
+    WeeklyPlanOptimizer(const WeeklyProblem &p, const WorkoutCatalog &c): prob(p), catalog(c) {
+        options.push_back({-1, 0, 0, 0.0});
+        options.reserve(1 + catalog.size() * size(kDurations));
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            const CatalogEntry &e = catalog.at(i);
+            for (uint16_t d : kDurations) {
+                double kcal = caloriesPerKg(e.kind, e.met, d, kIntensity) * prob.weightKg;
+                options.push_back({(int16_t)i, d, e.muscles, kcal});
+            }
+            maxGroupsPerOption = max(maxGroupsPerOption, __builtin_popcount(e.muscles & prob.requiredMuscles));
+        }
+        for (int d = 6; d >= 0; --d) {
+            double m = 0;
+            for (const Option &o : options) if (o.duration <= prob.dayLimitMin[d]) m = max(m, o.kcal);
+            maxKcalOn[d] = m;
+            maxKcalFrom[d] = maxKcalFrom[d + 1] + m;
+        }
+    }
+
+    WeeklySolution solve(const WeeklySolution *warm = nullptr,
+                         chrono::microseconds timeLimit = chrono::microseconds(50000)) {
+        auto t0 = chrono::steady_clock::now();
+        deadline = t0 + timeLimit;
+        best = WeeklySolution();
+        warmIndex.fill(-1);
+        if (warm && warm->feasible) {
+            array<int, 7> pick;
+            bool usable = true;
+            for (int d = 0; d < 7 && usable; ++d) usable = (pick[d] = warmIndex[d] = optionIndex(warm->days[d])) >= 0;
+            double obj, kcal;
+            if (usable && evaluate(pick, obj, kcal)) {
+                improve(pick, obj, kcal);
+                best.feasible = true;
+                best.objective = obj;
+                best.kcal = kcal;
+                for (int d = 0; d < 7; ++d) {
+                    best.days[d] = {options[pick[d]].entry, options[pick[d]].duration};
+                    warmIndex[d] = pick[d];
+                }
+            }
+        }
+        dfs(0, 0.0, 0, 0, 0);
+        best.optimal = !timedOut || (best.feasible && best.objective == 0);
+        best.lowerBound = best.optimal ? best.objective : bound(0, 0.0, 0, prob.minRestDays);
+        best.seconds = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        return best;
+    }
+
+    // Solves many members' weeks in parallel; warm[i] (if given) is member i's previous week.
+    // Each member gets problems[i].timeLimit, or timeLimit when that is 0.
+    static vector<WeeklySolution> solveBatch(const vector<WeeklyProblem> &problems, const WorkoutCatalog &catalog,
+                                             const vector<WeeklySolution> *warm = nullptr, unsigned threads = 0,
+                                             chrono::microseconds timeLimit = chrono::microseconds(50000)) {
+        vector<WeeklySolution> out(problems.size());
+        atomic<size_t> next{0};
+        runParts(workerCount(threads), [&](unsigned) {
+            for (size_t i; (i = next.fetch_add(1)) < problems.size();) {
+                WeeklyPlanOptimizer opt(problems[i], catalog);
+                chrono::microseconds limit = problems[i].timeLimit.count() > 0 ? problems[i].timeLimit : timeLimit;
+                out[i] = opt.solve(warm && i < warm->size() ? &(*warm)[i] : nullptr, limit);
+            }
+        });
+        return out;
+    }
+};
+
+/* ---------------------------
+   FitnessApp controller
+   --------------------------- */
+class FitnessApp {
+    User currentUser;
+    Logger logger;
+    // demonstrate arrays and pointers:
+    // static 1D array of recommended durations for 3 intensity levels
+    int recommendedDurations[3] = {20, 30, 45};
+    // 2D array for sample weekly schedule (7 days x 3 slot types)
+    string weeklySchedule[7][3];
+    // optional rule file consulted before the built-in goal mapping
+    const RecommendationRules *rules = nullptr;
+
+public:
+    explicit FitnessApp(const string &logFile = "fitness_log.txt"): currentUser(), logger(logFile) {
+        // initialize weeklySchedule with defaults
+        for (int d=0; d<7; ++d) {
+            weeklySchedule[d][0] = "Rest";
+            weeklySchedule[d][1] = "Cardio";
+            weeklySchedule[d][2] = "Strength";
+        }
+    }
+
+    // replaces the default weekly schedule with an optimized week:
+    // slots are workout (or "Rest"), workout kind, duration
+    void applyWeeklyPlan(const WeeklySolution &sol, const WorkoutCatalog &catalog) {
+        for (int d=0; d<7; ++d) {
+            const DayChoice &c = sol.days[d];
+            if (c.entry < 0) {
+                weeklySchedule[d][0] = "Rest";
+                weeklySchedule[d][1] = weeklySchedule[d][2] = "-";
+            } else {
+                const CatalogEntry &e = catalog.at((size_t)c.entry);
+                weeklySchedule[d][0] = e.name;
+                weeklySchedule[d][1] = workoutKindName(e.kind);
+                weeklySchedule[d][2] = to_string(c.durationMin) + " min";
+            }
+        }
+    }
+
+    // pointer arithmetic demo (shows addresses and values)
+    void pointerDemo() {
+        int *p = recommendedDurations; // pointer to first element
+        cout << "Pointer demo: recommendedDurations addresses and values\n";
+        for (int i=0; i<3; ++i) {
+            cout << "  idx " << i << " address " << (p + i) << " value " << *(p + i) << "\n";
+        }
+    }
+
+    // create sample workouts (dynamically allocated to show pointer management)
+    WorkoutPlan createSamplePlan() {
+        WorkoutPlan plan;
+        plan.emplace<Cardio>("Jogging", 30, 6, 7.0);
+        plan.emplace<Strength>("Circuit training", 40, 7);
+        plan.emplace<Flexibility>("Yoga", 20, 3);
+        return plan;
+    }
+
+    void useRecommendationRules(const RecommendationRules *r) { rules = r; }
+
+    // mapping user goal to recommended plan
+    WorkoutPlan recommendPlanForUser(const User &u) {
+        WorkoutPlan plan;
+        if (rules) {
+            shared_ptr<const RecommendationTable> table = rules->current();
+            uint16_t id = table->lookup(u);
+            if (id != RecommendationTable::kNoPlan) {
+                table->fillPlan(id, plan);
+                return plan;
+            }
+        }
+        fillDefaultPlan(goalKindOf(u.getGoal()), plan);
+        return plan;
+    }
+
+    // one blocking request: profile lookup, recommendation, estimate, log of the first
+    // workout; -1 for an unknown member. planOut (optional) receives the recommendation.
+    double serveRequest(const UserStore &users, uint64_t memberId, WorkoutPlan *planOut = nullptr) {
+        return serveRequest(users, memberId, logger, planOut);
+    }
+    // Same, logging to `log` instead of the app's logger. Nothing else here writes to the
+    // app, so threads with a Logger each may serve requests at the same time.
+    double serveRequest(const UserStore &users, uint64_t memberId, Logger &log, WorkoutPlan *planOut = nullptr) {
+        int64_t i = users.indexOf(memberId);
+        if (i < 0) return -1.0;
+        User u = users.toUser((size_t)i);
+        WorkoutPlan plan = recommendPlanForUser(u);
+        double kcal = plan.totalCaloriesFor(u);
+        if (plan.size()) log.logSession(u, plan.at(0), plan.at(0).estimateCalories(u));
+        if (planOut) *planOut = std::move(plan);
+        return kcal;
+    }
+    const string &logFile() const { return logger.getFilename(); }
+
+    // weekly plan kcal of members [lo, hi) into out (sized for all members)
+    void scoreMembers(const UserStore &users, vector<float> &out, size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; ++i) {
+            User u = users.toUser(i);
+            out[i] = (float)recommendPlanForUser(u).totalCaloriesFor(u);
+        }
+    }
+
+    // Member-facing recommendation in the scheduler's interactive class.
+    future<WorkoutPlan> submitRecommendation(PriorityScheduler &sched, const User &u) {
+        return sched.submit(WorkClass::Interactive, [this, u] { return recommendPlanForUser(u); });
+    }
+    // Nightly population scoring as a cooperative batch job of `chunk` members per task.
+    future<void> submitPopulationScoring(PriorityScheduler &sched, const UserStore &users, vector<float> &out,
+                                         size_t chunk = 256) {
+        out.assign(users.size(), 0.0f);
+        return sched.forEachChunk(users.size(), chunk,
+                                  [this, &users, &out](size_t lo, size_t hi) { scoreMembers(users, out, lo, hi); });
+    }
+
+#ifdef FITNESS_HAVE_COROUTINES
+    // Coroutine variants. The profile fetch runs on the I/O pool (it stands in for a
+    // database read); recommendation and estimate are CPU work on the loop thread.
+    static Task<optional<User>> fetchProfileAsync(EventLoop &loop, FileIoPool &io, const UserStore &users, uint64_t memberId) {
+        co_return co_await io.run(loop, [&users, memberId]() -> optional<User> {
+            int64_t i = users.indexOf(memberId);
+            if (i < 0) return nullopt;
+            return users.toUser((size_t)i);
+        });
+    }
+    Task<WorkoutPlan> recommendPlanAsync(const User &u) { co_return recommendPlanForUser(u); }
+    static Task<double> estimateAsync(const WorkoutPlan &plan, const Person &p) { co_return plan.totalCaloriesFor(p); }
+
+    // serveRequest() without blocking the loop thread; -1 for an unknown member
+    Task<double> serveRequestAsync(EventLoop &loop, FileIoPool &io, const UserStore &users, uint64_t memberId) {
+        optional<User> u = co_await fetchProfileAsync(loop, io, users, memberId);
+        if (!u) co_return -1.0;
+        WorkoutPlan plan = co_await recommendPlanAsync(*u);
+        double kcal = co_await estimateAsync(plan, *u);
+        if (plan.size()) co_await logger.logSessionAsync(loop, io, *u, plan.at(0), plan.at(0).estimateCalories(*u));
+        co_return kcal;
+    }
+#endif
+
+    // main interactive menu (kept minimal, but demonstrates control structures)
+    void runDemo() {
+        cout << "=== Fitness & Calorie Burn Recommendation System ===\n";
+        // create demo user
+        currentUser = User("Devin M.", 22, 72.5, 175.0, 'M', "Lose weight");
+        cout << "User: " << currentUser.getName() << ", Goal: " << currentUser.getGoal() << "\n";
+
+        pointerDemo();
+
+        WorkoutPlan recommended = recommendPlanForUser(currentUser);
+        recommended.showPlan();
+        double total = recommended.totalCaloriesFor(currentUser);
+        cout << "Estimated total calories for plan: " << fixed << setprecision(2) << total << "\n";
+
+        // demonstrate operator+ merging plans
+        WorkoutPlan extras = createSamplePlan();
+        WorkoutPlan merged = recommended + extras; // operator+
+        cout << "\nMerged plan:\n";
+        merged.showPlan();
+        cout << "Merged calories estimate: " << merged.totalCaloriesFor(currentUser) << "\n";
+
+        // log first workout
+        try {
+            // pick first workout pointer via internal copy: get pointer by creating sample again and delete
+            WorkoutPlan single = createSamplePlan();
+            // For demo, we extract first workout to log (ptr ownership tricky: we'll create a temp cardio)
+            Cardio tempCardio("Temp Jog", 30, 6, 7.0);
+            double cal = tempCardio.estimateCalories(currentUser);
+            logger.logSession(currentUser, tempCardio, cal);
+            cout << "Logged session: " << tempCardio.info() << " calories: " << cal << "\n";
+        } catch (FitnessException &ex) {
+            cerr << "Logging failed: " << ex.what() << "\n";
+        }
+
+        // demonstrate array (1D) traversal with control structures
+        cout << "\nRecommended durations by intensity index:\n";
+        for (int i=0; i<3; ++i) {
+            if (recommendedDurations[i] < 30) cout << "  Short: ";
+            else if (recommendedDurations[i] == 30) cout << "  Medium: ";
+            else cout << "  Long: ";
+            cout << recommendedDurations[i] << " min\n";
+        }
+
+        // 2D array display (weekly schedule)
+        cout << "\nWeekly schedule sample (days x 3 slots):\n";
+        const char* days[] = {"Mon","Tue","Wed","Thu","Fri","Sat","Sun"};
+        for (int d=0; d<7; ++d) {
+            cout << days[d] << ": ";
+            for (int s=0; s<3; ++s) cout << weeklySchedule[d][s] << (s==2? "": " | ");
+            cout << "\n";
+        }
+
+        // demonstrate string / pointer mixing and pointer arithmetic
+        string sample = "HelloFitness";
+        const char *cstr = sample.c_str();
+        cout << "\nString pointer traversal: ";
+        for (size_t i=0; i<sample.size(); ++i) {
+            cout << *(cstr + i); // pointer arithmetic on C-string
+        }
+        cout << "\n";
+
+        // Demonstrate exception: BMI with zero height
+        try {
+            User badUser("ZeroHeight", 30, 70, 0.0, 'F', "Maintain");
+            cout << "Attempting BMI for " << badUser.getName() << "\n";
+            cout << "BMI: " << badUser.bmi() << "\n"; // should throw
+        } catch (FitnessException &ex) {
+            cout << "Caught exception as expected: " << ex.what() << "\n";
+        }
+
+        cout << "\nDemo finished.\n";
+    }
+};
+
+/* ---------------------------
+   RecommendationServer - admission control and load shedding
+   --------------------------- */
+struct AdmissionOptions {
+    bool enabled = true;        // false: unbounded FIFO queue (no shedding)
+    double targetMs = 5.0;      // acceptable standing queue delay
+    double intervalMs = 100.0;  // how long the queue may stay above target
+    unsigned initialLimit = 64; // requests admitted (queued + running)
+    unsigned minLimit = 4;
+    unsigned maxLimit = 4096;
+    double latencyTolerance = 2.0; // latency up to tolerance x best still counts as healthy
+    unsigned windowSamples = 200;  // completions per limit update
+};
+
+// Queue delay gate in the style of CoDel as used by RPC servers: while the queue has
+// drained below target at least once per interval, requests may wait up to interval;
+// once the minimum sojourn stayed above target for a whole interval the queue is
+// standing, and anything older than target is dropped at dequeue.
+class SojournGate {
+    double target, interval;
+    double windowStart = 0.0, windowMin = numeric_limits<double>::infinity();
+    bool overloaded = false;
+
+public:
+    SojournGate(double targetSeconds, double intervalSeconds): target(targetSeconds), interval(intervalSeconds) {}
+
+    // sojourn of the request leaving the queue at `now` (seconds on any monotonic clock)
+    bool shouldDrop(double sojourn, double now) {
+        windowMin = min(windowMin, sojourn);
+        if (now - windowStart >= interval) {
+            overloaded = windowMin > target;
+            windowStart = now;
+            windowMin = numeric_limits<double>::infinity();
+        }
+        return sojourn > (overloaded ? target : interval);
+    }
+    bool isOverloaded() const { return overloaded; }
+};
+
+// Concurrency limit from observed latency (gradient rule): every window the limit is
+// scaled by best/current latency (clamped to [0.5, 1]) and given sqrt(limit) of queue
+// headroom, so it grows while latency stays near the best seen and shrinks as soon as
+// requests start waiting. The best latency is re-learned every 50 windows.
+class AdaptiveConcurrencyLimit {
+    AdmissionOptions opt;
+    double limit;
+    double bestLatency = numeric_limits<double>::infinity();
+    double windowSum = 0.0;
+    unsigned windowCount = 0, windows = 0;
+
+public:
+    explicit AdaptiveConcurrencyLimit(const AdmissionOptions &o): opt(o), limit(o.initialLimit) {}
+
+    void onComplete(double latency) {
+        windowSum += latency;
+        if (++windowCount < opt.windowSamples) return;
+        double mean = windowSum / windowCount;
+        windowSum = 0.0;
+        windowCount = 0;
+        if (++windows % 50 == 0) bestLatency = mean;
+        bestLatency = min(bestLatency, mean);
+        double gradient = clamp(opt.latencyTolerance * bestLatency / mean, 0.5, 1.0);
+        double next = limit * gradient + sqrt(limit);
+        limit = clamp(0.8 * limit + 0.2 * next, (double)opt.minLimit, (double)opt.maxLimit);
+    }
+    unsigned current() const { return (unsigned)limit; }
+};
+
+enum class ResponseStatus : uint8_t { Served, Degraded, Rejected };
+
+struct RecommendationResponse {
+    ResponseStatus status = ResponseStatus::Rejected;
+    double calories = 0.0;
+    PlanInterner::Handle plan; // empty when rejected
+    double latencyMs = 0.0;    // submit to response
+};
+
+struct ServerStats {
+    uint64_t served = 0, degraded = 0, rejectedAtAdmission = 0, droppedFromQueue = 0;
+    size_t peakQueue = 0;
+    unsigned limit = 0;
+};
+
+// Serves recommend-estimate-log requests for a FitnessApp on worker threads. Arrivals
+// beyond the adaptive concurrency limit, and queued requests that waited too long, are
+// shed without running: droppable requests get the member's last recommendation (or
+// the last one served for their goal) as a degraded response, the rest are rejected.
+// Shedding at admission happens on the caller's thread and costs one lock.
+// Workers share the app read-only and each logs to its own shard, <app log>.<worker>
+// (see logFiles()), so requests run in parallel; the app's own logger and whatever is
+// attached to it are not used.
+class RecommendationServer {
+public:
+    using Callback = function<void(const RecommendationResponse &)>;
+
+private:
+    using Clock = chrono::steady_clock;
+    struct Pending {
+        uint64_t member;
+        bool droppable;
+        Clock::time_point arrived;
+        Callback done;
+    };
+    struct Cached {
+        PlanInterner::Handle plan;
+        double calories;
+    };
+
+    FitnessApp &app;
+    const UserStore &users;
+    AdmissionOptions opt;
+    SojournGate gate;
+    AdaptiveConcurrencyLimit limiter;
+    Clock::time_point epoch = Clock::now();
+
+    mutex m; // queue, limiter, gate, stats
+    condition_variable cv;
+    deque<Pending> queue;
+    size_t running = 0;
+    bool stopping = false;
+    ServerStats counters;
+
+    vector<unique_ptr<Logger>> shards; // one per worker
+    mutex cacheLock; // interner and both caches
+    PlanInterner interner;
+    unordered_map<uint64_t, Cached> byMember;
+    array<Cached, 3> byGoal;
+    vector<thread> workers;
+
+    double since(Clock::time_point t, Clock::time_point now) const { return chrono::duration<double>(now - t).count(); }
+
+    // degraded or rejected response, without touching the app; returns which one
+    ResponseStatus shed(const Pending &p, Clock::time_point now) {
+        RecommendationResponse r;
+        if (p.droppable) {
+            lock_guard<mutex> lk(cacheLock);
+            auto it = byMember.find(p.member);
+            const Cached *c = it != byMember.end() ? &it->second : nullptr;
+            if (!c) {
+                int64_t i = users.indexOf(p.member);
+                if (i >= 0) c = &byGoal[(size_t)goalKindOf(users.goal((size_t)i))];
+            }
+            if (c && c->plan) {
+                r.status = ResponseStatus::Degraded;
+                r.plan = c->plan;
+                r.calories = c->calories;
+            }
+        }
+        r.latencyMs = 1e3 * since(p.arrived, now);
+        p.done(r);
+        return r.status;
+    }
+
+    RecommendationResponse serve(const Pending &p, Logger &log) {
+        RecommendationResponse r;
+        WorkoutPlan plan;
+        double kcal = app.serveRequest(users, p.member, log, &plan);
+        if (kcal < 0) return r; // unknown member
+        r.status = ResponseStatus::Served;
+        r.calories = kcal;
+        lock_guard<mutex> lk(cacheLock);
+        r.plan = interner.intern(std::move(plan));
+        byMember[p.member] = {r.plan, kcal};
+        byGoal[(size_t)goalKindOf(users.goal((size_t)users.indexOf(p.member)))] = {r.plan, kcal};
+        return r;
+    }
+
+    void workerLoop(Logger &log) {
+        unique_lock<mutex> lk(m);
+        for (;;) {
+            cv.wait(lk, [&] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            Pending p = std::move(queue.front());
+            queue.pop_front();
+            Clock::time_point now = Clock::now();
+            if (opt.enabled && gate.shouldDrop(since(p.arrived, now), since(epoch, now))) {
+                ++counters.droppedFromQueue;
+                lk.unlock();
+                ResponseStatus st = shed(p, now);
+                lk.lock();
+                if (st == ResponseStatus::Degraded) ++counters.degraded;
+                continue;
+            }
+            ++running;
+            lk.unlock();
+            RecommendationResponse r = serve(p, log);
+            Clock::time_point end = Clock::now();
+            r.latencyMs = 1e3 * since(p.arrived, end);
+            p.done(r);
+            lk.lock();
+            --running;
+            if (r.status == ResponseStatus::Served) ++counters.served;
+            limiter.onComplete(since(p.arrived, end));
+        }
+    }
+
+public:
+    RecommendationServer(FitnessApp &application, const UserStore &store, const AdmissionOptions &options = AdmissionOptions(),
+                         unsigned threads = 0)
+        : app(application), users(store), opt(options), gate(options.targetMs / 1e3, options.intervalMs / 1e3),
+          limiter(options) {
+        unsigned n = workerCount(threads);
+        for (unsigned i = 0; i < n; ++i) shards.push_back(make_unique<Logger>(app.logFile() + "." + to_string(i)));
+        for (unsigned i = 0; i < n; ++i) workers.emplace_back([this, i] { workerLoop(*shards[i]); });
+    }
+    // finishes queued requests
+    ~RecommendationServer() {
+        {
+            lock_guard<mutex> lk(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (thread &t : workers) t.join();
+    }
+    RecommendationServer(const RecommendationServer &) = delete;
+    RecommendationServer &operator=(const RecommendationServer &) = delete;
+
+    // Queues a request; done runs on a worker, or right here when the request is shed.
+    // Returns false when it was shed at admission.
+    bool submit(uint64_t memberId, bool droppable, Callback done) {
+        Pending p{memberId, droppable, Clock::now(), std::move(done)};
+        {
+            lock_guard<mutex> lk(m);
+            bool admit = !opt.enabled || queue.size() + running < limiter.current();
+            if (admit) {
+                queue.push_back(std::move(p));
+                counters.peakQueue = max(counters.peakQueue, queue.size());
+            } else {
+                ++counters.rejectedAtAdmission;
+            }
+            if (admit) {
+                cv.notify_one();
+                return true;
+            }
+        }
+        if (shed(p, p.arrived) == ResponseStatus::Degraded) {
+            lock_guard<mutex> lk(m);
+            ++counters.degraded;
+        }
+        return false;
+    }
+
+    ServerStats stats() {
+        lock_guard<mutex> lk(m);
+        ServerStats s = counters;
+        s.limit = opt.enabled ? limiter.current() : 0;
+        return s;
+    }
+    // the per-worker session logs
+    vector<string> logFiles() const {
+        vector<string> files;
+        for (const auto &l : shards) files.push_back(l->getFilename());
+        return files;
+    }
+};
+
+/* ---------------------------
+   Benchmarks (fitness_app bench <name>)
+   --------------------------- */
+inline double secondsSince(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+// 1M submissions per simulated day, 10% of them client retries
+void benchDedup() {
+    const size_t perDay = 1000000, days = 5;
+    SessionDeduplicator dedup(3, perDay);
+    mt19937_64 rng(42);
+    vector<uint64_t> ids(perDay);
+    size_t accepted = 0, dups = 0;
+    double total = 0.0;
+    for (size_t d = 0; d < days; ++d) {
+        for (size_t i = 0; i < perDay; ++i) ids[i] = (i % 10 == 9) ? ids[rng() % i] : rng();
+        int64_t dayStart = 1700000000 + (int64_t)d * 86400;
+        auto t0 = chrono::steady_clock::now();
+        for (size_t i = 0; i < perDay; ++i) {
+            DedupResult r = dedup.checkHash(ids[i], dayStart + (int64_t)(i % 86400), dayStart + 86400);
+            accepted += r == DedupResult::Accepted;
+            dups += r == DedupResult::Duplicate;
+        }
+        total += secondsSince(t0);
+    }
+    size_t n = perDay * days;
+    cout << "dedup: " << n << " checks, " << accepted << " accepted, " << dups << " duplicates, "
+         << fixed << setprecision(1) << total * 1e9 / n << " ns/check, "
+         << dedup.bloomNegativeCount() << " answered by Bloom filter, "
+         << dedup.memoryBytes() / (1 << 20) << " MiB live for 3 days\n";
+
+    // quiet days against the same sizing: the exact sets only grow with what is flushed
+    SessionDeduplicator quiet(3, perDay);
+    const size_t quietPerDay = 20000;
+    for (size_t d = 0; d < 3; ++d) {
+        int64_t dayStart = 1700000000 + (int64_t)d * 86400;
+        for (size_t i = 0; i < quietPerDay; ++i) {
+            ids[i] = (i % 10 == 9) ? ids[rng() % i] : rng();
+            quiet.checkHash(ids[i], dayStart + (int64_t)(i % 86400), dayStart + 86400);
+        }
+    }
+    cout << "dedup: " << quietPerDay << " ids/day against the same sizing hold " << setprecision(2)
+         << quiet.memoryBytes() / double(1 << 20) << " MiB for 3 days\n";
+
+    // a client clock a year ahead must not expire today's ids; a released id is accepted again
+    int64_t now = 1700000000 + (int64_t)days * 86400;
+    SessionDeduplicator small(3, 1000);
+    small.checkHash(1, now, now);
+    small.checkHash(2, now + 365 * 86400, now);
+    bool kept = small.checkHash(1, now, now) == DedupResult::Duplicate;
+    small.releaseHash(3, now, now); // never seen: no effect
+    small.checkHash(3, now, now);
+    small.releaseHash(3, now, now);
+    bool released = small.checkHash(3, now, now) == DedupResult::Accepted && small.checkHash(3, now, now) == DedupResult::Duplicate;
+    cout << "dedup: future-dated session keeps the window " << (kept ? "yes" : "NO")
+         << ", released id accepted again " << (released ? "yes" : "NO") << "\n";
+}
+
+// members whose true burn differs from the MET formula; RLS should recover it
+void benchCalibration() {
+    const size_t users = 1000000, perUser = 20;
+    mt19937 rng(7);
+    UserStore store;
+    SessionLog log;
+    store.reserve(users);
+    log.reserve(users * perUser);
+    vector<double> trueMult(users);
+    uniform_real_distribution<double> mult(0.7, 1.4), w(50, 120);
+    for (size_t u = 0; u < users; ++u) {
+        store.add(u, "member", 20 + (int)(rng() % 50), w(rng), 170, (rng() & 1) ? 'M' : 'F', "Maintain");
+        trueMult[u] = mult(rng);
+    }
+    const ProfileColumns &prof = store.columns();
+    for (size_t u = 0; u < users; ++u) {
+        for (size_t s = 0; s < perUser; ++s) {
+            // a catalog exercise, so sessions of one kind carry different METs
+            const ProgramExercise &ex = kProgramExercises[rng() % size(kProgramExercises)];
+            WorkoutKind k = ex.kind;
+            int dur = 20 + (int)(rng() % 40), inten = 1 + (int)(rng() % 10);
+            double truth = caloriesPerKg(k, ex.met, dur, inten) * prof.weightKg[u] * trueMult[u];
+            // invert Keytel to get the heart rate that explains `truth`
+            double perMin = truth / dur * 4.184;
+            double hr = prof.gender[u] == 'F'
+                ? (perMin + 20.4022 + 0.1263 * prof.weightKg[u] - 0.074 * prof.age[u]) / 0.4472
+                : (perMin + 55.0969 - 0.1988 * prof.weightKg[u] - 0.2017 * prof.age[u]) / 0.6309;
+            log.append((uint32_t)u, 1700000000 + (int64_t)s * 86400, 0, k, (uint16_t)dur, (uint8_t)inten,
+                       (uint16_t)min(250.0, max(0.0, hr + 0.5)), (float)truth, (float)ex.met);
+        }
+    }
+    CalibrationStore cal;
+    auto t0 = chrono::steady_clock::now();
+    cal.refit(store, log);
+    double refitS = secondsSince(t0);
+
+    // estimates for HIIT (MET 10, not the cardio default of 7)
+    double errFixed = 0, errCal = 0, sink = 0;
+    t0 = chrono::steady_clock::now();
+    for (size_t u = 0; u < users; ++u) {
+        int inten = 1 + (int)(u % 10);
+        double truth = caloriesPerKg(WorkoutKind::Cardio, 10.0, 30, inten) * prof.weightKg[u] * trueMult[u];
+        double fixedEst = caloriesPerKg(WorkoutKind::Cardio, 10.0, 30, inten) * prof.weightKg[u];
+        double calEst = cal.at(u).estimate(WorkoutKind::Cardio, 10.0, 30, inten, prof.weightKg[u]);
+        errFixed += fabs(fixedEst - truth) / truth;
+        errCal += fabs(calEst - truth) / truth;
+        sink += calEst;
+    }
+    double evalS = secondsSince(t0);
+    cout << "calibration: refit " << users * perUser << " sessions for " << users << " members in " << fixed
+         << setprecision(3) << refitS << " s (" << cal.memoryBytes() / (1 << 20) << " MiB of models); "
+         << "mean abs error fixed MET " << setprecision(1) << 100 * errFixed / users << "% -> calibrated "
+         << 100 * errCal / users << "%; " << setprecision(1) << evalS * 1e9 / users << " ns/estimate"
+         << (sink < 0 ? "!" : "") << "\n";
+
+    // years of sessions at one intensity, then a few hard ones: the covariance of the
+    // unexcited slope must not wind up and swing the model
+    UserCalibration steady;
+    double weightKg = 70, steadyMult = 1.2;
+    for (int i = 0; i < 5000; ++i)
+        steady.observe(WorkoutKind::Cardio, 7.0, 40, 5, weightKg, caloriesPerKg(WorkoutKind::Cardio, 7.0, 40, 5) * weightKg * steadyMult);
+    for (int i = 0; i < 5; ++i)
+        steady.observe(WorkoutKind::Cardio, 7.0, 40, 9, weightKg, caloriesPerKg(WorkoutKind::Cardio, 7.0, 40, 9) * weightKg * steadyMult);
+    double ratio = steady.estimate(WorkoutKind::Cardio, 7.0, 40, 5, weightKg) / (caloriesPerKg(WorkoutKind::Cardio, 7.0, 40, 5) * weightKg);
+    cout << "calibration: after 5000 same-intensity sessions the multiplier is " << setprecision(3) << ratio
+         << " (true " << steadyMult << ")\n";
+}
+
+// two years of near-daily weigh-ins for 100k members
+void benchWeightHistory() {
+    const size_t users = 100000, days = 730;
+    BodyMetricHistory history;
+    mt19937 rng(11);
+    normal_distribution<double> noise(0.0, 0.3);
+    auto t0 = chrono::steady_clock::now();
+    for (size_t u = 0; u < users; ++u) {
+        double w = 60 + (double)(rng() % 50), trend = ((int)(rng() % 21) - 10) / 3650.0;
+        int64_t ts = 1700000000 + (int64_t)(rng() % 3600);
+        for (size_t d = 0; d < days; ++d) {
+            if (rng() % 10 == 0) continue; // skipped weigh-in
+            // same time of day give or take a few minutes
+            history.record(u, BodyMetric::WeightKg, ts + (int64_t)d * 86400 + (int64_t)(rng() % 600), w + trend * d + noise(rng));
+        }
+    }
+    double appendS = secondsSince(t0);
+    size_t n = history.sampleCount();
+    t0 = chrono::steady_clock::now();
+    double sink = 0;
+    for (size_t u = 0; u < users; ++u) {
+        auto weekly = history.find(u, BodyMetric::WeightKg)->downsample(1700000000, 1700000000 + 365 * 86400, 7 * 86400);
+        for (auto &b : weekly) sink += b.mean;
+        sink += history.weightAt(u, 1700000000 + 400 * 86400, 0);
+    }
+    double queryS = secondsSince(t0);
+    cout << "weight history: " << n << " samples, " << fixed << setprecision(2)
+         << (double)history.compressedBytes() / n << " bytes/sample (vs 16 raw), append "
+         << setprecision(1) << appendS * 1e9 / n << " ns/sample, "
+         << "1-year weekly downsample + point lookup " << setprecision(1) << queryS * 1e6 / users << " us/member"
+         << (sink < 0 ? "!" : "") << "\n";
+
+    // re-estimates use each session's own MET (HIIT at 10, not the cardio default) and the
+    // weight on the day
+    UserStore two;
+    two.add(0, "", 30, 80, 175, 'M', "Maintain");
+    two.add(1, "", 30, 80, 175, 'F', "Maintain");
+    SessionLog sessions;
+    int64_t day = 1700000000 + 200 * 86400;
+    sessions.append(0, day, sessions.workoutNames.intern("HIIT"), WorkoutKind::Cardio, 30, 8, 0, 0, 10.0f);
+    sessions.append(1, day, sessions.workoutNames.intern("Run"), WorkoutKind::Cardio, 30, 8, 0, 0);
+    vector<float> recomputed = recomputeSessionCalories(sessions, two, history);
+    bool metOk = true;
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        double met = i == 0 ? 10.0 : defaultMet(WorkoutKind::Cardio);
+        double want = caloriesPerKg(WorkoutKind::Cardio, met, 30, 8) * history.weightAt(i, day, 80);
+        metOk &= fabs(recomputed[i] - want) < 1e-3 * want;
+    }
+    cout << "weight history: recomputed calories use the logged MET " << (metOk ? "yes" : "NO") << "\n";
+}
+
+// trend updates for 10M members, then a population ranking pass
+void benchWeightTrend() {
+    const size_t users = 10000000, samples = 8;
+    UserStore store;
+    store.reserve(users);
+    const char *goals[] = {"Lose weight", "Build muscle", "Maintain"};
+    WeightTrendStore trends;
+    mt19937 rng(5);
+    for (size_t u = 0; u < users; ++u) store.add(u, "", 30, 80, 175, 'M', goals[u % 3]);
+    auto t0 = chrono::steady_clock::now();
+    for (size_t s = 0; s < samples; ++s)
+        for (size_t u = 0; u < users; ++u)
+            trends.observe(u, 1700000000 + (int64_t)s * 7 * 86400, 80 + ((int)(u % 41) - 20) * 0.05 * s + (rng() % 5) * 0.1);
+    double updateS = secondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    vector<TrendDeviation> top = trends.rankByDeviation(store, 10);
+    double rankS = secondsSince(t0);
+    optional<int64_t> eta = trends.at(0).projectedGoalDate(70.0);
+    cout << "weight trend: " << users * samples << " updates in " << fixed << setprecision(2) << updateS << " s ("
+         << setprecision(1) << updateS * 1e9 / (users * samples) << " ns each), ranked " << users << " members in "
+         << setprecision(3) << rankS << " s; top deviation " << setprecision(2) << (top.empty() ? 0.0 : top[0].deviation)
+         << " kg/week; member 0 reaches 70 kg in "
+         << (eta ? to_string((*eta - trends.at(0).lastTs) / 86400) + " days" : string("never")) << "\n";
+}
+
+// 1M foods built into a mapped database, lookups, then daily nets for 1M members
+// minimum edit distance between q and any prefix of s (reference for the index)
+static int prefixEditDistance(const string &q, const string &s) {
+    vector<int> prev(s.size() + 1), cur(s.size() + 1);
+    for (size_t j = 0; j <= s.size(); ++j) prev[j] = (int)j;
+    for (size_t i = 1; i <= q.size(); ++i) {
+        cur[0] = (int)i;
+        for (size_t j = 1; j <= s.size(); ++j)
+            cur[j] = min({prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + (q[i - 1] != s[j - 1])});
+        swap(prev, cur);
+    }
+    return *min_element(prev.begin(), prev.end());
+}
+
+// Query timing on a 100k-name catalog, plus typo queries checked against a brute-force
+// prefix edit distance on a smaller one (long names, single edits anywhere).
+void benchCatalog() {
+    mt19937 rng(78);
+    const char *words[] = {"swimming", "freestyle", "interval", "bench", "press", "squat", "yoga", "flow", "rowing",
+                           "tempo", "run", "cycling", "hill", "stretch", "mobility", "pilates", "core", "circuit"};
+    auto randomName = [&](int parts) {
+        string s;
+        for (int p = 0; p < parts; ++p) s += (p ? " " : "") + string(words[rng() % 18]);
+        return s;
+    };
+    auto catalogOf = [&](size_t n) {
+        vector<CatalogEntry> e;
+        e.push_back({"Swimming freestyle", WorkoutKind::Cardio, 8.0, 600});
+        e.push_back({"abcdefgXzzzzzzzz", WorkoutKind::Cardio, 7.0, 1});
+        while (e.size() < n) e.push_back({randomName(2 + rng() % 4) + " " + to_string(rng() % 1000), WorkoutKind::Cardio, 7.0, (uint32_t)(rng() % 1000)});
+        return WorkoutCatalog(std::move(e));
+    };
+    auto typo = [&](string s) {
+        size_t at = rng() % s.size();
+        switch (rng() % 3) {
+            case 0: s[at] = (char)('a' + rng() % 26); break;
+            case 1: s.erase(at, 1); break;
+            default: s.insert(at, 1, (char)('a' + rng() % 26)); break;
+        }
+        return s;
+    };
+
+    // correctness: every returned distance is the true one, and nothing within reach is missed
+    WorkoutCatalog small = catalogOf(2000);
+    vector<string> names;
+    for (size_t i = 0; i < small.size(); ++i) {
+        string n = small.at(i).name;
+        for (char &c : n) c = (char)tolower((unsigned char)c);
+        names.push_back(n);
+    }
+    vector<string> queries = {"swiming", "swimmign", "swimmingg", "abcdefgh"};
+    for (int i = 0; i < 300; ++i) {
+        const string &n = names[rng() % names.size()];
+        queries.push_back(typo(n.substr(0, min<size_t>(n.size(), 8 + rng() % 20))));
+    }
+    size_t checked = 0, wrong = 0;
+    for (const string &q : queries) {
+        int maxDist = q.size() < 4 ? 0 : q.size() < 8 ? 1 : 2;
+        vector<int> dist(names.size());
+        size_t within = 0;
+        int bestTrue = INT_MAX;
+        for (size_t i = 0; i < names.size(); ++i) {
+            dist[i] = prefixEditDistance(q, names[i]);
+            if (dist[i] <= maxDist) ++within;
+            bestTrue = min(bestTrue, dist[i]);
+        }
+        const size_t k = 10;
+        vector<CatalogMatch> got = small.searchIndex().search(q, k);
+        bool ok = got.size() == min(k, within) && (got.empty() || got[0].distance == bestTrue);
+        for (const CatalogMatch &m : got) ok = ok && m.distance == dist[m.entry];
+        ++checked;
+        if (!ok) {
+            ++wrong;
+            if (wrong <= 5) cout << "  catalog search mismatch for \"" << q << "\": " << got.size() << " hits, " << within << " expected\n";
+        }
+    }
+
+    WorkoutCatalog big = catalogOf(100000);
+    vector<string> prefixes, typos;
+    for (int i = 0; i < 2000; ++i) {
+        string n = big.at(rng() % big.size()).name;
+        prefixes.push_back(n.substr(0, 1 + rng() % 6));
+        typos.push_back(typo(n.substr(0, min<size_t>(n.size(), 6 + rng() % 10))));
+    }
+    size_t hits = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (const string &p : prefixes) hits += big.autocomplete(p, 5).size();
+    double autoS = secondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    for (const string &q : typos) hits += big.search(q, 5).size();
+    double fuzzyS = secondsSince(t0);
+    cout << "catalog: " << big.size() << " names, " << big.searchIndex().nodeCount() << " trie nodes; autocomplete "
+         << fixed << setprecision(2) << autoS * 1e6 / prefixes.size() << " us, typo search " << fuzzyS * 1e6 / typos.size()
+         << " us per query (" << hits << " hits); " << checked - wrong << "/" << checked
+         << " typo queries match brute force\n";
+}
+
+void benchFood() {
+    const size_t foods = 1000000, users = 1000000;
+    filesystem::path tmp = filesystem::temp_directory_path();
+    string csvPath = (tmp / "fitness_bench_foods.csv").string(), dbPath = (tmp / "fitness_bench_foods.db").string();
+    mt19937 rng(3);
+    const char *words[] = {"apple", "banana", "bread", "chicken", "rice", "oat", "yogurt", "salmon", "egg", "bean",
+                           "cheese", "pasta", "potato", "tofu", "milk", "nut", "berry", "soup", "salad", "wrap"};
+    {
+        ofstream ofs(csvPath);
+        ofs << "food_id,name,kcal_per_100g,protein_g,carbs_g,fat_g\n";
+        for (size_t i = 0; i < foods; ++i)
+            ofs << i * 7 + 1 << "," << words[rng() % 20] << " " << words[rng() % 20] << " " << i << ","
+                << 50 + rng() % 500 << "," << rng() % 30 << "," << rng() % 60 << "," << rng() % 30 << "\n";
+    }
+    auto t0 = chrono::steady_clock::now();
+    size_t built = FoodDatabase::build(csvPath, dbPath);
+    double buildS = secondsSince(t0);
+    FoodDatabase db;
+    db.open(dbPath);
+
+    const int lookups = 100000;
+    size_t found = 0;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i) found += db.byId((uint64_t)(rng() % foods) * 7 + 1) != nullptr;
+    double idUs = secondsSince(t0) * 1e6 / lookups;
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        string q = string(words[rng() % 20]) + " " + string(words[rng() % 20]).substr(0, 2);
+        found += db.byPrefix(q, 10).size();
+    }
+    double prefixUs = secondsSince(t0) * 1e6 / lookups;
+
+    IntakeLog intake;
+    SessionLog sessions;
+    const int64_t day = 1700000000 / 86400;
+    for (size_t i = 0; i < users * 4; ++i)
+        intake.append((uint32_t)(rng() % users), day * 86400 + (int64_t)(rng() % 86400), (uint64_t)(rng() % foods) * 7 + 1,
+                      50.0f + rng() % 300);
+    for (size_t i = 0; i < users; ++i)
+        sessions.append((uint32_t)(rng() % users), day * 86400 + (int64_t)(rng() % 86400), 0, WorkoutKind::Cardio, 30, 5, 0, 250.0f);
+    t0 = chrono::steady_clock::now();
+    vector<DailyNet> nets = dailyNetCalories(intake, sessions, db, users, day);
+    double netS = secondsSince(t0);
+
+    // a truncated copy and one whose id index points past the end must both be refused
+    int rejected = 0;
+    string badPath = (tmp / "fitness_bench_foods_bad.db").string();
+    {
+        MappedFile good(dbPath);
+        string bytes(good.data(), good.size());
+        auto refused = [&](const string &b) {
+            ofstream(badPath, ios::binary | ios::trunc).write(b.data(), (streamsize)b.size());
+            FoodDatabase bad;
+            try {
+                bad.open(badPath);
+            } catch (const FitnessException &) {
+                return bad.size() == 0;
+            }
+            return false;
+        };
+        rejected += refused(bytes.substr(0, bytes.size() / 2));
+        uint64_t idIndexOffset;
+        memcpy(&idIndexOffset, bytes.data() + 24, sizeof idIndexOffset);
+        uint64_t pastEnd = built;
+        memcpy(&bytes[idIndexOffset + 8], &pastEnd, sizeof pastEnd);
+        rejected += refused(bytes);
+    }
+    remove(badPath.c_str());
+    remove(csvPath.c_str());
+    remove(dbPath.c_str());
+    cout << "food: built " << built << " foods in " << fixed << setprecision(2) << buildS << " s; by id "
+         << setprecision(2) << idUs << " us, by prefix (top 10) " << prefixUs << " us; daily net for " << users
+         << " members (" << intake.size() << " intake rows) in " << setprecision(3) << netS << " s, member 0 net "
+         << setprecision(0) << nets[0].net() << " kcal (" << found << " hits); corrupt files refused " << rejected
+         << "/2\n";
+}
+
+// nightly program generation and whole-program projections for 1M members
+void benchPrograms() {
+    const size_t users = 1000000;
+    UserStore store;
+    store.reserve(users);
+    const char *goals[] = {"Lose weight", "Build muscle", "Maintain"};
+    mt19937 rng(9);
+    for (size_t u = 0; u < users; ++u)
+        store.add(u, "", 18 + (int)(rng() % 60), 50 + (double)(rng() % 70), 155 + (double)(rng() % 45), 'F', goals[u % 3]);
+    auto t0 = chrono::steady_clock::now();
+    vector<TrainingProgram> programs = generatePrograms(store);
+    double genS = secondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    double total = 0;
+    for (size_t u = 0; u < users; ++u) total += programs[u].projectedCalories(store.columns().weightKg[u]);
+    double projS = secondsSince(t0);
+    WeekPrescription w3 = programs[0].week(3), w4 = programs[0].week(4);
+    cout << "programs: generated " << users << " in " << fixed << setprecision(3) << genS << " s ("
+         << sizeof(TrainingProgram) << " bytes each), projected all in " << projS << " s; avg program "
+         << setprecision(0) << total / users << " kcal; member 0 week 4 " << (w3.deload ? "deload" : "build")
+         << " first session " << w3.sessions[0].durationMin << " min -> week 5 " << w4.sessions[0].durationMin << " min\n";
+
+    // a hand-built program with no mesocycle length runs as one long build block
+    TrainingProgram flat = programs[0];
+    flat.mesoLength = 0;
+    bool noDeload = true;
+    for (int k = 0; k < flat.weeks; ++k) noDeload &= !flat.week(k).deload;
+    cout << "programs: mesoLength 0 projects " << setprecision(0) << flat.projectedCalories(70.0) << " kcal, no deloads "
+         << (noDeload ? "yes" : "NO") << "\n";
+}
+
+// cold solves for 2000 members, then warm-started re-solves with a 3% higher target
+void benchWeeklyOptimizer() {
+    const size_t users = 2000;
+    WorkoutCatalog catalog = WorkoutCatalog::defaults();
+    mt19937 rng(21);
+    vector<WeeklyProblem> problems(users);
+    for (WeeklyProblem &p : problems) {
+        p.weightKg = 50 + rng() % 60;
+        p.targetKcal = 1200 + rng() % 2500;
+        p.minRestDays = 1 + (int)(rng() % 2);
+        for (uint16_t &lim : p.dayLimitMin) lim = (uint16_t)(rng() % 4 == 0 ? 30 : 45 + rng() % 46);
+    }
+    auto report = [&](const char *label, const vector<WeeklySolution> &sols, double wall) {
+        size_t feasible = 0, optimal = 0;
+        double gap = 0, objective = 0, nodes = 0;
+        for (const WeeklySolution &s : sols) {
+            feasible += s.feasible;
+            optimal += s.optimal;
+            if (s.feasible) {
+                gap += s.gap();
+                objective += s.objective;
+            }
+            nodes += (double)s.nodes;
+        }
+        cout << "  " << label << ": " << fixed << setprecision(1) << wall * 1e3 << " ms, " << feasible << "/" << users
+             << " feasible, " << optimal << " optimal, mean objective " << objective / max<size_t>(1, feasible)
+             << ", mean gap " << gap / max<size_t>(1, feasible) << " kcal, " << setprecision(0) << nodes / users
+             << " nodes/member\n";
+    };
+    cout << "weekly optimizer (" << users << " members, 10 ms limit each, 2% calorie tolerance):\n";
+    auto t0 = chrono::steady_clock::now();
+    const chrono::microseconds limit(10000);
+    vector<WeeklySolution> first = WeeklyPlanOptimizer::solveBatch(problems, catalog, nullptr, 0, limit);
+    report("cold", first, secondsSince(t0));
+    for (WeeklyProblem &p : problems) p.targetKcal *= 1.03;
+    t0 = chrono::steady_clock::now();
+    vector<WeeklySolution> cold = WeeklyPlanOptimizer::solveBatch(problems, catalog, nullptr, 0, limit);
+    report("next week, cold", cold, secondsSince(t0));
+    t0 = chrono::steady_clock::now();
+    vector<WeeklySolution> warm = WeeklyPlanOptimizer::solveBatch(problems, catalog, &first, 0, limit);
+    report("next week, warm", warm, secondsSince(t0));
+
+    // per-member budgets: every other member gets 20 us instead of the batch's 10 ms
+    for (size_t i = 0; i < users; i += 2) problems[i].timeLimit = chrono::microseconds(20);
+    t0 = chrono::steady_clock::now();
+    vector<WeeklySolution> mixed = WeeklyPlanOptimizer::solveBatch(problems, catalog, nullptr, 0, limit);
+    report("next week, cold, 20 us / 10 ms", mixed, secondsSince(t0));
+    double slowest[2] = {0, 0};
+    size_t optimal[2] = {0, 0};
+    for (size_t i = 0; i < users; ++i) {
+        slowest[i % 2] = max(slowest[i % 2], mixed[i].seconds);
+        optimal[i % 2] += mixed[i].optimal;
+    }
+    cout << "  20 us budget: " << optimal[0] << "/" << users / 2 << " optimal, slowest " << setprecision(3)
+         << slowest[0] * 1e3 << " ms; 10 ms budget: " << optimal[1] << "/" << users / 2 << " optimal, slowest "
+         << slowest[1] * 1e3 << " ms\n";
+}
+
+// 1M members in 20k teams / 500 gyms / 10 regions; update throughput with readers running
+void benchRollup() {
+    HierarchyRollup tree;
+    const size_t regions = 10, gymsPer = 50, teamsPer = 40, membersPer = 50;
+    vector<uint32_t> members, teams;
+    for (size_t r = 0; r < regions; ++r) {
+        uint32_t rn = tree.addRegion("region " + to_string(r));
+        for (size_t g = 0; g < gymsPer; ++g) {
+            uint32_t gn = tree.addGym(rn, "gym");
+            for (size_t t = 0; t < teamsPer; ++t) {
+                uint32_t tn = tree.addTeam(gn, "team");
+                teams.push_back(tn);
+                for (size_t m = 0; m < membersPer; ++m) members.push_back(tree.addMember(tn));
+            }
+        }
+    }
+    mt19937 rng(4);
+    const size_t events = 5000000;
+    vector<pair<uint32_t, double>> batch;
+    atomic<bool> stop{false};
+    atomic<uint64_t> reads{0}, liveSnapshots{0};
+    thread reader([&]() {
+        mt19937 r2(8);
+        while (!stop.load(memory_order_relaxed)) {
+            RollupTotals t = tree.totals(teams[r2() % teams.size()]);
+            reads.fetch_add(1 + (t.kcal < 0), memory_order_relaxed);
+            // whole-tree snapshots must also finish while the writer keeps going
+            if (r2() % 65536 == 0 && tree.snapshot().size() == tree.size()) liveSnapshots.fetch_add(1, memory_order_relaxed);
+        }
+    });
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < events / 2; ++i) tree.record(members[rng() % members.size()], 300.0);
+    double singleS = secondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < events / 2; i += 1024) {
+        batch.clear();
+        for (size_t j = 0; j < 1024 && i + j < events / 2; ++j) batch.push_back({members[rng() % members.size()], 300.0});
+        tree.recordBatch(batch);
+    }
+    double batchS = secondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < 100000; ++i) tree.move(members[rng() % members.size()], teams[rng() % teams.size()]);
+    double moveS = secondsSince(t0);
+    stop = true;
+    reader.join();
+    t0 = chrono::steady_clock::now();
+    vector<RollupTotals> snap = tree.snapshot();
+    double snapS = secondsSince(t0);
+    double regionSum = 0;
+    for (uint32_t i = 0; i < snap.size(); ++i) if (tree.parentOf(i) == UINT32_MAX) regionSum += snap[i].kcal;
+    cout << "rollup: " << members.size() << " members; single updates " << fixed << setprecision(1)
+         << events / 2 / singleS / 1e6 << " M/s, batched " << events / 2 / batchS / 1e6 << " M/s, moves "
+         << setprecision(0) << moveS * 1e9 / 100000 << " ns, snapshot of " << snap.size() << " nodes "
+         << setprecision(1) << snapS * 1e3 << " ms (regions sum " << setprecision(0) << regionSum << " = "
+         << events * 300.0 << "), " << reads.load() << " concurrent O(1) reads, " << liveSnapshots.load()
+         << " snapshots during writes\n";
+
+    // only members take sessions, and a batch with a bad id records nothing
+    RollupTotals before = tree.totals(members[0]);
+    int refused = 0;
+    for (uint32_t bad : {teams[0], (uint32_t)tree.size()}) {
+        try { tree.record(bad, 1.0); } catch (const FitnessException &) { ++refused; }
+        try { tree.recordBatch({{members[0], 1.0}, {bad, 1.0}}); } catch (const FitnessException &) { ++refused; }
+    }
+    RollupTotals after = tree.totals(members[0]);
+    cout << "rollup: non-member and out-of-range ids refused " << refused << "/4, totals untouched "
+         << (after.kcal == before.kcal && after.sessions == before.sessions ? "yes" : "NO") << "\n";
+
+    // sessions logged for a known member reach the rollup
+    string path = (filesystem::temp_directory_path() / "fitness_bench_rollup.txt").string();
+    remove(path.c_str());
+    HierarchyRollup gymTree;
+    uint32_t team = gymTree.addTeam(gymTree.addGym(gymTree.addRegion("north"), "gym"), "team");
+    gymTree.addMember(team, "Ann", 7);
+    Logger logger(path);
+    logger.attachRollup(&gymTree);
+    bool wasTracing = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    {
+        User ann("Ann", 30, 60.0, 165.0, 'F', "fit");
+        Cardio run("Run", 30, 7, 9.8);
+        for (int i = 0; i < 3; ++i) logger.logSession(ann, run, 300.0, 7);
+        logger.logSession(ann, run, 300.0, 8); // not in the rollup
+    }
+    Person::traceLifecycle = wasTracing;
+    remove(path.c_str());
+    cout << "rollup: logged sessions fed to the region total: " << gymTree.totals(0).sessions << "/3\n";
+}
+
+// ~2000 generated rules over 50k members and 5M time-ordered sessions
+void benchAchievements() {
+    const char *metrics[] = {"count", "kcal", "minutes", "streak"};
+    const char *kinds[] = {"", " cardio", " strength", " flexibility"};
+    const int mins[] = {0, 30, 60};
+    string rules = "five-a-week: count per week >= 5\nbig-burn: kcal per day >= 1000\n";
+    size_t generated = 0;
+    for (int m = 0; m < 4; ++m)
+        for (int k = 0; k < 4; ++k)
+            for (int mi : mins)
+                for (const char *win : {"day", "week"})
+                    for (int t = 1; t <= 21; ++t) {
+                        // thresholds a typical member (~2 sessions a week) reaches only a few
+                        // times a year; badges re-arm every window, so weekly ones sit higher
+                        double scale = win[0] == 'w' ? 2.5 : 1.0;
+                        double first = scale * (m == 0 ? 3 : m == 1 ? 800 : m == 2 ? 90 : 4);
+                        double step = m == 0 ? 1 : m == 1 ? 100 : m == 2 ? 15 : 1;
+                        rules += "r" + to_string(generated++) + ": " + metrics[m] + kinds[k] + " min " + to_string(mi) +
+                                 " per " + win + " >= " + to_string(first + step * t) + "\n";
+                    }
+    AchievementEngine engine(rules);
+
+    const uint32_t users = 50000;
+    const size_t events = 5000000;
+    SessionLog log;
+    log.reserve(events);
+    mt19937 rng(12);
+    int64_t ts = 1700000000;
+    for (size_t i = 0; i < events; ++i) {
+        ts += rng() % 13; // ~1 year in total
+        WorkoutKind k = static_cast<WorkoutKind>(rng() % kWorkoutKinds);
+        uint16_t dur = (uint16_t)(15 + rng() % 60);
+        log.append(rng() % users, ts, 0, k, dur, 6, 0, (float)(dur * 8));
+    }
+    auto t0 = chrono::steady_clock::now();
+    vector<AchievementAward> awards = engine.processLog(log, 1);
+    double s = secondsSince(t0);
+    size_t weekly = 0;
+    for (const auto &a : awards) weekly += engine.ruleName(a.rule) == "five-a-week";
+    // five-a-week by brute force: weeks (Monday to Sunday, UTC) in which a member had 5+ sessions
+    unordered_map<uint64_t, uint32_t> perWeek;
+    for (size_t i = 0; i < events; ++i)
+        ++perWeek[(uint64_t)log.user[i] << 32 | (uint32_t)((log.timestamp[i] / 86400 + 3) / 7)];
+    size_t expectedWeekly = 0;
+    for (const auto &w : perWeek) expectedWeekly += w.second >= 5;
+
+    // the same sessions with rows displaced by up to 1000 places, replayed on 4 threads
+    vector<size_t> perm(events);
+    iota(perm.begin(), perm.end(), 0);
+    for (size_t i = 0; i + 1 < events; ++i) swap(perm[i], perm[min(events - 1, i + rng() % 1000)]);
+    SessionLog shuffled;
+    shuffled.reserve(events);
+    for (size_t i : perm)
+        shuffled.append(log.user[i], log.timestamp[i], 0, log.kind[i], log.durationMin[i], 6, 0, log.calories[i]);
+    engine.reset();
+    vector<AchievementAward> again = engine.processLog(shuffled, 4);
+    auto key = [](const AchievementAward &a) { return make_tuple(a.user, a.rule, a.timestamp); };
+    auto byKey = [&](const AchievementAward &x, const AchievementAward &y) { return key(x) < key(y); };
+    sort(awards.begin(), awards.end(), byKey);
+    sort(again.begin(), again.end(), byKey);
+    bool same = awards.size() == again.size() && engine.lateEvents() == 0 &&
+                equal(awards.begin(), awards.end(), again.begin(),
+                      [&](const AchievementAward &x, const AchievementAward &y) { return key(x) == key(y); });
+
+    cout << "achievements: " << engine.ruleCount() << " rules in " << engine.accumulatorCount()
+         << " shared accumulators, " << events << " events in " << fixed << setprecision(2) << s << " s ("
+         << setprecision(1) << events / s / 1e6 << " M events/s), " << awards.size() << " awards ("
+         << weekly << " five-a-week, brute force " << (weekly == expectedWeekly ? "agrees" : "DISAGREES")
+         << "), state " << engine.stateBytes() / (1 << 20) << " MiB; out-of-order log on 4 threads gives the same awards "
+         << (same ? "yes" : "NO") << "\n";
+}
+
+// rule table over 1M members: batch evaluation, single lookups, hot reload
+void benchRecommendationRules() {
+    const char *rulesText =
+        "plan gentle: cardio 30 3 met=3.5 Brisk walk; flexibility 15 2 Stretch\n"
+        "plan walk-start: cardio 35 4 met=4.0 Incline walk; strength 20 4 Bodyweight basics\n"
+        "plan hiit: cardio 25 9 met=10 HIIT; strength 30 7 Full-body strength; flexibility 15 2 Stretch\n"
+        "plan recover: flexibility 30 2 Yoga; cardio 20 3 met=3.0 Easy walk\n"
+        "plan hypertrophy: strength 50 8 Hypertrophy; cardio 20 4 met=5.5 Light cardio; flexibility 20 3 Mobility\n"
+        "plan strength-mix: strength 40 7 Strength circuit; cardio 25 5 met=6 Cycling\n"
+        "plan maintain: cardio 30 5 met=6 Steady-state; strength 30 5 Maintenance strength\n"
+        "load>=4000 -> recover\n"
+        "goal=lose age>=60 -> gentle\n"
+        "goal=lose bmi>=30 -> walk-start\n"
+        "goal=lose age<18 -> gentle\n"
+        "goal=lose -> hiit\n"
+        "goal=build age>=55 -> strength-mix\n"
+        "goal=build gender=F bmi<20 -> strength-mix\n"
+        "goal=build -> hypertrophy\n"
+        "bmi>=35 -> walk-start\n"
+        "* -> maintain\n";
+    string path = (filesystem::temp_directory_path() / "fitness_bench_rules.txt").string();
+    { ofstream(path) << rulesText; }
+    RecommendationRules rules(path);
+    shared_ptr<const RecommendationTable> table = rules.current();
+
+    UserStore store;
+    const size_t n = 1000000;
+    store.reserve(n);
+    mt19937 rng(21);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    vector<float> load(n);
+    for (size_t i = 0; i < n; ++i) {
+        store.add(i, "m", 14 + rng() % 70, 45 + rng() % 80, 150 + rng() % 50, "MFX"[rng() % 3], goals[rng() % 3]);
+        load[i] = (float)(rng() % 5000);
+    }
+    auto t0 = chrono::steady_clock::now();
+    vector<uint16_t> ids = table->evaluate(store, &load, 1);
+    double batchS = secondsSince(t0);
+    vector<size_t> perPlan(table->planCount());
+    for (uint16_t id : ids) if (id != RecommendationTable::kNoPlan) ++perPlan[id];
+
+    const ProfileColumns &prof = store.columns();
+    t0 = chrono::steady_clock::now();
+    size_t sink = 0;
+    for (size_t i = 0; i < n; ++i) sink += table->lookup(prof.age[i], 25.0, prof.gender[i], GoalKind::Lose, load[i]);
+    double singleS = secondsSince(t0);
+
+    { ofstream(path) << rulesText << "# edited\n"; }
+    filesystem::last_write_time(path, filesystem::last_write_time(path) + chrono::seconds(1));
+    t0 = chrono::steady_clock::now();
+    bool reloaded = rules.reloadIfChanged();
+    double reloadS = secondsSince(t0);
+    remove(path.c_str());
+
+    cout << "recommendation rules: " << table->cellCount() << " cells, " << table->uncoveredCells()
+         << " uncovered; batch " << fixed << setprecision(1) << batchS * 1e9 / n << " ns/member, single lookup "
+         << singleS * 1e9 / n << " ns, reload " << (reloaded ? "ok" : "failed") << " in " << setprecision(2)
+         << reloadS * 1e6 << " us (sink " << sink % 7 << ")\n ";
+    for (size_t p = 0; p < perPlan.size(); ++p) cout << " " << table->planName((uint16_t)p) << "=" << perPlan[p];
+    cout << "\n";
+
+    // numbers with trailing garbage are refused, not truncated
+    int refused = 0;
+    for (const char *bad : {"plan a: cardio 30 5 met=7abc Run\n* -> a\n", "plan a: cardio 30 5 Run\nbmi<25x -> a\n",
+                            "plan a: cardio 30 5 Run\nage>=40.5.1 -> a\n"}) {
+        try { RecommendationTable::compile(bad); } catch (const FitnessException &) { ++refused; }
+    }
+    cout << "recommendation rules: malformed numbers refused " << refused << "/3\n";
+}
+
+// two years of weekly behaviour for 100k members replayed through three strategies
+void benchReplay() {
+    const size_t members = 100000, weeks = 104;
+    const int64_t t0s = 1672617600; // Monday 2023-01-02
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(33);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], goals[rng() % 3]);
+
+    // members mostly follow the built-in plan; older members skip the hard sessions more often
+    SessionLog log;
+    log.reserve(members * weeks * 5 / 2);
+    uniform_real_distribution<double> unit(0, 1);
+    const ProfileColumns &prof = store.columns();
+    for (size_t u = 0; u < members; ++u) {
+        WorkoutPlan plan;
+        fillDefaultPlan(goalKindOf(store.goal(u)), plan);
+        double follow = prof.age[u] < 45 ? 0.7 : 0.45;
+        for (size_t w = 0; w < weeks; ++w) {
+            int64_t ts = t0s + (int64_t)w * 7 * 86400;
+            if (unit(rng) < follow) {
+                for (size_t i = 0; i < plan.size(); ++i) {
+                    const Workout &x = plan.at(i);
+                    if (x.getIntensity() >= 8 && prof.age[u] >= 45 && unit(rng) < 0.5) continue;
+                    double kcal = caloriesPerKg(x.kind(), x.getMet(), x.getDuration(), x.getIntensity()) * prof.weightKg[u];
+                    log.append((uint32_t)u, ts + (int64_t)i * 86400 + 3600 * 18, 0, x.kind(), (uint16_t)x.getDuration(),
+                               (uint8_t)x.getIntensity(), 0, (float)kcal, (float)x.getMet());
+                }
+            } else {
+                for (int i = rng() % 3; i > 0; --i)
+                    log.append((uint32_t)u, ts + (rng() % 7) * 86400, 0, static_cast<WorkoutKind>(rng() % kWorkoutKinds),
+                               (uint16_t)(15 + rng() % 30), 5, 0, 200.0f);
+            }
+        }
+    }
+
+    ReplayHarness harness;
+    harness.addBuiltinStrategy();
+    harness.addRuleStrategy("rules", RecommendationTable::compile(
+        "plan gentle: cardio 30 4 met=4 Brisk walk; strength 30 5 Bodyweight; flexibility 15 2 Stretch\n"
+        "plan hiit: cardio 25 9 met=10 HIIT; strength 30 7 Full-body strength; flexibility 15 2 Stretch\n"
+        "plan hypertrophy: strength 50 8 Hypertrophy; cardio 20 4 met=5.5 Light cardio; flexibility 20 3 Mobility\n"
+        "plan maintain: cardio 30 5 met=6 Steady-state; strength 30 5 Maintenance strength\n"
+        "goal=lose age>=45 -> gentle\n"
+        "goal=lose -> hiit\n"
+        "goal=build -> hypertrophy\n"
+        "* -> maintain\n"));
+    WorkoutPlan light;
+    light.emplace<Cardio>("Easy walk", 20, 3, 3.5);
+    int lightId = harness.addPlan("light", light);
+    harness.addStrategy({"light-only", [lightId](const ReplayContext &) { return lightId; }});
+
+    auto t0 = chrono::steady_clock::now();
+    vector<double> agreement;
+    vector<ReplayResult> results = harness.run(store, log, 0, &agreement);
+    double s = secondsSince(t0);
+    cout << "replay: " << members << " members x " << weeks << " weeks, " << log.size() << " sessions in "
+         << fixed << setprecision(2) << s << " s (" << setprecision(1) << log.size() / s / 1e6 << " M sessions/s)\n";
+    ReplayHarness::printReport(results, agreement, cout);
+}
+
+// 10M sessions from 200k members with 0.5% injected anomalies: check cost and detection
+void benchAnomalies() {
+    const size_t members = 200000, sessions = 10000000;
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(51);
+    uniform_real_distribution<double> unit(0, 1);
+    vector<double> metScale(members);
+    vector<uint16_t> usualMin(members);
+    for (size_t i = 0; i < members; ++i) {
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], "Stay healthy");
+        metScale[i] = 0.7 + unit(rng) * 0.7; // how hard this member works relative to the formula
+        usualMin[i] = (uint16_t)(20 + rng() % 50);
+    }
+    const ProfileColumns &prof = store.columns();
+    SessionLog log;
+    log.reserve(sessions);
+    vector<uint8_t> injected(sessions, 0); // 0 clean, 1 hard, 2 member-level
+    for (size_t i = 0; i < sessions; ++i) {
+        uint32_t u = rng() % members;
+        WorkoutKind k = static_cast<WorkoutKind>(rng() % kWorkoutKinds);
+        int dur = max(5, (int)(usualMin[u] * (0.8 + unit(rng) * 0.4)));
+        int inten = 3 + rng() % 6;
+        double kcal = caloriesPerKg(k, defaultMet(k), dur, inten) * prof.weightKg[u] * metScale[u] * (0.9 + unit(rng) * 0.2);
+        double roll = unit(rng);
+        if (roll < 0.0025) { dur = 600; inten = 10; kcal *= 12; injected[i] = 1; }
+        else if (roll < 0.005) { kcal *= 2.6; injected[i] = 2; }
+        log.append(u, 1700000000 + (int64_t)i * 3, 0, k, (uint16_t)dur, (uint8_t)inten, 0, (float)kcal);
+    }
+
+    SessionAnomalyDetector det;
+    auto t0 = chrono::steady_clock::now();
+    vector<AnomalyResult> res = backfillAnomalies(det, log, store, 1);
+    double s = secondsSince(t0);
+    size_t hard = 0, hardHit = 0, soft = 0, softHit = 0, clean = 0, cleanFlag = 0;
+    for (size_t i = 0; i < sessions; ++i) {
+        bool hit = res[i].verdict != SessionVerdict::Ok;
+        if (injected[i] == 1) { ++hard; hardHit += res[i].verdict == SessionVerdict::Quarantined; }
+        else if (injected[i] == 2) { ++soft; softHit += hit; }
+        else { ++clean; cleanFlag += hit; }
+    }
+    cout << "anomalies: " << sessions << " sessions in " << fixed << setprecision(2) << s << " s ("
+         << setprecision(0) << s * 1e9 / sessions << " ns/check), quarantined " << det.count(SessionVerdict::Quarantined)
+         << ", flagged " << det.count(SessionVerdict::Flagged) << "; hard caught " << setprecision(1)
+         << 100.0 * hardHit / hard << "%, member-level caught " << 100.0 * softHit / soft << "%, clean flagged "
+         << setprecision(2) << 100.0 * cleanFlag / clean << "%, state " << det.memoryBytes() / 1024 << " KiB\n";
+
+    // the logger runs every attached component on every session it has the data for
+    string path = (filesystem::temp_directory_path() / "fitness_bench_anomalies.txt").string();
+    remove(path.c_str());
+    remove((path + ".quarantine").c_str());
+    SessionAnomalyDetector live;
+    SessionDeduplicator seen(3, 1000);
+    HierarchyRollup tree;
+    tree.addMember(tree.addTeam(tree.addGym(tree.addRegion("north"), "gym"), "team"), "Ann", 7);
+    Logger logger(path);
+    logger.attachAnomalyDetector(&live);
+    logger.attachDeduplicator(&seen);
+    logger.attachRollup(&tree);
+    bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    bool ok;
+    {
+        User ann("Ann", 30, 60.0, 165.0, 'F', "fit");
+        Cardio stroll("Stroll", 60, 2, 1.5), marathon("Treadmill", 600, 10, 9.8);
+        SessionContext ctx;
+        ctx.sessionId = "s-1";
+        ctx.sessionTime = time(nullptr);
+        ctx.member = 7;
+        // a slow walk is plausible at its own MET (1.5) though far below the cardio default (7)
+        LogOutcome first = logger.logSession(ann, stroll, stroll.estimateCalories(ann), ctx);
+        LogOutcome retry = logger.logSession(ann, stroll, stroll.estimateCalories(ann), ctx);
+        ctx.sessionId = "s-2";
+        LogOutcome huge = logger.logSession(ann, marathon, marathon.estimateCalories(ann), ctx);
+        // no member and no id: the global rules still run
+        logger.logSession(ann, marathon, marathon.estimateCalories(ann));
+        ifstream quarantine(path + ".quarantine");
+        size_t quarantined = 0;
+        for (string line; getline(quarantine, line);) ++quarantined;
+        ok = first.logged() && retry.dedup == DedupResult::Duplicate && huge.verdict == SessionVerdict::Quarantined &&
+             quarantined == 2 && tree.totals(0).sessions == 1;
+    }
+    Person::traceLifecycle = trace;
+    remove(path.c_str());
+    remove((path + ".quarantine").c_str());
+    cout << "anomalies: logger runs dedup, detection (session MET) and rollup on one path " << (ok ? "yes" : "NO") << "\n";
+}
+
+// create + merge + evaluate a three-workout plan: inline slots vs one heap object per workout
+void benchPlans() {
+    const bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    auto member = make_unique<Person>("Bench", 30, 72.5, 175.0, 'M');
+    const Person &p = *member;
+    const int rounds = 1000000;
+    double sink = 0;
+    auto t0 = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        WorkoutPlan a;
+        a.emplace<Cardio>("Jogging", 30, 6, 7.0);
+        a.emplace<Strength>("Circuit", 40, 7);
+        a.emplace<Flexibility>("Yoga", 20, 3);
+        WorkoutPlan merged = a + a;
+        sink += merged.totalCaloriesFor(p);
+    }
+    double inlineS = secondsSince(t0);
+    t0 = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i) {
+        WorkoutPlan a;
+        a.add(new Cardio("Jogging", 30, 6, 7.0));
+        a.add(new Strength("Circuit", 40, 7));
+        a.add(new Flexibility("Yoga", 20, 3));
+        WorkoutPlan merged;
+        for (int k = 0; k < 2; ++k)
+            for (size_t j = 0; j < a.size(); ++j) merged.add(a.at(j).clone());
+        sink += merged.totalCaloriesFor(p);
+    }
+    double heapS = secondsSince(t0);
+    cout << "plans: create+merge+evaluate inline " << fixed << setprecision(0) << inlineS * 1e9 / rounds
+         << " ns, heap workouts " << heapS * 1e9 / rounds << " ns (sizeof(WorkoutPlan) " << sizeof(WorkoutPlan)
+         << ", checksum " << setprecision(1) << sink / rounds << ")\n";
+    member.reset();
+    Person::traceLifecycle = trace;
+}
+
+// one request (member, recommended plan, merged plan, formatted text) per iteration,
+// with every allocation from the default heap vs a per-request monotonic arena
+void benchPmr() {
+    const bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    auto request = [&](size_t i, pmr::memory_resource *mr) {
+        Person::allocator_type alloc(mr);
+        User u("Member with a long display name", 20 + (int)(i % 50), 60.0 + (double)(i % 40), 175.0, 'F',
+               goals[i % 3], alloc);
+        WorkoutPlan recommended(alloc);
+        fillDefaultPlan(goalKindOf(goals[i % 3]), recommended);
+        WorkoutPlan extras(alloc);
+        extras.emplace<Cardio>("Jogging around the park", 30, 6, 7.0);
+        extras.emplace<Strength>("Circuit training session", 40, 7);
+        extras.emplace<Flexibility>("Evening yoga and stretching", 20, 3);
+        extras.emplace<Cardio>("Cycling to work and back", 45, 5, 6.5);
+        WorkoutPlan merged = recommended + extras; // spills past the inline slots
+        pmr::string out(alloc);
+        out += u.getName();
+        out += "\n";
+        merged.format(out);
+        return out.size() + (size_t)merged.totalCaloriesFor(u);
+    };
+    const size_t perThread = 200000;
+    auto run = [&](unsigned threads, bool arena) {
+        atomic<size_t> sink{0};
+        auto t0 = chrono::steady_clock::now();
+        vector<thread> pool;
+        for (unsigned t = 0; t < threads; ++t)
+            pool.emplace_back([&, t]() {
+                size_t local = 0;
+                alignas(max_align_t) static thread_local char buffer[8192];
+                for (size_t i = 0; i < perThread; ++i) {
+                    if (arena) {
+                        pmr::monotonic_buffer_resource mr(buffer, sizeof buffer);
+                        local += request(i + t, &mr);
+                    } else {
+                        local += request(i + t, pmr::new_delete_resource());
+                    }
+                }
+                sink += local;
+            });
+        for (thread &th : pool) th.join();
+        double s = secondsSince(t0);
+        cout << "  " << threads << " thread(s), " << (arena ? "arena  " : "default") << ": " << fixed << setprecision(0)
+             << s * 1e9 / (perThread * threads) << " ns/request (" << setprecision(2)
+             << perThread * threads / s / 1e6 << " M/s, checksum " << sink.load() % 1000 << ")\n";
+    };
+    cout << "pmr: request = member + recommended plan + merged plan + formatted text\n";
+    for (unsigned threads : {1u, 4u}) {
+        run(threads, false);
+        run(threads, true);
+    }
+    Person::traceLifecycle = trace;
+}
+
+// scoring 20M members with node-local, huge-page backed partitions vs one flat copy
+void benchNuma() {
+    NumaTopology topo = NumaTopology::detect();
+    const size_t n = 20000000;
+    UserStore store;
+    store.reserve(n);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < n; ++i) store.add(i, "", 30, 50.0 + (double)(i % 70), 175.0, 'M', goals[i % 3]);
+    array<float, 3> perKg{};
+    for (GoalKind g : {GoalKind::Lose, GoalKind::Build, GoalKind::Maintain}) {
+        WorkoutPlan plan;
+        fillDefaultPlan(g, plan);
+        for (size_t i = 0; i < plan.size(); ++i) {
+            const Workout &w = plan.at(i);
+            perKg[(size_t)g] += (float)caloriesPerKg(w.kind(), w.getMet(), w.getDuration(), w.getIntensity());
+        }
+    }
+    cout << "numa: " << topo.nodes() << " node(s)" << (topo.fromSysfs ? "" : " (no sysfs topology)")
+         << ", THP " << transparentHugePageMode() << "\n";
+    double best[2] = {0, 0};
+    for (int mode = 0; mode < 2; ++mode) {
+        bool numa = mode == 1;
+        NumaPopulation pop(store, topo, numa);
+        double total = 1e30;
+        vector<NumaPopulation::NodeStats> stats;
+        for (int rep = 0; rep < 5; ++rep) {
+            auto t0 = chrono::steady_clock::now();
+            vector<NumaPopulation::NodeStats> s = pop.score(perKg);
+            double secs = secondsSince(t0);
+            if (secs < total) { total = secs; stats = s; }
+        }
+        best[mode] = total;
+        cout << "  " << (numa ? "numa-aware" : "flat      ") << (numa && !pop.isNumaAware() ? " (single node, same as flat)" : "")
+             << ": " << fixed << setprecision(1) << total * 1e3 << " ms, " << (pop.usesExplicitHugePages() ? "hugetlbfs" : "THP/4k")
+             << " pages, check " << setprecision(1) << pop.scoreOf(n / 2) << "\n";
+        for (const auto &s : stats)
+            cout << "    node " << s.node << ": " << s.members << " members, " << setprecision(2) << s.gbPerSecond << " GB/s\n";
+    }
+    cout << "  speedup " << setprecision(2) << best[0] / best[1] << "x\n";
+}
+
+// 1M members: goal plans, program weeks and small customizations, interned vs copied
+void benchPlanInterning() {
+    const size_t members = 1000000;
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(95);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, 'F', goals[rng() % 3]);
+    vector<TrainingProgram> programs = generatePrograms(store, 1);
+
+    // counts the bytes a plan really holds beyond its own object
+    struct CountingResource : pmr::memory_resource {
+        size_t live = 0;
+        void *do_allocate(size_t bytes, size_t align) override {
+            live += bytes;
+            return pmr::new_delete_resource()->allocate(bytes, align);
+        }
+        void do_deallocate(void *p, size_t bytes, size_t align) override {
+            live -= bytes;
+            pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+        bool do_is_equal(const pmr::memory_resource &o) const noexcept override { return this == &o; }
+    } counting;
+
+    PlanInterner interner;
+    vector<PlanInterner::Handle> handles(members);
+    size_t copiedBytes = 0; // measured: what 1M private copies would hold
+    auto t0 = chrono::steady_clock::now();
+    for (size_t i = 0; i < members; ++i) {
+        WorkoutPlan plan(&counting); // a request-scoped resource; the interner must not keep it
+        uint32_t r = rng() % 100;
+        if (r < 50) programs[i].fillPlan((int)(rng() % 12), plan); // following a program
+        else fillDefaultPlan(goalKindOf(store.goal(i)), plan);
+        if (r % 10 == 0) plan.emplace<Flexibility>("Cool-down stretch", 5 + 5 * (int)(rng() % 3), 2); // customized
+        copiedBytes += sizeof(WorkoutPlan) + counting.live;
+        handles[i] = interner.intern(std::move(plan));
+    }
+    double internS = secondsSince(t0);
+    bool onDefault = true;
+    for (const auto &h : handles) onDefault &= h->get_allocator() == WorkoutPlan::allocator_type();
+
+    // edits: lengthen the first workout by 5 minutes, as the UI would
+    const size_t edits = 200000;
+    t0 = chrono::steady_clock::now();
+    for (size_t e = 0; e < edits; ++e) {
+        size_t i = rng() % members;
+        handles[i] = interner.edit(handles[i], [](WorkoutPlan &p) {
+            WorkoutPlan longer;
+            for (size_t k = 0; k < p.size(); ++k) {
+                const Workout &w = p.at(k);
+                int d = w.getDuration() + (k == 0 ? 5 : 0);
+                if (w.kind() == WorkoutKind::Cardio) longer.emplace<Cardio>(w.nameView(), d, w.getIntensity(), w.getMet());
+                else if (w.kind() == WorkoutKind::Strength) longer.emplace<Strength>(w.nameView(), d, w.getIntensity());
+                else longer.emplace<Flexibility>(w.nameView(), d, w.getIntensity());
+            }
+            p = std::move(longer);
+        });
+    }
+    double editS = secondsSince(t0);
+    size_t same = 0;
+    for (size_t i = 1; i < members; ++i) same += handles[i] == handles[i - 1];
+    interner.purge();
+    // measured the same way: one copy of each live shared plan, plus its control block and the handles
+    unordered_set<const WorkoutPlan *> unique;
+    size_t sharedBytes = members * sizeof(PlanInterner::Handle);
+    for (const auto &h : handles) {
+        if (!unique.insert(h.get()).second) continue;
+        WorkoutPlan copy(*h, &counting);
+        sharedBytes += sizeof(WorkoutPlan) + 2 * sizeof(long) + counting.live;
+    }
+    cout << "plan interning: " << members << " members share " << interner.uniquePlans() << " plans (hit rate "
+         << fixed << setprecision(1) << 100.0 * interner.hitRate() << "%); measured memory " << copiedBytes / (1 << 20)
+         << " MiB copied vs " << sharedBytes / (1 << 20) << " MiB shared (" << setprecision(1)
+         << 100.0 * (1.0 - (double)sharedBytes / copiedBytes) << "% saved); intern " << setprecision(0)
+         << internS * 1e9 / members << " ns, edit " << editS * 1e9 / edits << " ns; " << same
+         << " neighbours equal by pointer; shared plans on the default heap " << (onDefault ? "yes" : "NO") << "\n";
+}
+
+// ~150 MB session export (1% bad rows, half without calories) against the 1 GB/s target:
+// the structural scan alone, then importSessions on 1, 2, 4 ... hardware threads
+void benchImport() {
+    const size_t members = 200000, sessions = 3000000;
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(77);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], goals[rng() % 3]);
+    string path = (filesystem::temp_directory_path() / "fitness_bench_import.csv").string();
+    size_t bad = 0;
+    {
+        ofstream ofs(path, ios::binary);
+        ofs << "member_id,timestamp,workout,kind,duration_min,intensity,avg_hr,calories\n";
+        const char *names[] = {"Running", "Cycling", "Bench Press", "Squat", "Yoga", "\"Rowing, indoor\""};
+        const char *kinds[] = {"cardio", "cardio", "strength", "strength", "flexibility", "cardio"};
+        for (size_t i = 0; i < sessions; ++i) {
+            int w = (int)(rng() % 6);
+            bool unknown = rng() % 100 == 0;
+            bad += unknown;
+            ofs << (unknown ? members + rng() % 1000 : rng() % members) << ',' << 1700000000 + i * 13 << ',' << names[w]
+                << ',' << kinds[w] << ',' << 10 + rng() % 80 << ',' << 1 + rng() % 10 << ',' << 90 + rng() % 90 << ',';
+            if (rng() % 2) ofs << 50 + rng() % 700;
+            ofs << '\n';
+        }
+    }
+
+    MappedFile file(path);
+    vector<CsvField> fields;
+    size_t records = 0;
+    auto t0 = chrono::steady_clock::now();
+    csvScanRecords(file.data(), file.data() + file.size(), file.data() + file.size(), ',', fields,
+                   [&](const vector<CsvField> &, const char *) { ++records; });
+    double scanS = secondsSince(t0);
+    const double mb = file.size() / 1e6, target = 1000.0;
+    cout << "import: " << sessions << " sessions, " << fixed << setprecision(1) << mb << " MB; structural scan "
+         << setprecision(0) << mb / scanS << " MB/s on one thread\n";
+
+    unsigned hw = workerCount();
+    double best = 0, perThread = 0;
+    vector<uint32_t> reference;
+    bool same = true;
+    for (unsigned threads = 1;; threads = min(hw, threads * 2)) {
+        BulkImporter importer(threads);
+        SessionLog log;
+        ImportReport rep = importer.importSessions(path, store, log);
+        if (threads == 1) {
+            reference = log.user;
+            perThread = rep.megabytesPerSecond();
+        }
+        same = same && log.user == reference && rep.errors.size() == bad && rep.imported == sessions - bad;
+        best = max(best, rep.megabytesPerSecond());
+        cout << "  " << threads << " thread" << (threads > 1 ? "s" : " ") << ": " << setprecision(0)
+             << rep.megabytesPerSecond() << " MB/s (" << rep.imported << " rows, " << rep.errors.size() << " rejected)\n";
+        if (threads == hw) break;
+    }
+    filesystem::remove(path);
+    cout << "  target " << setprecision(0) << target << " MB/s " << (best >= target ? "met" : "NOT met") << " with "
+         << hw << " hw threads (best " << best << " MB/s; at " << perThread << " MB/s per thread it needs ~"
+         << ceil(target / max(perThread, 1.0)) << " threads); rows match across thread counts " << (same ? "yes" : "NO")
+         << "\n";
+}
+
+void benchPipeline() {
+    const size_t members = 200000, sessions = 2000000;
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(97);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], goals[rng() % 3]);
+
+    // ~1% bad rows; half the rows leave calories to be estimated
+    string path = (filesystem::temp_directory_path() / "fitness_bench_sessions.csv").string();
+    {
+        ofstream ofs(path, ios::binary);
+        ofs << "member_id,timestamp,workout,kind,duration_min,intensity,avg_hr,calories\n";
+        const char *names[] = {"Running", "Cycling", "Bench Press", "Squat", "Yoga", "\"Rowing, indoor\""};
+        const char *kinds[] = {"cardio", "cardio", "strength", "strength", "flexibility", "cardio"};
+        string line;
+        for (size_t i = 0; i < sessions; ++i) {
+            int w = (int)(rng() % 6), bad = (int)(rng() % 100);
+            line = to_string(bad == 0 ? members + rng() % 1000 : rng() % members) + "," + to_string(1700000000 + i * 13) +
+                   "," + names[w] + "," + kinds[w] + "," + to_string(bad == 1 ? 0 : 10 + rng() % 80) + "," +
+                   to_string(1 + rng() % 10) + "," + (rng() % 2 ? to_string(90 + rng() % 90) : string()) + "," +
+                   (rng() % 2 ? to_string(50 + rng() % 700) : string()) + "\n";
+            ofs << line;
+        }
+    }
+
+    BulkImporter importer;
+    SessionLog direct;
+    ImportReport a = importer.importSessions(path, store, direct);
+
+    HierarchyRollup rollup;
+    uint32_t team = rollup.addTeam(rollup.addGym(rollup.addRegion("all"), "gym"), "team");
+    vector<uint32_t> node(members);
+    for (size_t i = 0; i < members; ++i) node[i] = rollup.addMember(team);
+    vector<pair<uint32_t, double>> events;
+    SessionLog staged;
+    vector<PipelineStageStats> stats;
+    ImportReport b = importer.importSessionsStaged(path, store, staged, StagedImportOptions(), &stats,
+        [&](const SessionLog &log, size_t first, size_t last) {
+            events.clear();
+            for (size_t i = first; i < last; ++i) events.push_back({node[log.user[i]], log.calories[i]});
+            rollup.recordBatch(events);
+        });
+
+    // many parsers and a one-batch reorder window: still file order
+    StagedImportOptions tight;
+    tight.parseThreads = 4;
+    tight.reorderWindow = 1;
+    SessionLog ordered;
+    importer.importSessionsStaged(path, store, ordered, tight);
+    // a throwing stage callback surfaces from the import instead of terminating
+    bool rethrown = false;
+    try {
+        SessionLog failing;
+        importer.importSessionsStaged(path, store, failing, StagedImportOptions(), nullptr,
+                                      [](const SessionLog &, size_t, size_t) { throw FitnessException("aggregate failed"); });
+    } catch (const FitnessException &) {
+        rethrown = true;
+    }
+    filesystem::remove(path);
+
+    bool same = a.imported == b.imported && a.errors.size() == b.errors.size() && direct.size() == staged.size() &&
+                equal(direct.calories.begin(), direct.calories.end(), staged.calories.begin()) &&
+                equal(direct.user.begin(), direct.user.end(), staged.user.begin()) &&
+                ordered.user == direct.user && ordered.timestamp == direct.timestamp;
+    cout << "pipeline: " << sessions << " sessions, " << fixed << setprecision(1) << b.bytes / 1e6 << " MB, "
+         << thread::hardware_concurrency() << " hw threads; chunked import " << a.megabytesPerSecond()
+         << " MB/s, staged " << b.megabytesPerSecond() << " MB/s (" << b.imported << " logged, " << b.errors.size()
+         << " rejected, " << (same ? "same rows" : "ROWS DIFFER") << ", rollup " << setprecision(0)
+         << rollup.totals(team).kcal << " kcal, stage error rethrown " << (rethrown ? "yes" : "NO") << ")\n";
+    printPipelineStats(cout, stats, b.seconds);
+}
+
+void benchScheduler() {
+    const size_t members = 50000, requests = 4000;
+    const auto interval = chrono::microseconds(250);
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(98);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], goals[rng() % 3]);
+    bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    auto app = make_unique<FitnessApp>((filesystem::temp_directory_path() / "fitness_bench_sched.txt").string());
+    vector<User> askers;
+    for (size_t r = 0; r < requests; ++r) askers.push_back(store.toUser(rng() % members));
+
+    // open-loop arrivals; latency runs from the intended arrival to the finished plan
+    auto interactive = [&](PriorityScheduler &sched) {
+        vector<double> latency(requests);
+        vector<future<void>> done;
+        done.reserve(requests);
+        auto start = chrono::steady_clock::now();
+        for (size_t r = 0; r < requests; ++r) {
+            auto arrival = start + interval * r;
+            this_thread::sleep_until(arrival);
+            done.push_back(sched.submit(WorkClass::Interactive, [&, r, arrival] {
+                WorkoutPlan plan = app->recommendPlanForUser(askers[r]);
+                latency[r] = chrono::duration<double, micro>(chrono::steady_clock::now() - arrival).count();
+            }));
+        }
+        for (future<void> &f : done) f.get();
+        sort(latency.begin(), latency.end());
+        return make_pair(latency[requests / 2], latency[requests * 99 / 100]);
+    };
+
+    pair<double, double> alone, plain, scheduled;
+    double plainRate = 0, scheduledRate = 0, batchShare = 0;
+    {
+        PriorityScheduler sched;
+        alone = interactive(sched);
+    }
+    {
+        // today: the batch job on its own threads, left to the OS scheduler
+        PriorityScheduler sched;
+        atomic<bool> stop{false};
+        atomic<size_t> scored{0};
+        vector<float> out(members);
+        vector<thread> batch;
+        unsigned n = workerCount();
+        auto t0 = chrono::steady_clock::now();
+        for (unsigned t = 0; t < n; ++t)
+            batch.emplace_back([&, t] {
+                for (size_t lo = members * t / n, end = members * (t + 1) / n; !stop.load(memory_order_relaxed);) {
+                    size_t hi = min(end, lo + 256);
+                    app->scoreMembers(store, out, lo, hi);
+                    scored.fetch_add(hi - lo, memory_order_relaxed);
+                    lo = hi == end ? members * t / n : hi;
+                }
+            });
+        plain = interactive(sched);
+        stop = true;
+        for (thread &t : batch) t.join();
+        plainRate = scored / secondsSince(t0);
+    }
+    {
+        PriorityScheduler sched;
+        atomic<bool> stop{false};
+        size_t passes = 0;
+        vector<float> out;
+        auto t0 = chrono::steady_clock::now();
+        thread nightly([&] {
+            while (!stop.load()) {
+                app->submitPopulationScoring(sched, store, out).get();
+                ++passes;
+            }
+        });
+        scheduled = interactive(sched);
+        stop = true;
+        nightly.join();
+        scheduledRate = passes * members / secondsSince(t0);
+        WorkClassStats i = sched.stats(WorkClass::Interactive), b = sched.stats(WorkClass::Batch);
+        batchShare = b.runSeconds / max(1e-9, i.runSeconds + b.runSeconds);
+    }
+    askers.clear();
+    app.reset();
+    Person::traceLifecycle = trace;
+
+    cout << "scheduler: interactive p50/p99 us over " << requests << " requests, " << workerCount() << " worker(s): alone "
+         << fixed << setprecision(0) << alone.first << "/" << alone.second << "; batch on plain threads " << plain.first
+         << "/" << plain.second << " (" << plainRate << " members/s); batch via scheduler " << scheduled.first << "/"
+         << scheduled.second << " (" << scheduledRate << " members/s, " << setprecision(1) << 100 * batchShare
+         << "% of task time)\n";
+}
+
+// Open-loop load test: 0.5x capacity, then a spike, then 0.5x again; half the
+// requests accept degraded answers.
+void benchAdmission() {
+    const size_t members = 20000;
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(99);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], goals[rng() % 3]);
+    bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    string path = (filesystem::temp_directory_path() / "fitness_bench_admission.txt").string();
+
+    // capacity with every worker serving flat out, each logging to its own file as the
+    // server's workers do
+    unsigned threads = workerCount();
+    double capacity;
+    {
+        FitnessApp app(path);
+        atomic<size_t> n{0};
+        auto t0 = chrono::steady_clock::now();
+        runParts(threads, [&](unsigned t) {
+            Logger log(path + "." + to_string(t));
+            size_t k = 0;
+            while (secondsSince(t0) < 0.3) app.serveRequest(store, (k++ * threads + t) % members, log);
+            n += k;
+            filesystem::remove(log.getFilename());
+        });
+        capacity = n / secondsSince(t0);
+    }
+    cout << "admission: capacity ~" << fixed << setprecision(0) << capacity << " req/s on " << threads
+         << " worker(s), SLO 100 ms\n";
+    // by-end%: share served before the last arrival. The unbounded FIFO never sheds, so
+    // its by-end% is what the server (sharing the machine with the load generator) can
+    // serve during the spike at all - the ceiling for the admission-controlled rows.
+    cout << left << setw(22) << "scenario" << right << setw(9) << "requests" << setw(9) << "served%" << setw(9)
+         << "by-end%" << setw(10) << "degraded%" << setw(10) << "rejected%" << setw(9) << "p50 ms" << setw(9) << "p99 ms"
+         << setw(11) << "goodput/s" << setw(11) << "peak queue" << setw(7) << "limit" << setw(9) << "stats ok" << "\n";
+
+    for (double spike : {2.0, 5.0})
+        for (bool control : {false, true}) {
+            struct Outcome {
+                ResponseStatus status = ResponseStatus::Rejected;
+                double ms = -1.0;
+                double doneAt = 0.0; // seconds since the first arrival
+            };
+            const double phases[3][2] = {{0.5, 0.5}, {spike, 1.0}, {0.5, 0.5}}; // load x capacity, seconds
+            size_t total = 0;
+            double arrivalEnd = 0.0;
+            for (auto &ph : phases) {
+                total += (size_t)(ph[0] * capacity * ph[1]);
+                arrivalEnd += ph[1];
+            }
+            vector<Outcome> out(total);
+            ServerStats st;
+            vector<string> logs;
+            auto t0 = chrono::steady_clock::now();
+            {
+                FitnessApp app(path);
+                AdmissionOptions opt;
+                opt.enabled = control;
+                RecommendationServer server(app, store, opt);
+                size_t r = 0;
+                double phaseStart = 0.0;
+                for (auto &ph : phases) {
+                    size_t count = (size_t)(ph[0] * capacity * ph[1]);
+                    for (size_t k = 0; k < count; ++k, ++r) {
+                        double at = phaseStart + k / (ph[0] * capacity);
+                        while (secondsSince(t0) < at) this_thread::sleep_for(chrono::microseconds(200));
+                        server.submit(rng() % members, r % 2 == 0, [&out, r, t0](const RecommendationResponse &resp) {
+                            out[r] = {resp.status, resp.latencyMs, secondsSince(t0)};
+                        });
+                    }
+                    phaseStart += ph[1];
+                }
+                // every request ends in exactly one of these counters
+                do {
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                    st = server.stats();
+                } while (st.served + st.rejectedAtAdmission + st.droppedFromQueue < total);
+                logs = server.logFiles();
+            }
+            double wall = secondsSince(t0);
+            for (const string &f : logs) filesystem::remove(f);
+            vector<double> lat;
+            size_t served = 0, degraded = 0, goodput = 0, byEnd = 0;
+            for (const Outcome &o : out) {
+                if (o.status == ResponseStatus::Served) {
+                    ++served;
+                    byEnd += o.doneAt <= arrivalEnd;
+                    lat.push_back(o.ms);
+                    goodput += o.ms <= 100.0;
+                } else if (o.status == ResponseStatus::Degraded) {
+                    ++degraded;
+                }
+            }
+            sort(lat.begin(), lat.end());
+            auto pct = [&](double q) { return lat.empty() ? 0.0 : lat[(size_t)(q * (lat.size() - 1))]; };
+            ostringstream name;
+            name << setprecision(0) << fixed << spike << "x spike, " << (control ? "admission" : "unbounded");
+            bool statsOk = st.served == served && st.degraded == degraded;
+            cout << left << setw(22) << name.str() << right << setw(9) << total << setprecision(1) << setw(9)
+                 << 100.0 * served / total << setw(9) << 100.0 * byEnd / total << setw(10) << 100.0 * degraded / total
+                 << setw(10) << 100.0 * (total - served - degraded) / total << setw(9) << pct(0.5) << setw(9) << pct(0.99)
+                 << setw(11) << setprecision(0) << goodput / wall << setw(11) << st.peakQueue << setw(7)
+                 << (control ? to_string(st.limit) : string("-")) << setw(9) << (statsOk ? "yes" : "NO") << "\n";
+        }
+    filesystem::remove(path);
+    Person::traceLifecycle = trace;
+}
+
+struct MicroBatchStats {
+    uint64_t requests = 0;
+    uint64_t batches = 0;
+    uint64_t planEvaluations = 0; // kcalPerKg() calls, once per distinct plan per batch
+    double kernelSeconds = 0.0;   // grouping and scaling, excluding callbacks
+    double meanBatch() const { return batches ? (double)requests / batches : 0.0; }
+};
+
+// The micro-batching experiment behind bench microbatch; nothing serves through it. It
+// collects estimate requests for up to `window` after the first one arrives (or until
+// maxBatch are waiting) and evaluates them together on one thread: each distinct plan
+// (interned plans compare by pointer) is walked once, then scaled by each weight.
+// Callbacks run on the batcher thread. A zero window flushes whatever is queued as soon
+// as the batcher is free. A plan walk costs less than the hand-off, so batching only
+// added latency and cost throughput against calling totalCaloriesFor directly.
+class CalorieMicroBatcher {
+public:
+    using Callback = function<void(double)>;
+
+private:
+    using Clock = chrono::steady_clock;
+    struct Request {
+        PlanInterner::Handle plan;
+        double weightKg;
+        Callback done;
+    };
+
+    chrono::nanoseconds window;
+    size_t maxBatch;
+    mutex m;
+    condition_variable cv;
+    deque<Request> pending;
+    Clock::time_point firstArrival;
+    bool stopping = false;
+    MicroBatchStats counters;
+    thread worker;
+
+    void run() {
+        vector<Request> batch;
+        unordered_map<const WorkoutPlan *, double> perPlan;
+        vector<double> out;
+        unique_lock<mutex> lk(m);
+        for (;;) {
+            cv.wait(lk, [&] { return stopping || !pending.empty(); });
+            if (pending.empty()) return;
+            if (window.count() > 0 && !stopping)
+                cv.wait_until(lk, firstArrival + window, [&] { return stopping || pending.size() >= maxBatch; });
+            size_t take = min(pending.size(), maxBatch);
+            move(pending.begin(), pending.begin() + take, back_inserter(batch));
+            pending.erase(pending.begin(), pending.begin() + take);
+            lk.unlock(); // leftovers have waited long enough: the next round flushes them at once
+
+            auto t0 = Clock::now();
+            size_t n = batch.size();
+            perPlan.clear();
+            out.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                auto it = perPlan.find(batch[i].plan.get());
+                if (it == perPlan.end()) it = perPlan.emplace(batch[i].plan.get(), batch[i].plan->kcalPerKg()).first;
+                out[i] = it->second * batch[i].weightKg;
+            }
+            double s = chrono::duration<double>(Clock::now() - t0).count();
+            for (size_t i = 0; i < n; ++i) batch[i].done(out[i]);
+            batch.clear();
+
+            lk.lock();
+            counters.requests += n;
+            counters.batches++;
+            counters.planEvaluations += perPlan.size();
+            counters.kernelSeconds += s;
+        }
+    }
+
+public:
+    explicit CalorieMicroBatcher(chrono::microseconds batchWindow = chrono::microseconds(100), size_t maxBatchSize = 256)
+        : window(batchWindow), maxBatch(max<size_t>(1, maxBatchSize)) {
+        worker = thread([this] { run(); });
+    }
+    // completes every queued request
+    ~CalorieMicroBatcher() {
+        {
+            lock_guard<mutex> lk(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+    CalorieMicroBatcher(const CalorieMicroBatcher &) = delete;
+    CalorieMicroBatcher &operator=(const CalorieMicroBatcher &) = delete;
+
+    // done(plan->totalCaloriesFor(person with weightKg)), from the batcher thread
+    void submit(PlanInterner::Handle plan, double weightKg, Callback done) {
+        bool wake;
+        {
+            lock_guard<mutex> lk(m);
+            if (pending.empty()) firstArrival = Clock::now();
+            pending.push_back({std::move(plan), weightKg, std::move(done)});
+            // the batcher only needs a nudge for the first request and for a full batch
+            wake = pending.size() == 1 || pending.size() >= maxBatch;
+        }
+        if (wake) cv.notify_one();
+    }
+
+    MicroBatchStats stats() {
+        lock_guard<mutex> lk(m);
+        return counters;
+    }
+};
+
+// Throughput (two producers submitting flat out) and latency from submit to result
+// (open loop at 100k req/s) of totalCaloriesFor through the micro-batcher, per window.
+void benchMicroBatch() {
+    const size_t members = 20000, requests = 400000, openLoopRate = 100000;
+    bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    mt19937 rng(100);
+    PlanInterner interner;
+    vector<PlanInterner::Handle> plans;
+    for (int g = 0; g < 3; ++g)
+        for (int extra = 0; extra < 8; ++extra) {
+            WorkoutPlan p;
+            fillDefaultPlan(static_cast<GoalKind>(g), p);
+            p.emplace<Cardio>("Walk", 10 + 5 * extra, 3, 3.5);
+            plans.push_back(interner.intern(std::move(p)));
+        }
+    vector<User> people;
+    vector<uint32_t> planOf(members);
+    people.reserve(members);
+    for (size_t i = 0; i < members; ++i) {
+        people.emplace_back("m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], "Stay healthy");
+        planOf[i] = (uint32_t)(rng() % plans.size());
+    }
+    vector<uint32_t> who(requests);
+    for (uint32_t &w : who) w = (uint32_t)(rng() % members);
+
+    // direct: each request walks its plan (virtual call per workout)
+    double directSeconds;
+    double checksum = 0.0;
+    {
+        auto t0 = chrono::steady_clock::now();
+        for (size_t r = 0; r < requests; ++r) checksum += plans[planOf[who[r]]]->totalCaloriesFor(people[who[r]]);
+        directSeconds = secondsSince(t0);
+    }
+    cout << "microbatch: " << requests << " totalCaloriesFor requests over " << plans.size()
+         << " interned plans; direct " << fixed << setprecision(0) << requests / directSeconds << " req/s ("
+         << setprecision(1) << directSeconds * 1e9 / requests << " ns each)\n";
+    cout << setw(10) << "window us" << setw(12) << "req/s" << setw(11) << "mean batch" << setw(15) << "kernel ns/req"
+         << setw(16) << "p50 us @100k/s" << setw(10) << "p99 us" << setw(11) << "mean batch" << "  result\n";
+
+    for (int windowUs : {0, 50, 100, 200}) {
+        double rate, meanBatch, kernelNs, batchAtRate;
+        bool exact = true;
+        {
+            CalorieMicroBatcher batcher{chrono::microseconds(windowUs), 256};
+            vector<double> out(requests);
+            atomic<size_t> remaining{requests};
+            auto t0 = chrono::steady_clock::now();
+            auto produce = [&](size_t lo, size_t hi) {
+                for (size_t r = lo; r < hi; ++r)
+                    batcher.submit(plans[planOf[who[r]]], people[who[r]].getWeight(), [&out, &remaining, r](double kcal) {
+                        out[r] = kcal;
+                        remaining.fetch_sub(1, memory_order_release);
+                    });
+            };
+            thread second(produce, requests / 2, requests);
+            produce(0, requests / 2);
+            second.join();
+            while (remaining.load(memory_order_acquire)) this_thread::yield();
+            rate = requests / secondsSince(t0);
+            MicroBatchStats st = batcher.stats();
+            meanBatch = st.meanBatch();
+            kernelNs = st.kernelSeconds * 1e9 / st.requests;
+            double sum = 0.0;
+            for (size_t r = 0; r < requests; ++r) sum += out[r];
+            exact = fabs(sum - checksum) <= 1e-9 * checksum;
+        }
+        vector<double> latency;
+        {
+            const size_t n = openLoopRate / 2; // half a second
+            CalorieMicroBatcher batcher{chrono::microseconds(windowUs), 256};
+            latency.assign(n, 0.0);
+            atomic<size_t> remaining{n};
+            auto t0 = chrono::steady_clock::now();
+            for (size_t r = 0; r < n; ++r) {
+                auto due = t0 + chrono::nanoseconds(1000000000ull * r / openLoopRate);
+                while (chrono::steady_clock::now() < due) this_thread::sleep_for(chrono::microseconds(20));
+                auto sent = chrono::steady_clock::now();
+                batcher.submit(plans[planOf[who[r]]], people[who[r]].getWeight(), [&latency, &remaining, r, sent](double) {
+                    latency[r] = chrono::duration<double, micro>(chrono::steady_clock::now() - sent).count();
+                    remaining.fetch_sub(1, memory_order_release);
+                });
+            }
+            while (remaining.load(memory_order_acquire)) this_thread::yield();
+            batchAtRate = batcher.stats().meanBatch();
+        }
+        sort(latency.begin(), latency.end());
+        cout << setw(10) << windowUs << setw(12) << setprecision(0) << rate << setw(11) << setprecision(1) << meanBatch
+             << setw(15) << kernelNs << setw(16) << setprecision(0) << latency[latency.size() / 2] << setw(10)
+             << latency[latency.size() * 99 / 100] << setw(11) << setprecision(1) << batchAtRate << "  "
+             << (exact ? "matches" : "DIFFERS") << "\n";
+    }
+    people.clear();
+    Person::traceLifecycle = trace;
+}
+
+#ifdef FITNESS_HAVE_COROUTINES
+void benchAsync() {
+    const size_t members = 20000, requests = 20000, threadBatch = 64;
+    UserStore store;
+    store.reserve(members);
+    mt19937 rng(96);
+    const char *goals[] = {"Lose weight", "Build muscle", "Stay healthy"};
+    for (size_t i = 0; i < members; ++i)
+        store.add(i, "m", 18 + rng() % 60, 50 + rng() % 70, 150 + rng() % 45, "MF"[rng() % 2], goals[rng() % 3]);
+    vector<uint64_t> ids(requests);
+    for (uint64_t &id : ids) id = rng() % members;
+
+    bool trace = Person::traceLifecycle;
+    Person::traceLifecycle = false;
+    string path = (filesystem::temp_directory_path() / "fitness_bench_async.txt").string();
+    double sumThreads = 0, sumAsync = 0;
+
+    // thread per request; the logger is not thread-safe, so requests share one lock
+    filesystem::remove(path);
+    auto t0 = chrono::steady_clock::now();
+    {
+        FitnessApp app(path);
+        mutex m;
+        for (size_t b = 0; b < requests; b += threadBatch) {
+            vector<thread> ts;
+            for (size_t i = b; i < min(requests, b + threadBatch); ++i)
+                ts.emplace_back([&, i] {
+                    lock_guard<mutex> lk(m);
+                    sumThreads += app.serveRequest(store, ids[i]);
+                });
+            for (thread &t : ts) t.join();
+        }
+    }
+    double threadS = secondsSince(t0);
+
+    // one loop thread, every request in flight, appends group-committed on the pool
+    filesystem::remove(path);
+    uint64_t writes = 0;
+    t0 = chrono::steady_clock::now();
+    {
+        FitnessApp app(path);
+        EventLoop loop;
+        FileIoPool io(2);
+        for (size_t i = 0; i < requests; ++i)
+            loop.spawn([](FitnessApp &a, EventLoop &l, FileIoPool &p, const UserStore &s, uint64_t id, double &sum) -> Task<void> {
+                sum += co_await a.serveRequestAsync(l, p, s, id);
+            }(app, loop, io, store, ids[i], sumAsync));
+        loop.run();
+        writes = io.fileWriteCount();
+    }
+    double asyncS = secondsSince(t0);
+    filesystem::remove(path);
+    Person::traceLifecycle = trace;
+
+    cout << "async: " << requests << " recommend-estimate-log requests; thread-per-request " << fixed
+         << setprecision(0) << requests / threadS << " req/s, coroutines " << requests / asyncS << " req/s ("
+         << setprecision(1) << threadS / asyncS << "x, " << writes << " file writes for " << requests
+         << " appends); totals " << (fabs(sumThreads - sumAsync) < 1e-6 * sumThreads ? "match" : "DIFFER") << "\n";
+}
+#endif
+
+int runBench(int argc, char **argv) {
+    map<string, function<void()>> benches = {
+        {"dedup", benchDedup},
+        {"calibration", benchCalibration},
+        {"weight-history", benchWeightHistory},
+        {"weight-trend", benchWeightTrend},
+        {"food", benchFood},
+        {"catalog", benchCatalog},
+        {"programs", benchPrograms},
+        {"weekly-optimizer", benchWeeklyOptimizer},
+        {"rollup", benchRollup},
+        {"achievements", benchAchievements},
+        {"recommendation-rules", benchRecommendationRules},
+        {"replay", benchReplay},
+        {"anomalies", benchAnomalies},
+        {"plans", benchPlans},
+        {"pmr", benchPmr},
+        {"numa", benchNuma},
+        {"plan-interning", benchPlanInterning},
+        {"import", benchImport},
+        {"pipeline", benchPipeline},
+        {"scheduler", benchScheduler},
+        {"admission", benchAdmission},
+        {"microbatch", benchMicroBatch},
+#ifdef FITNESS_HAVE_COROUTINES
+        {"async", benchAsync},
+#endif
+    };
+    if (argc < 3 || (string(argv[2]) != "all" && !benches.count(argv[2]))) {
+        cerr << "usage: " << argv[0] << " bench <all";
+        for (auto &b : benches) cerr << "|" << b.first;
+        cerr << ">\n";
+        return 2;
+    }
+    for (auto &b : benches)
+        if (string(argv[2]) == "all" || b.first == argv[2]) b.second();
+    return 0;
+}
+
+// import <profiles.csv> [sessions.csv] [--staged]
+int runImport(int argc, char **argv) {
+    if (argc < 3) { cerr << "usage: " << argv[0] << " import <profiles.csv> [sessions.csv] [--staged]\n"; return 2; }
+    try {
+        BulkImporter importer;
+        UserStore users;
+        SessionLog sessions;
+        ImportReport rp = importer.importProfiles(argv[2], users);
+        cout << "Profiles: ";
+        rp.summarize(cout);
+        if (argc > 3) {
+            bool staged = argc > 4 && string(argv[4]) == "--staged";
+            vector<PipelineStageStats> stages;
+            ImportReport rs = staged ? importer.importSessionsStaged(argv[3], users, sessions, StagedImportOptions(), &stages)
+                                     : importer.importSessions(argv[3], users, sessions);
+            cout << "Sessions: ";
+            rs.summarize(cout);
+            if (staged) printPipelineStats(cout, stages, rs.seconds);
+        }
+    } catch (FitnessException &ex) {
+        cerr << "Import failed: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// search "<query>" [logfile]
+int runSearch(int argc, char **argv) {
+    if (argc < 3) { cerr << "usage: " << argv[0] << " search \"<query>\" [logfile]\n"; return 2; }
+    string path = argc > 3 ? argv[3] : "fitness_log.txt";
+    SessionTextIndex index;
+    auto t0 = chrono::steady_clock::now();
+    index.indexFile(path);
+    auto t1 = chrono::steady_clock::now();
+    vector<uint32_t> hits = index.query(argv[2]);
+    auto t2 = chrono::steady_clock::now();
+    cout << "Indexed " << index.documentCount() << " lines, " << index.termCount() << " terms, "
+         << index.postingBytes() << " posting bytes in " << chrono::duration<double>(t1 - t0).count() << " s\n";
+    cout << hits.size() << " matches in " << chrono::duration<double, micro>(t2 - t1).count() << " us\n";
+    ifstream ifs(path);
+    string line;
+    size_t lineNo = 0, h = 0;
+    while (h < hits.size() && h < 20 && getline(ifs, line)) {
+        if (lineNo++ == hits[h]) { cout << "  " << line << "\n"; ++h; }
+    }
+    return 0;
+}
+
+/* ---------------------------
+   Main — Executes tests and demo
    --------------------------- */
-int main() {
+int main(int argc, char **argv) {
     ios::sync_with_stdio(false);
     cin.tie(nullptr);
 
+    if (argc > 1 && string(argv[1]) == "import") return runImport(argc, argv);
+    if (argc > 1 && string(argv[1]) == "search") return runSearch(argc, argv);
+    if (argc > 1 && string(argv[1]) == "bench") return runBench(argc, argv);
+
     cout << "Starting Fitness App demo...\n\n";
     FitnessApp app;
     app.runDemo();